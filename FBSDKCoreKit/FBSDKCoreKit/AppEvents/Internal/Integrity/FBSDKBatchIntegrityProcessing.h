@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#if !TARGET_OS_TV
+
+#import <FBSDKCoreKit/FBSDKIntegrityProcessing.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Integrity processors that can check many parameters in one pass, see FBSDKIntegrityManager
+NS_SWIFT_NAME(BatchIntegrityProcessing)
+@protocol FBSDKBatchIntegrityProcessing <FBSDKIntegrityProcessing>
+
+/// Batched variant of `processIntegrity:`, returns one boolean per parameter in the same order.
+- (NSArray<NSNumber *> *)processIntegrityForParameters:(NSArray<NSString *> *)parameters;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+#endif
@@ -10,6 +10,8 @@
 
 #import "FBSDKIntegrityManager.h"
 
+#import "FBSDKBatchIntegrityProcessing.h"
+
 #import <FBSDKCoreKit/FBSDKCoreKit.h>
 #import <FBSDKCoreKit_Basics/FBSDKCoreKit_Basics.h>
 
@@ -50,9 +52,31 @@
   NSMutableDictionary<NSString *, id> *params = [NSMutableDictionary dictionaryWithDictionary:parameters];
   NSMutableDictionary<NSString *, id> *restrictiveParams = [NSMutableDictionary dictionary];
 
-  for (NSString *key in parameters.keyEnumerator) {
+  NSArray<NSString *> *keys = parameters.allKeys;
+  NSMutableArray<NSString *> *valueStrings = [NSMutableArray arrayWithCapacity:keys.count];
+  for (NSString *key in keys) {
+    [FBSDKTypeUtility array:valueStrings addObject:[FBSDKTypeUtility coercedToStringValue:parameters[key]] ?: @""];
+  }
+
+  // Run every key and value through the model as a single batch when the processor supports it
+  NSArray<NSNumber *> *batchResults = nil;
+  id<FBSDKIntegrityProcessing> integrityProcessor = self.integrityProcessor;
+  if ([(NSObject *)integrityProcessor conformsToProtocol:@protocol(FBSDKBatchIntegrityProcessing)]) {
+    batchResults = [(id<FBSDKBatchIntegrityProcessing>)integrityProcessor processIntegrityForParameters:[keys arrayByAddingObjectsFromArray:valueStrings]];
+    if (batchResults.count != keys.count * 2) {
+      batchResults = nil;
+    }
+  }
+
+  for (NSUInteger i = 0; i < keys.count; i++) {
+    NSString *key = keys[i];
     NSString *valueString = [FBSDKTypeUtility coercedToStringValue:parameters[key]];
-    BOOL shouldFilter = [self.integrityProcessor processIntegrity:key] || [self.integrityProcessor processIntegrity:valueString];
+    BOOL shouldFilter;
+    if (batchResults) {
+      shouldFilter = batchResults[i].boolValue || batchResults[keys.count + i].boolValue;
+    } else {
+      shouldFilter = [integrityProcessor processIntegrity:key] || [integrityProcessor processIntegrity:valueString];
+    }
     if (shouldFilter) {
       [FBSDKTypeUtility dictionary:restrictiveParams setObject:self.isSampleEnabled ? valueString : @"" forKey:key];
       [params removeObjectForKey:key];
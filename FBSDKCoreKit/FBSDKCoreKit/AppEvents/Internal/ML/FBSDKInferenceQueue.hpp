@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef FBSDKInferenceQueue_hpp
+#define FBSDKInferenceQueue_hpp
+
+#if !TARGET_OS_TV
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace fbsdk {
+  struct MInferenceQueueStats {
+    uint64_t submitted = 0;
+    // duplicates merged into a pending request
+    uint64_t coalesced = 0;
+    // pending requests dropped to make room for newer ones
+    uint64_t dropped = 0;
+    uint64_t completed = 0;
+    // from Submit to Complete
+    uint64_t total_latency_ns = 0;
+    uint64_t max_latency_ns = 0;
+  };
+
+  /*
+   Bounded queue of pending inference requests. A request whose key matches a pending request submitted
+   less than coalesce_window_ns earlier is merged into it. Once capacity requests are pending the oldest,
+   i.e. the most stale, is dropped to make room. Consumers take the pending requests in batches and report
+   each one complete to track its latency. Timestamps are supplied by the caller, in nanoseconds.
+   */
+  template <typename T>
+  class MInferenceQueue {
+  public:
+    enum SubmitResult {
+      kQueued,
+      kCoalesced,
+      kQueuedDroppingOldest,
+    };
+
+    struct Request {
+      std::string key;
+      T value;
+      uint64_t submitted_ns;
+    };
+
+    MInferenceQueue(size_t capacity, uint64_t coalesce_window_ns) :
+      capacity_(std::max<size_t>(capacity, 1)),
+      coalesce_window_ns_(coalesce_window_ns) {};
+
+    SubmitResult Submit(const std::string &key, const T &value, uint64_t now_ns)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.submitted++;
+      for (const Request &request : pending_) {
+        if (request.key == key && now_ns - request.submitted_ns < coalesce_window_ns_) {
+          stats_.coalesced++;
+          return kCoalesced;
+        }
+      }
+      SubmitResult result = kQueued;
+      if (pending_.size() >= capacity_) {
+        pending_.pop_front();
+        stats_.dropped++;
+        result = kQueuedDroppingOldest;
+      }
+      pending_.push_back({key, value, now_ns});
+      return result;
+    }
+
+    // Removes and returns up to max_batch pending requests, oldest first
+    std::vector<Request> TakeBatch(size_t max_batch)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const size_t n = std::min(max_batch, pending_.size());
+      std::vector<Request> batch(pending_.begin(), pending_.begin() + (std::ptrdiff_t)n);
+      pending_.erase(pending_.begin(), pending_.begin() + (std::ptrdiff_t)n);
+      return batch;
+    }
+
+    // Records the latency of a request returned by TakeBatch and returns it
+    uint64_t Complete(const Request &request, uint64_t now_ns)
+    {
+      const uint64_t latency = now_ns > request.submitted_ns ? now_ns - request.submitted_ns : 0;
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.completed++;
+      stats_.total_latency_ns += latency;
+      stats_.max_latency_ns = std::max(stats_.max_latency_ns, latency);
+      return latency;
+    }
+
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return pending_.size();
+    }
+
+    MInferenceQueueStats stats() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return stats_;
+    }
+
+  private:
+    size_t capacity_;
+    uint64_t coalesce_window_ns_;
+    std::deque<Request> pending_;
+    MInferenceQueueStats stats_;
+    mutable std::mutex mutex_;
+  };
+}
+
+#endif
+
+#endif /* FBSDKInferenceQueue_hpp */
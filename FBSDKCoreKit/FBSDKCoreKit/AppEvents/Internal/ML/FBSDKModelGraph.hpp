@@ -0,0 +1,657 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef FBSDKModelGraph_hpp
+#define FBSDKModelGraph_hpp
+
+#if !TARGET_OS_TV
+
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "FBSDKModelRuntime.hpp"
+
+/*
+ Op graph of a model, shipped in its weights container as the kOpGraphSection section so that the server
+ can change the architecture without an SDK release. All integers are little-endian.
+
+ offset 0     MOpGraphHeader
+ offset 16    op_count MOpRecord records
+
+ Values are numbered: 0 is the tokens of the texts, 1 their dense features, and 2 + i the output of op i,
+ so an op can only read values defined before it. Weights are referenced by their name in the container
+ and have the layout they were exported with. planOpGraph validates a graph against the weights, infers
+ the shape of every value, packs the weights for the kernels and fuses conv + relu (+ max pool) and
+ dense + relu into the kernels' epilogues, which runOpGraph then executes.
+ */
+namespace fbsdk {
+  static const char *const kOpGraphSection = "graph";
+  static const uint32_t kOpGraphVersion = 1;
+  // bounds on what a graph can make the client do
+  static const uint32_t kOpGraphMaxOps = 256;
+  static const int kOpGraphMaxLength = 1024;
+
+  enum MOpType : uint8_t {
+    kOpEmbedding = 1, // tokens -> seq_length, d; weight: vocab, d
+    kOpConv1D = 2, // len, in -> len - kernel_size + 1, out; weight: out, in, kernel_size; bias: out
+    kOpMaxPool1D = 3, // len, c -> len - attr + 1, c
+    kOpGlobalMaxPool1D = 4, // len, c -> c
+    kOpDense = 5, // in -> out; weight: out, in; bias: out
+    kOpReLU = 6,
+    kOpSoftmax = 7, // over a vector
+    kOpConcat = 8, // of up to kOpMaxInputs vectors
+    kOpOutput = 9, // names its input, e.g. after a task; weight holds the name
+  };
+
+  enum {
+    kOpGraphTokens = 0,
+    kOpGraphDenseFeatures = 1,
+    kOpGraphInputCount = 2,
+  };
+
+  struct MOpGraphHeader {
+    uint32_t version;
+    uint32_t op_count;
+    int32_t seq_length;
+    int32_t dense_length;
+  };
+
+  static const int kOpMaxInputs = 4;
+
+  struct MOpRecord {
+    uint8_t type;
+    uint8_t input_count;
+    uint16_t reserved;
+    int32_t attr;
+    int32_t inputs[kOpMaxInputs];
+    char weight[32]; // null-terminated
+    char bias[32]; // null-terminated
+  };
+
+  static_assert(sizeof(MOpGraphHeader) == 16, "MOpGraphHeader is part of the file format");
+  static_assert(sizeof(MOpRecord) == 88, "MOpRecord is part of the file format");
+
+  struct MOpGraph {
+    int seq_length = SEQ_LEN;
+    int dense_length = DENSE_FEATURE_LEN;
+    std::vector<MOpRecord> ops;
+
+    // Appends an op and returns the id of its output value
+    int Add(MOpType type, std::initializer_list<int> inputs, const char *weight = "", const char *bias = "", int attr = 0)
+    {
+      MOpRecord op;
+      memset(&op, 0, sizeof(op));
+      op.type = type;
+      op.attr = attr;
+      for (int input : inputs) {
+        if (op.input_count < kOpMaxInputs) {
+          op.inputs[op.input_count++] = input;
+        }
+      }
+      strncpy(op.weight, weight, sizeof(op.weight) - 1);
+      strncpy(op.bias, bias, sizeof(op.bias) - 1);
+      ops.push_back(op);
+      return kOpGraphInputCount + (int)ops.size() - 1;
+    }
+  };
+
+  static inline std::vector<char> MSerializeOpGraph(const MOpGraph &graph)
+  {
+    MOpGraphHeader header;
+    header.version = kOpGraphVersion;
+    header.op_count = (uint32_t)graph.ops.size();
+    header.seq_length = graph.seq_length;
+    header.dense_length = graph.dense_length;
+    std::vector<char> bytes(sizeof(header) + graph.ops.size() * sizeof(MOpRecord));
+    memcpy(bytes.data(), &header, sizeof(header));
+    if (!graph.ops.empty()) {
+      memcpy(bytes.data() + sizeof(header), graph.ops.data(), graph.ops.size() * sizeof(MOpRecord));
+    }
+    return bytes;
+  }
+
+  // Reads a serialized graph, only its structure is checked here, see planOpGraph
+  static inline bool MParseOpGraph(const std::vector<char> &bytes, MOpGraph &graph)
+  {
+    graph = MOpGraph();
+    MOpGraphHeader header;
+    if (bytes.size() < sizeof(header)) {
+      return false;
+    }
+    memcpy(&header, bytes.data(), sizeof(header));
+    if (header.version != kOpGraphVersion
+        || header.op_count > kOpGraphMaxOps
+        || bytes.size() != sizeof(header) + header.op_count * sizeof(MOpRecord)) {
+      return false;
+    }
+    graph.seq_length = header.seq_length;
+    graph.dense_length = header.dense_length;
+    graph.ops.resize(header.op_count);
+    if (header.op_count > 0) {
+      memcpy(graph.ops.data(), bytes.data() + sizeof(header), header.op_count * sizeof(MOpRecord));
+    }
+    for (const MOpRecord &op : graph.ops) {
+      if (op.input_count > kOpMaxInputs || op.weight[sizeof(op.weight) - 1] != '\0' || op.bias[sizeof(op.bias) - 1] != '\0') {
+        graph = MOpGraph();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The architecture predictOnMTMLBatch implements, with an output per task head
+  static inline MOpGraph MTMLOpGraph(const std::vector<std::string> &tasks = {"integrity_detect", "app_event_pred"})
+  {
+    MOpGraph graph;
+    const int embed_x = graph.Add(kOpEmbedding, {kOpGraphTokens}, "embed.weight");
+    const int c0 = graph.Add(kOpReLU, {graph.Add(kOpConv1D, {embed_x}, "convs.0.weight", "convs.0.bias")});
+    const int ca = graph.Add(kOpGlobalMaxPool1D, {c0});
+    const int c1 = graph.Add(kOpReLU, {graph.Add(kOpConv1D, {c0}, "convs.1.weight", "convs.1.bias")});
+    const int p1 = graph.Add(kOpMaxPool1D, {c1}, "", "", 2);
+    const int cb = graph.Add(kOpGlobalMaxPool1D, {p1});
+    const int c2 = graph.Add(kOpReLU, {graph.Add(kOpConv1D, {p1}, "convs.2.weight", "convs.2.bias")});
+    const int cc = graph.Add(kOpGlobalMaxPool1D, {c2});
+    const int concat = graph.Add(kOpConcat, {ca, cb, cc, kOpGraphDenseFeatures});
+    const int dense1_x = graph.Add(kOpReLU, {graph.Add(kOpDense, {concat}, "fc1.weight", "fc1.bias")});
+    const int dense2_x = graph.Add(kOpReLU, {graph.Add(kOpDense, {dense1_x}, "fc2.weight", "fc2.bias")});
+    for (const std::string &task : tasks) {
+      const int logits = graph.Add(kOpDense, {dense2_x}, (task + ".weight").c_str(), (task + ".bias").c_str());
+      graph.Add(kOpOutput, {graph.Add(kOpSoftmax, {logits})}, task.c_str());
+    }
+    return graph;
+  }
+
+  /*
+   Whether graph is MTMLOpGraph for the tasks it outputs. Such a graph runs on predictOnMTMLBatch instead,
+   whose fused, length-bucketed, half precision and quantized paths the planned graph does not have.
+   */
+  static inline bool isMTMLOpGraph(const MOpGraph &graph)
+  {
+    std::vector<std::string> tasks;
+    for (const MOpRecord &op : graph.ops) {
+      if (op.type == kOpOutput) {
+        tasks.push_back(op.weight);
+      }
+    }
+    const MOpGraph mtml = MTMLOpGraph(tasks);
+    if (graph.seq_length != SEQ_LEN || graph.dense_length != DENSE_FEATURE_LEN || graph.ops.size() != mtml.ops.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < graph.ops.size(); i++) {
+      const MOpRecord &op = graph.ops[i];
+      const MOpRecord &expected = mtml.ops[i];
+      if (op.type != expected.type || op.attr != expected.attr || op.input_count != expected.input_count
+          || memcmp(op.inputs, expected.inputs, op.input_count * sizeof(op.inputs[0])) != 0
+          || strcmp(op.weight, expected.weight) != 0 || strcmp(op.bias, expected.bias) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // One kernel call of a planned graph, which may cover several ops
+  struct MOpGraphStep {
+    MOpType type;
+    std::vector<int> inputs;
+    int output; // the value of the last op covered
+    MTensor weight; // kernel layout, empty if sparse_weight replaces it
+    MBlockSparseTensor sparse_weight; // dense: replacement of weight, if toBlockSparseIfFaster made one
+    kernels::DenseKernel dense_kernel = kernels::dense; // dense: specialized for the shape of weight, if possible
+    MTensor bias;
+    bool relu = false; // conv, dense: relu fused into the epilogue
+    int pool_size = 1; // conv: max pool fused into the epilogue, max pool: its size
+    bool in_place = false; // relu, softmax: the input has no other reader
+    std::string name; // output
+    int buffer = -1; // the output's buffer in MOpGraphPlan::buffers, if the step allocates it
+    std::vector<int> release; // values this step reads last
+  };
+
+  struct MOpGraphPlan {
+    int seq_length = 0;
+    int dense_length = 0;
+    // per example, i.e. without the batch dimension
+    std::vector<MShape> shapes;
+    std::vector<MOpGraphStep> steps;
+    // placement of every tensor a prediction allocates in floats per example, buffer 0 holds the dense
+    // features; see opGraphWorkspaceBytes
+    MBufferPlan buffers;
+    // per output, the steps it depends on
+    std::unordered_map<std::string, std::vector<bool>> output_steps;
+
+    bool empty() const
+    {
+      return steps.empty();
+    }
+  };
+
+  /*
+   Validates graph against weights and plans its execution. Returns an empty plan if an op is unknown,
+   reads an undefined value or a missing weight, if any shapes do not match, or if weights holds a tensor
+   the graph never reads.
+   */
+  static inline MOpGraphPlan planOpGraph(const MOpGraph &graph, const std::unordered_map<std::string, MTensor> &weights)
+  {
+    MOpGraphPlan plan;
+    if (graph.seq_length <= 0 || graph.seq_length > kOpGraphMaxLength
+        || graph.dense_length <= 0 || graph.dense_length > kOpGraphMaxLength
+        || graph.ops.empty() || graph.ops.size() > kOpGraphMaxOps) {
+      return MOpGraphPlan();
+    }
+    const int n_values = kOpGraphInputCount + (int)graph.ops.size();
+    std::vector<MShape> shapes(n_values);
+    shapes[kOpGraphTokens] = MShape({graph.seq_length});
+    shapes[kOpGraphDenseFeatures] = MShape({graph.dense_length});
+    std::vector<int> readers(n_values, 0);
+    std::vector<int> reader(n_values, -1);
+    std::unordered_set<std::string> names;
+    std::unordered_set<std::string> read_weights;
+    auto find = [&weights, &read_weights](const char *name, int rank) -> const MTensor * {
+      auto it = weights.find(name);
+      if (it == weights.end() || it->second.sizes().size() != rank) {
+        return nullptr;
+      }
+      read_weights.insert(name);
+      return &it->second;
+    };
+
+    // shape inference
+    for (int i = 0; i < (int)graph.ops.size(); i++) {
+      const MOpRecord &op = graph.ops[i];
+      const int value = kOpGraphInputCount + i;
+      if (op.input_count < 1 || op.input_count > kOpMaxInputs || (op.type != kOpConcat && op.input_count != 1)) {
+        return MOpGraphPlan();
+      }
+      for (int k = 0; k < op.input_count; k++) {
+        const int input = op.inputs[k];
+        // tokens are only read by embeddings, which read nothing else
+        if (input < 0 || input >= value || (input == kOpGraphTokens) != (op.type == kOpEmbedding)) {
+          return MOpGraphPlan();
+        }
+        readers[input]++;
+        reader[input] = i;
+      }
+      const MShape &x = shapes[op.inputs[0]];
+      MShape &y = shapes[value];
+      switch (op.type) {
+        case kOpEmbedding: {
+          // the tokens are bytes
+          const MTensor *w = find(op.weight, 2);
+          if (!w || w->size(0) < 256) {
+            return MOpGraphPlan();
+          }
+          y = MShape({graph.seq_length, w->size(1)});
+          break;
+        }
+        case kOpConv1D: {
+          const MTensor *w = find(op.weight, 3);
+          const MTensor *b = find(op.bias, 1);
+          if (x.size() != 2 || !w || !b || w->size(1) != x[1] || w->size(2) > x[0] || b->size(0) != w->size(0)) {
+            return MOpGraphPlan();
+          }
+          y = MShape({x[0] - w->size(2) + 1, w->size(0)});
+          break;
+        }
+        case kOpMaxPool1D:
+          if (x.size() != 2 || op.attr < 1 || op.attr > x[0]) {
+            return MOpGraphPlan();
+          }
+          y = MShape({x[0] - op.attr + 1, x[1]});
+          break;
+        case kOpGlobalMaxPool1D:
+          if (x.size() != 2) {
+            return MOpGraphPlan();
+          }
+          y = MShape({x[1]});
+          break;
+        case kOpDense: {
+          const MTensor *w = find(op.weight, 2);
+          const MTensor *b = find(op.bias, 1);
+          if (x.size() != 1 || !w || !b || w->size(1) != x[0] || b->size(0) != w->size(0)) {
+            return MOpGraphPlan();
+          }
+          y = MShape({w->size(0)});
+          break;
+        }
+        case kOpReLU:
+          if (x.size() == 0) {
+            return MOpGraphPlan();
+          }
+          y = x;
+          break;
+        case kOpSoftmax:
+          if (x.size() != 1) {
+            return MOpGraphPlan();
+          }
+          y = x;
+          break;
+        case kOpConcat: {
+          int count = 0;
+          for (int k = 0; k < op.input_count; k++) {
+            if (shapes[op.inputs[k]].size() != 1) {
+              return MOpGraphPlan();
+            }
+            count += shapes[op.inputs[k]][0];
+          }
+          y = MShape({count});
+          break;
+        }
+        case kOpOutput:
+          if (x.size() != 1 || op.weight[0] == '\0' || !names.insert(op.weight).second) {
+            return MOpGraphPlan();
+          }
+          y = x;
+          break;
+        default:
+          return MOpGraphPlan();
+      }
+    }
+    if (names.empty() || read_weights.size() != weights.size()) {
+      return MOpGraphPlan();
+    }
+
+    // steps, fusing an op into its only reader where a kernel epilogue can do its work
+    plan.seq_length = graph.seq_length;
+    plan.dense_length = graph.dense_length;
+    std::vector<bool> fused(graph.ops.size(), false);
+    auto fusable = [&](int value, MOpType type) {
+      const int i = reader[value];
+      return readers[value] == 1 && graph.ops[i].type == type ? i : -1;
+    };
+    auto count = [](const MShape &shape) {
+      int n = 1;
+      for (int d = 0; d < shape.size(); d++) {
+        n *= shape[d];
+      }
+      return n;
+    };
+    for (int i = 0; i < (int)graph.ops.size(); i++) {
+      if (fused[i]) {
+        continue;
+      }
+      const MOpRecord &op = graph.ops[i];
+      MOpGraphStep step;
+      step.type = (MOpType)op.type;
+      step.inputs.assign(op.inputs, op.inputs + op.input_count);
+      step.output = kOpGraphInputCount + i;
+      switch (op.type) {
+        case kOpEmbedding:
+          step.weight = weights.at(op.weight);
+          break;
+        case kOpConv1D:
+        case kOpDense: {
+          const MTensor &w = weights.at(op.weight);
+          step.weight = op.type == kOpConv1D ? transpose3D(w) : transpose2D(w);
+          step.bias = weights.at(op.bias);
+          if (op.type == kOpDense) {
+            step.dense_kernel = kernels::dense_for_shape(step.weight.size(0), step.weight.size(1));
+            step.sparse_weight = toBlockSparseIfFaster(step.weight);
+            if (!step.sparse_weight.empty()) {
+              step.weight = MTensor();
+            }
+          }
+          const int relu = fusable(step.output, kOpReLU);
+          if (relu >= 0) {
+            fused[relu] = true;
+            step.relu = true;
+            step.output = kOpGraphInputCount + relu;
+            const int pool = op.type == kOpConv1D ? fusable(step.output, kOpMaxPool1D) : -1;
+            if (pool >= 0) {
+              fused[pool] = true;
+              step.pool_size = graph.ops[pool].attr;
+              step.output = kOpGraphInputCount + pool;
+            }
+          }
+          break;
+        }
+        case kOpMaxPool1D:
+          step.pool_size = op.attr;
+          break;
+        case kOpReLU:
+        case kOpSoftmax:
+          // the dense features are borrowed from the caller
+          step.in_place = readers[op.inputs[0]] == 1 && op.inputs[0] != kOpGraphDenseFeatures;
+          break;
+        case kOpOutput:
+          step.name = op.weight;
+          break;
+        default:
+          break;
+      }
+      plan.steps.push_back(step);
+    }
+    plan.shapes = shapes;
+
+    // global max pools run right after the step they read, so that its output can die sooner
+    std::vector<MOpGraphStep> steps;
+    std::vector<bool> scheduled(plan.steps.size(), false);
+    for (size_t i = 0; i < plan.steps.size(); i++) {
+      if (scheduled[i]) {
+        continue;
+      }
+      steps.push_back(plan.steps[i]);
+      for (size_t k = i + 1; k < plan.steps.size(); k++) {
+        if (plan.steps[k].type == kOpGlobalMaxPool1D && plan.steps[k].inputs[0] == plan.steps[i].output) {
+          steps.push_back(plan.steps[k]);
+          scheduled[k] = true;
+        }
+      }
+    }
+    plan.steps.swap(steps);
+
+    // the steps of an output are those whose value it reads, directly or through other steps
+    for (int k = 0; k < (int)plan.steps.size(); k++) {
+      if (plan.steps[k].type != kOpOutput) {
+        continue;
+      }
+      std::vector<bool> &needed = plan.output_steps[plan.steps[k].name];
+      needed.assign(plan.steps.size(), false);
+      std::vector<bool> read(n_values, false);
+      read[plan.steps[k].output] = true;
+      for (int i = k; i >= 0; i--) {
+        if (read[plan.steps[i].output]) {
+          needed[i] = true;
+          for (int input : plan.steps[i].inputs) {
+            read[input] = true;
+          }
+        }
+      }
+    }
+
+    // buffer liveness: step i runs at time i + 1, after the dense features are copied in at time 0, and
+    // the outputs live past the last step. In-place steps and outputs share the buffer they read.
+    const int end = (int)plan.steps.size() + 1;
+    std::vector<MBufferLifetime> lifetimes = {{(size_t)graph.dense_length, 0, 0}};
+    std::vector<int> buffer_of(n_values, -1);
+    std::vector<int> last_read(n_values, -1);
+    buffer_of[kOpGraphDenseFeatures] = 0;
+    for (int i = 0; i < (int)plan.steps.size(); i++) {
+      MOpGraphStep &step = plan.steps[i];
+      for (int input : step.inputs) {
+        last_read[input] = i;
+        if (buffer_of[input] >= 0) {
+          lifetimes[buffer_of[input]].last = i + 1;
+        }
+      }
+      if (step.type == kOpOutput) {
+        lifetimes[buffer_of[step.inputs[0]]].last = end;
+      } else if (step.in_place) {
+        buffer_of[step.output] = buffer_of[step.inputs[0]];
+      } else {
+        step.buffer = (int)lifetimes.size();
+        buffer_of[step.output] = step.buffer;
+        // a conv may write as many rows as it reads before it drops those between examples, see conv1DGemm
+        const MShape &shape = shapes[step.output];
+        const int size = step.type == kOpConv1D ? shapes[step.inputs[0]][0] * shape[1] : count(shape);
+        lifetimes.push_back({(size_t)size, i + 1, i + 1});
+      }
+    }
+    for (int value = 0; value < n_values; value++) {
+      if (last_read[value] >= 0) {
+        plan.steps[last_read[value]].release.push_back(value);
+      }
+    }
+    // 64-byte aligned for any number of examples
+    plan.buffers = MPlanBuffers(lifetimes, 16);
+    return plan;
+  }
+
+  // Arena bytes of one prediction, i.e. its peak working set
+  static inline size_t opGraphWorkspaceBytes(const MOpGraphPlan &plan, const int n_examples)
+  {
+    return (size_t)n_examples * plan.buffers.peak * sizeof(float);
+  }
+
+  // Profiler stage of a step, named after its op; fused ops are part of the step they are fused into
+  static inline const char *opGraphStageName(MOpType type)
+  {
+    switch (type) {
+      case kOpEmbedding:
+        return "embedding";
+      case kOpConv1D:
+        return "conv";
+      case kOpMaxPool1D:
+        return "max_pool";
+      case kOpGlobalMaxPool1D:
+        return "global_max_pool";
+      case kOpDense:
+        return "dense";
+      case kOpReLU:
+        return "relu";
+      case kOpSoftmax:
+        return "softmax";
+      case kOpConcat:
+        return "concat";
+      case kOpOutput:
+        return "output";
+    }
+    return "unknown";
+  }
+
+  /*
+   Runs all texts through a planned graph as one batch and returns its outputs by name.
+   df: texts.size() rows of plan.dense_length floats, or nullptr
+   profiler: see MTMLInferenceOptions::profiler
+   output: if set, only the steps this output depends on run and only it is returned
+   */
+  static inline std::unordered_map<std::string, MTensor> runOpGraph(const MOpGraphPlan &plan, const std::vector<const char *> &texts, const float *df, MTensorArena *arena = nullptr, MModelProfiler *profiler = nullptr, const char *output = nullptr)
+  {
+    std::unordered_map<std::string, MTensor> outputs;
+    if (plan.empty() || texts.empty()) {
+      return outputs;
+    }
+    const std::vector<bool> *needed = nullptr;
+    if (output) {
+      auto it = plan.output_steps.find(output);
+      if (it == plan.output_steps.end()) {
+        return outputs;
+      }
+      needed = &it->second;
+    }
+    const int n_examples = (int)texts.size();
+    if (arena) {
+      arena->Reset();
+      const size_t nbytes = opGraphWorkspaceBytes(plan, n_examples);
+      arena->Reserve(nbytes, nbytes);
+    }
+    std::vector<MTensor> values(plan.shapes.size());
+    MPlaceNextTensor(arena, plan.buffers, 0, n_examples);
+    MTensor dense_tensor = MAllocateTensor({n_examples, plan.dense_length}, arena);
+    const size_t dense_bytes = (size_t)n_examples * (size_t)plan.dense_length * sizeof(float);
+    if (df) {
+      memcpy(dense_tensor.mutable_data(), df, dense_bytes);
+    } else {
+      memset(dense_tensor.mutable_data(), 0, dense_bytes);
+    }
+    values[kOpGraphDenseFeatures] = dense_tensor;
+
+    for (size_t i = 0; i < plan.steps.size(); i++) {
+      if (needed && !(*needed)[i]) {
+        continue;
+      }
+      const MOpGraphStep &step = plan.steps[i];
+      FBSDK_ML_PROFILE_SCOPE(profiler, opGraphStageName(step.type));
+      const MTensor &x = values[step.inputs[0]];
+      MTensor &y = values[step.output];
+      if (step.buffer >= 0) {
+        MPlaceNextTensor(arena, plan.buffers, step.buffer, n_examples);
+      }
+      switch (step.type) {
+        case kOpEmbedding:
+          y = embedding(texts, plan.seq_length, step.weight, arena);
+          break;
+        case kOpConv1D:
+          if (step.relu) {
+            y = conv1DBiasReLUMaxPool1D(x, step.weight, step.bias, step.pool_size, arena);
+          } else {
+            y = conv1D(x, step.weight, arena);
+            addmv(y, step.bias);
+          }
+          break;
+        case kOpMaxPool1D:
+          y = maxPool1D(x, step.pool_size, arena);
+          break;
+        case kOpGlobalMaxPool1D:
+          y = maxPool1D(x, x.size(1), arena);
+          flatten(y, 1);
+          break;
+        case kOpDense:
+          y = step.sparse_weight.empty() ? dense(x, step.weight, step.bias, arena, step.dense_kernel) : dense(x, step.sparse_weight, step.bias, arena);
+          if (step.relu) {
+            relu(y);
+          }
+          break;
+        case kOpReLU:
+        case kOpSoftmax:
+          if (step.in_place) {
+            y = x;
+          } else {
+            y = MAllocateTensor(x.sizes(), arena);
+            memcpy(y.mutable_data(), x.data(), (size_t)x.count() * sizeof(float));
+          }
+          if (step.type == kOpReLU) {
+            relu(y);
+          } else {
+            softmax(y);
+          }
+          break;
+        case kOpConcat: {
+          std::vector<MTensor *> inputs;
+          for (int input : step.inputs) {
+            inputs.push_back(&values[input]);
+          }
+          y = concatenate(inputs.data(), (int)inputs.size(), arena);
+          break;
+        }
+        case kOpOutput:
+          y = x;
+          outputs[step.name] = x;
+          break;
+        default:
+          break;
+      }
+      if (step.type != kOpOutput && y.count() == 0) {
+        return std::unordered_map<std::string, MTensor>();
+      }
+      // without an arena, this frees the tensors no later step reads
+      for (int value : step.release) {
+        values[value] = MTensor();
+      }
+    }
+    return outputs;
+  }
+}
+
+#endif
+
+#endif /* FBSDKModelGraph_hpp */
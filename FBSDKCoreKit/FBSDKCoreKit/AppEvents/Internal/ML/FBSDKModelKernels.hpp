@@ -0,0 +1,1604 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef FBSDKModelKernels_hpp
+#define FBSDKModelKernels_hpp
+
+#if !TARGET_OS_TV
+
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Low level vector kernels used by the model runtime.
+//
+// The backend is chosen at compile time: Accelerate (vDSP) on Apple platforms, and a portable
+// C++ implementation everywhere else so the exact same inference code can be built and profiled
+// on Linux. Define FBSDK_ML_USE_ACCELERATE=0 to force the portable backend on Apple platforms,
+// and FBSDK_ML_DISABLE_SIMD to restrict the portable backend to its scalar reference loops.
+#ifndef FBSDK_ML_USE_ACCELERATE
+ #if defined(__APPLE__)
+  #define FBSDK_ML_USE_ACCELERATE 1
+ #else
+  #define FBSDK_ML_USE_ACCELERATE 0
+ #endif
+#endif
+
+#if FBSDK_ML_USE_ACCELERATE
+ #import <Accelerate/Accelerate.h>
+ #if defined(__aarch64__) && !defined(FBSDK_ML_DISABLE_SIMD)
+  #include <arm_neon.h> // for the int8 gemm, which vDSP has no equivalent of
+ #endif
+#elif defined(FBSDK_ML_DISABLE_SIMD)
+// scalar portable backend
+#elif defined(__AVX2__) && defined(__FMA__)
+ #include <immintrin.h>
+ #define FBSDK_ML_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+ #include <emmintrin.h>
+ #define FBSDK_ML_SIMD_SSE2 1
+#elif defined(__ARM_NEON)
+ #include <arm_neon.h>
+ #define FBSDK_ML_SIMD_NEON 1
+#endif
+
+#define MKERNEL_ALWAYS_INLINE inline __attribute__((always_inline))
+
+namespace fbsdk {
+  namespace kernels {
+  #if !FBSDK_ML_USE_ACCELERATE
+
+  // Minimal vector abstraction for the portable backend, kVecWidth floats per register.
+  #if FBSDK_ML_SIMD_AVX2
+    typedef __m256 vfloat;
+    static const int kVecWidth = 8;
+    MKERNEL_ALWAYS_INLINE vfloat vload(const float *p) { return _mm256_loadu_ps(p); }
+    MKERNEL_ALWAYS_INLINE void vstore(float *p, vfloat v) { _mm256_storeu_ps(p, v); }
+    MKERNEL_ALWAYS_INLINE vfloat vdup(float x) { return _mm256_set1_ps(x); }
+    MKERNEL_ALWAYS_INLINE vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vfma(vfloat acc, vfloat a, vfloat b) { return _mm256_fmadd_ps(a, b, acc); }
+    MKERNEL_ALWAYS_INLINE vfloat vabs(vfloat v) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v); }
+    // v * 2^e for integral e, by adding e to the exponent bits; the result must be a normal float
+    MKERNEL_ALWAYS_INLINE vfloat vldexp(vfloat v, vfloat e)
+    {
+      return _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(v), _mm256_slli_epi32(_mm256_cvtps_epi32(e), 23)));
+    }
+
+    // rounds to the nearest integer, ties to even, and stores the kVecWidth values as int8; they must fit
+    MKERNEL_ALWAYS_INLINE void vstore_rounded_s8(int8_t *q, vfloat v)
+    {
+      const __m256i i = _mm256_cvtps_epi32(v);
+      const __m128i h = _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extractf128_si256(i, 1));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(q), _mm_packs_epi16(h, h));
+    }
+
+    MKERNEL_ALWAYS_INLINE float vreduce_add(vfloat v)
+    {
+      __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+      s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+      s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+      return _mm_cvtss_f32(s);
+    }
+
+    MKERNEL_ALWAYS_INLINE float vreduce_max(vfloat v)
+    {
+      __m128 s = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+      s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+      s = _mm_max_ss(s, _mm_shuffle_ps(s, s, 1));
+      return _mm_cvtss_f32(s);
+    }
+
+  #elif FBSDK_ML_SIMD_SSE2
+    typedef __m128 vfloat;
+    static const int kVecWidth = 4;
+    MKERNEL_ALWAYS_INLINE vfloat vload(const float *p) { return _mm_loadu_ps(p); }
+    MKERNEL_ALWAYS_INLINE void vstore(float *p, vfloat v) { _mm_storeu_ps(p, v); }
+    MKERNEL_ALWAYS_INLINE vfloat vdup(float x) { return _mm_set1_ps(x); }
+    MKERNEL_ALWAYS_INLINE vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vfma(vfloat acc, vfloat a, vfloat b) { return _mm_add_ps(acc, _mm_mul_ps(a, b)); }
+    MKERNEL_ALWAYS_INLINE vfloat vabs(vfloat v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+    MKERNEL_ALWAYS_INLINE vfloat vldexp(vfloat v, vfloat e)
+    {
+      return _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(v), _mm_slli_epi32(_mm_cvtps_epi32(e), 23)));
+    }
+
+    MKERNEL_ALWAYS_INLINE void vstore_rounded_s8(int8_t *q, vfloat v)
+    {
+      __m128i i = _mm_cvtps_epi32(v);
+      i = _mm_packs_epi32(i, i);
+      const int32_t packed = _mm_cvtsi128_si32(_mm_packs_epi16(i, i));
+      memcpy(q, &packed, sizeof(packed));
+    }
+
+    MKERNEL_ALWAYS_INLINE float vreduce_add(vfloat v)
+    {
+      __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+      s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+      return _mm_cvtss_f32(s);
+    }
+
+    MKERNEL_ALWAYS_INLINE float vreduce_max(vfloat v)
+    {
+      __m128 s = _mm_max_ps(v, _mm_movehl_ps(v, v));
+      s = _mm_max_ss(s, _mm_shuffle_ps(s, s, 1));
+      return _mm_cvtss_f32(s);
+    }
+
+  #elif FBSDK_ML_SIMD_NEON
+    typedef float32x4_t vfloat;
+    static const int kVecWidth = 4;
+    MKERNEL_ALWAYS_INLINE vfloat vload(const float *p) { return vld1q_f32(p); }
+    MKERNEL_ALWAYS_INLINE void vstore(float *p, vfloat v) { vst1q_f32(p, v); }
+    MKERNEL_ALWAYS_INLINE vfloat vdup(float x) { return vdupq_n_f32(x); }
+    MKERNEL_ALWAYS_INLINE vfloat vadd(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vmul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vmax(vfloat a, vfloat b) { return vmaxq_f32(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vmin(vfloat a, vfloat b) { return vminq_f32(a, b); }
+    MKERNEL_ALWAYS_INLINE vfloat vabs(vfloat v) { return vabsq_f32(v); }
+    // the truncating conversion is exact on the integral e
+    MKERNEL_ALWAYS_INLINE vfloat vldexp(vfloat v, vfloat e)
+    {
+      return vreinterpretq_f32_s32(vaddq_s32(vreinterpretq_s32_f32(v), vshlq_n_s32(vcvtq_s32_f32(e), 23)));
+    }
+
+   #if defined(__aarch64__)
+    MKERNEL_ALWAYS_INLINE vfloat vfma(vfloat acc, vfloat a, vfloat b) { return vfmaq_f32(acc, a, b); }
+    MKERNEL_ALWAYS_INLINE float vreduce_add(vfloat v) { return vaddvq_f32(v); }
+    MKERNEL_ALWAYS_INLINE float vreduce_max(vfloat v) { return vmaxvq_f32(v); }
+    MKERNEL_ALWAYS_INLINE void vstore_rounded_s8(int8_t *q, vfloat v)
+    {
+      const int16x4_t h = vqmovn_s32(vcvtnq_s32_f32(v));
+      vst1_lane_s32(reinterpret_cast<int32_t *>(q), vreinterpret_s32_s8(vqmovn_s16(vcombine_s16(h, h))), 0);
+    }
+
+   #else
+    MKERNEL_ALWAYS_INLINE vfloat vfma(vfloat acc, vfloat a, vfloat b) { return vmlaq_f32(acc, a, b); }
+    MKERNEL_ALWAYS_INLINE float vreduce_add(vfloat v)
+    {
+      float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+      return vget_lane_f32(vpadd_f32(s, s), 0);
+    }
+
+    MKERNEL_ALWAYS_INLINE float vreduce_max(vfloat v)
+    {
+      float32x2_t s = vmax_f32(vget_low_f32(v), vget_high_f32(v));
+      return vget_lane_f32(vpmax_f32(s, s), 0);
+    }
+
+    // no rounding conversion before armv8
+    MKERNEL_ALWAYS_INLINE void vstore_rounded_s8(int8_t *q, vfloat v)
+    {
+      float f[4];
+      vst1q_f32(f, v);
+      for (int i = 0; i < 4; i++) {
+        q[i] = (int8_t)lrintf(f[i]);
+      }
+    }
+
+   #endif
+  #endif
+
+  #if FBSDK_ML_SIMD_AVX2 || FBSDK_ML_SIMD_SSE2 || FBSDK_ML_SIMD_NEON
+   #define FBSDK_ML_SIMD 1
+  #endif
+
+  #if FBSDK_ML_SIMD
+    /*
+     exp(x) to within a few ulp of expf, with the polynomial of the Cephes expf: x = n ln2 + r, |r| <= ln2 / 2,
+     and exp(x) = 2^n exp(r). x is clamped to [-86.5, 88.3] so that the result stays a normal float, i.e.
+     exp saturates where expf would underflow or overflow.
+     */
+    MKERNEL_ALWAYS_INLINE vfloat vexp(vfloat x)
+    {
+      x = vmax(vmin(x, vdup(88.3f)), vdup(-86.5f));
+      // n = round(x / ln2): adding and removing 1.5 * 2^23 drops the fraction, rounding to nearest
+      const vfloat n = vadd(vfma(vdup(12582912.0f), x, vdup(1.44269504089f)), vdup(-12582912.0f));
+      // r = x - n ln2 with ln2 in two parts, the first exact in n ln2
+      vfloat r = vfma(x, n, vdup(-0.693359375f));
+      r = vfma(r, n, vdup(2.12194440e-4f));
+      vfloat p = vdup(1.9875691500e-4f);
+      p = vfma(vdup(1.3981999507e-3f), p, r);
+      p = vfma(vdup(8.3334519073e-3f), p, r);
+      p = vfma(vdup(4.1665795894e-2f), p, r);
+      p = vfma(vdup(1.6666665459e-1f), p, r);
+      p = vfma(vdup(5.0000001201e-1f), p, r);
+      p = vfma(vadd(r, vdup(1)), p, vmul(r, r));
+      return vldexp(p, n);
+    }
+  #endif
+
+  #endif // !FBSDK_ML_USE_ACCELERATE
+
+    static inline const char *backendName()
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      return "accelerate";
+    #elif FBSDK_ML_SIMD_AVX2
+      return "portable-avx2";
+    #elif FBSDK_ML_SIMD_SSE2
+      return "portable-sse2";
+    #elif FBSDK_ML_SIMD_NEON
+      return "portable-neon";
+    #else
+      return "portable-scalar";
+    #endif
+    }
+
+    // x[i] = max(x[i], 0)
+    static inline void relu(float *x, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      float lower = 0;
+      float upper = FLT_MAX;
+      vDSP_vclip(x, 1, &lower, &upper, x, 1, (vDSP_Length)n);
+    #else
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      const vfloat zero = vdup(0);
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        vstore(x + i, vmax(vload(x + i), zero));
+      }
+     #endif
+      for (; i < n; i++) {
+        x[i] = x[i] > 0 ? x[i] : 0;
+      }
+    #endif
+    }
+
+    // return max(x[0..n))
+    static inline float max(const float *x, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      float result;
+      vDSP_maxv(x, 1, &result, (vDSP_Length)n);
+      return result;
+    #else
+      float result = -FLT_MAX;
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      if (n >= kVecWidth) {
+        vfloat acc = vload(x);
+        for (i = kVecWidth; i + kVecWidth <= n; i += kVecWidth) {
+          acc = vmax(acc, vload(x + i));
+        }
+        result = vreduce_max(acc);
+      }
+     #endif
+      for (; i < n; i++) {
+        result = x[i] > result ? x[i] : result;
+      }
+      return result;
+    #endif
+    }
+
+    // return sum(x[0..n))
+    static inline float sum(const float *x, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      float result;
+      vDSP_sve(x, 1, &result, (vDSP_Length)n);
+      return result;
+    #else
+      float result = 0;
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      vfloat acc = vdup(0);
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        acc = vadd(acc, vload(x + i));
+      }
+      result = vreduce_add(acc);
+     #endif
+      for (; i < n; i++) {
+        result += x[i];
+      }
+      return result;
+    #endif
+    }
+
+    // return dot(a[0..n), b[0..n))
+    static inline float dot(const float *a, const float *b, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      float result;
+      vDSP_dotpr(a, 1, b, 1, &result, (vDSP_Length)n);
+      return result;
+    #else
+      float result = 0;
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      vfloat acc = vdup(0);
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        acc = vfma(acc, vload(a + i), vload(b + i));
+      }
+      result = vreduce_add(acc);
+     #endif
+      for (; i < n; i++) {
+        result += a[i] * b[i];
+      }
+      return result;
+    #endif
+    }
+
+    // y[i] = x[i] + s, x and y may alias
+    static inline void add_scalar(const float *x, float s, float *y, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      vDSP_vsadd(x, 1, &s, y, 1, (vDSP_Length)n);
+    #else
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      const vfloat vs = vdup(s);
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        vstore(y + i, vadd(vload(x + i), vs));
+      }
+     #endif
+      for (; i < n; i++) {
+        y[i] = x[i] + s;
+      }
+    #endif
+    }
+
+    // y[i] = x[i] / s, x and y may alias
+    static inline void div_scalar(const float *x, float s, float *y, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      vDSP_vsdiv(x, 1, &s, y, 1, (vDSP_Length)n);
+    #else
+      for (int i = 0; i < n; i++) {
+        y[i] = x[i] / s;
+      }
+    #endif
+    }
+
+    // y[i] = x[i] * s, x and y may alias
+    static inline void mul_scalar(const float *x, float s, float *y, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      vDSP_vsmul(x, 1, &s, y, 1, (vDSP_Length)n);
+    #else
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      const vfloat vs = vdup(s);
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        vstore(y + i, vmul(vload(x + i), vs));
+      }
+     #endif
+      for (; i < n; i++) {
+        y[i] = x[i] * s;
+      }
+    #endif
+    }
+
+    // y[i] = exp(x[i]), x and y may alias
+    static inline void exp(const float *x, float *y, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      vvexpf(y, x, &n);
+    #else
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        vstore(y + i, vexp(vload(x + i)));
+      }
+     #endif
+      for (; i < n; i++) {
+        y[i] = expf(x[i]);
+      }
+    #endif
+    }
+
+    /*
+     x = softmax(x), i.e. exp(x - max(x)) normalized to sum to 1. The portable backend computes the
+     exponentials and their sum in one pass. Its remainder of fewer than kVecWidth classes, i.e. all of a
+     3 or 5 class head on AVX2, stays on expf: the row was just written by the scalar tail of the gemm, and
+     reloading it as a padded vector costs more than the expf calls it saves.
+     */
+    static inline void softmax(float *x, int n)
+    {
+      const float m = max(x, n);
+    #if FBSDK_ML_USE_ACCELERATE
+      add_scalar(x, -m, x, n);
+      exp(x, x, n);
+      const float s = sum(x, n);
+    #else
+      int i = 0;
+      float s = 0;
+     #if FBSDK_ML_SIMD
+      const vfloat vm = vdup(-m);
+      vfloat acc = vdup(0);
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        const vfloat e = vexp(vadd(vload(x + i), vm));
+        vstore(x + i, e);
+        acc = vadd(acc, e);
+      }
+      s = vreduce_add(acc);
+     #endif
+      for (; i < n; i++) {
+        x[i] = expf(x[i] - m);
+        s += x[i];
+      }
+    #endif
+      mul_scalar(x, 1 / s, x, n);
+    }
+
+    // Index of the first of n probabilities that reaches its threshold, or -1 if none does
+    static inline int first_over_threshold(const float *probs, const float *thresholds, int n)
+    {
+      for (int i = 0; i < n; i++) {
+        if (probs[i] >= thresholds[i]) {
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    // y[r * cols + c] += b[c] for every row r
+    static inline void add_bias(float *y, const float *b, int rows, int cols)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      for (int c = 0; c < cols; c++) {
+        vDSP_vsadd(y + c, cols, b + c, y + c, cols, (vDSP_Length)rows);
+      }
+    #else
+      for (int r = 0; r < rows; r++) {
+        float *y_row = y + r * cols;
+        int c = 0;
+       #if FBSDK_ML_SIMD
+        for (; c + kVecWidth <= cols; c += kVecWidth) {
+          vstore(y_row + c, vadd(vload(y_row + c), vload(b + c)));
+        }
+       #endif
+        for (; c < cols; c++) {
+          y_row[c] += b[c];
+        }
+      }
+    #endif
+    }
+
+    // y[i] += x[i]
+    static inline void add_into(const float *x, float *y, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      vDSP_vadd(x, 1, y, 1, y, 1, (vDSP_Length)n);
+    #else
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        vstore(y + i, vadd(vload(x + i), vload(y + i)));
+      }
+     #endif
+      for (; i < n; i++) {
+        y[i] += x[i];
+      }
+    #endif
+    }
+
+    // y[i] = max(x[i], y[i])
+    static inline void max_into(const float *x, float *y, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      vDSP_vmax(x, 1, y, 1, y, 1, (vDSP_Length)n);
+    #else
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        vstore(y + i, vmax(vload(x + i), vload(y + i)));
+      }
+     #endif
+      for (; i < n; i++) {
+        y[i] = x[i] > y[i] ? x[i] : y[i];
+      }
+    #endif
+    }
+
+  #if !FBSDK_ML_USE_ACCELERATE
+    // Output row t is the max of input rows t .. t + PoolSize - 1; over channel-contiguous rows this is an
+    // elementwise max of PoolSize shifted copies of the input, which reads memory in order.
+    template <int PoolSize>
+    static inline void max_pool_rows_fixed(const float *x, float *y, int out_len, int n)
+    {
+      const int count = out_len * n;
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      for (; i + kVecWidth <= count; i += kVecWidth) {
+        vfloat v = vload(x + i);
+        for (int q = 1; q < PoolSize; q++) {
+          v = vmax(v, vload(x + q * n + i));
+        }
+        vstore(y + i, v);
+      }
+     #endif
+      for (; i < count; i++) {
+        float v = x[i];
+        for (int q = 1; q < PoolSize; q++) {
+          v = x[q * n + i] > v ? x[q * n + i] : v;
+        }
+        y[i] = v;
+      }
+    }
+  #endif
+
+    /*
+     Sliding max over pool_size consecutive rows of the row-major (len, n) matrix x, i.e. a max pool over
+     the positions of channel-contiguous data.
+     y shape: len - pool_size + 1, n
+     */
+    static inline void max_pool_rows(const float *x, float *y, int len, int n, int pool_size)
+    {
+      const int out_len = len - pool_size + 1;
+      if (pool_size <= 0 || out_len <= 0 || n <= 0) {
+        return;
+      }
+    #if FBSDK_ML_USE_ACCELERATE
+      const vDSP_Length count = (vDSP_Length)out_len * (vDSP_Length)n;
+      if (pool_size == 1) {
+        memcpy(y, x, (size_t)count * sizeof(float));
+        return;
+      }
+      vDSP_vmax(x, 1, x + n, 1, y, 1, count);
+      for (int q = 2; q < pool_size; q++) {
+        vDSP_vmax(x + q * n, 1, y, 1, y, 1, count);
+      }
+    #else
+      switch (pool_size) {
+        case 1:
+          memcpy(y, x, (size_t)out_len * (size_t)n * sizeof(float));
+          return;
+        case 2:
+          max_pool_rows_fixed<2>(x, y, out_len, n);
+          return;
+        case 3:
+          max_pool_rows_fixed<3>(x, y, out_len, n);
+          return;
+        default:
+          max_pool_rows_fixed<2>(x, y, out_len, n);
+          for (int q = 2; q < pool_size; q++) {
+            max_into(x + q * n, y, out_len * n);
+          }
+          return;
+      }
+    #endif
+    }
+
+    // y[c] = max over the rows of the row-major (len, n) matrix x, i.e. a global max pool of channel-contiguous data
+    static inline void max_rows(const float *x, float *y, int len, int n)
+    {
+      if (len <= 0 || n <= 0) {
+        return;
+      }
+      memcpy(y, x, (size_t)n * sizeof(float));
+    #if FBSDK_ML_USE_ACCELERATE
+      for (int r = 1; r < len; r++) {
+        vDSP_vmax(x + r * n, 1, y, 1, y, 1, (vDSP_Length)n);
+      }
+    #else
+      int c = 0;
+     #if FBSDK_ML_SIMD
+      // four columns of registers at a time, which stay in registers for all the rows
+      for (; c + 4 * kVecWidth <= n; c += 4 * kVecWidth) {
+        vfloat m0 = vload(x + c);
+        vfloat m1 = vload(x + c + kVecWidth);
+        vfloat m2 = vload(x + c + 2 * kVecWidth);
+        vfloat m3 = vload(x + c + 3 * kVecWidth);
+        for (int r = 1; r < len; r++) {
+          const float *row = x + r * n + c;
+          m0 = vmax(m0, vload(row));
+          m1 = vmax(m1, vload(row + kVecWidth));
+          m2 = vmax(m2, vload(row + 2 * kVecWidth));
+          m3 = vmax(m3, vload(row + 3 * kVecWidth));
+        }
+        vstore(y + c, m0);
+        vstore(y + c + kVecWidth, m1);
+        vstore(y + c + 2 * kVecWidth, m2);
+        vstore(y + c + 3 * kVecWidth, m3);
+      }
+      for (; c + kVecWidth <= n; c += kVecWidth) {
+        vfloat m = vload(x + c);
+        for (int r = 1; r < len; r++) {
+          m = vmax(m, vload(x + r * n + c));
+        }
+        vstore(y + c, m);
+      }
+     #endif
+      for (int r = 1; r < len; r++) {
+        const float *row = x + r * n;
+        for (int k = c; k < n; k++) {
+          y[k] = row[k] > y[k] ? row[k] : y[k];
+        }
+      }
+    #endif
+    }
+
+    /*
+     Work applied to each row of a gemm result before it is written to c:
+     c = maxpool(relu(a * b + bias)), where bias may be null and maxpool is a sliding max over
+     pool_size consecutive rows (pool_size 1 disables pooling).
+     */
+    struct GemmEpilogue {
+      const float *bias;
+      bool relu;
+      int pool_size;
+    };
+
+    static const GemmEpilogue kNoEpilogue = {nullptr, false, 1};
+
+    // Writes the n finished values of row r of the gemm result into the pooled outputs they belong to, rows
+    // of c being ldc apart. Rows must be stored in increasing order for every column: row t initializes
+    // output t, later rows max into it.
+    static inline void store_pooled_row(const float *row, int r, int n, int ldc, int out_len, int pool_size, float *c)
+    {
+      for (int q = 0; q < pool_size; q++) {
+        int t = r - q;
+        if (t < 0 || t >= out_len) {
+          continue;
+        }
+        if (q == 0) {
+          memcpy(c + t * ldc, row, (size_t)n * sizeof(float));
+        } else {
+          max_into(row, c + t * ldc, n);
+        }
+      }
+    }
+
+  #if !FBSDK_ML_USE_ACCELERATE
+    MKERNEL_ALWAYS_INLINE float epilogue_scalar(float v, const GemmEpilogue &e, int j)
+    {
+      if (e.bias) {
+        v += e.bias[j];
+      }
+      if (e.relu && v < 0) {
+        v = 0;
+      }
+      return v;
+    }
+
+    MKERNEL_ALWAYS_INLINE void store_pooled_scalar(float v, int r, int j, int n, int out_len, int pool_size, float *c)
+    {
+      for (int q = 0; q < pool_size; q++) {
+        int t = r - q;
+        if (t >= 0 && t < out_len) {
+          float *dst = c + t * n + j;
+          *dst = (q == 0 || v > *dst) ? v : *dst;
+        }
+      }
+    }
+
+   #if FBSDK_ML_SIMD
+    MKERNEL_ALWAYS_INLINE vfloat epilogue_vector(vfloat v, const GemmEpilogue &e, int j)
+    {
+      if (e.bias) {
+        v = vadd(v, vload(e.bias + j));
+      }
+      if (e.relu) {
+        v = vmax(v, vdup(0));
+      }
+      return v;
+    }
+
+    MKERNEL_ALWAYS_INLINE void store_pooled_vector(vfloat v, int r, int j, int n, int out_len, int pool_size, float *c)
+    {
+      if (pool_size == 1) {
+        vstore(c + r * n + j, v);
+        return;
+      }
+      for (int q = 0; q < pool_size; q++) {
+        int t = r - q;
+        if (t >= 0 && t < out_len) {
+          float *dst = c + t * n + j;
+          vstore(dst, q == 0 ? v : vmax(v, vload(dst)));
+        }
+      }
+    }
+
+   #endif
+  #endif
+
+    // IEEE 754 half precision to float, exact
+    static inline float fp16_to_fp32(uint16_t h)
+    {
+      const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+      uint32_t bits = (uint32_t)(h & 0x7fff) << 13;
+      const uint32_t exponent = bits & 0x0f800000;
+      bits += 0x38000000; // rebias the exponent from 15 to 127
+      float f;
+      if (exponent == 0x0f800000) {
+        bits += 0x38000000; // inf or nan
+      } else if (exponent == 0) {
+        // zero or subnormal: renormalize through the float unit
+        bits += 0x00800000;
+        memcpy(&f, &bits, sizeof(f));
+        f -= 6.103515625e-05f; // 2^-14
+        memcpy(&bits, &f, sizeof(f));
+      }
+      bits |= sign;
+      memcpy(&f, &bits, sizeof(f));
+      return f;
+    }
+
+    // float to IEEE 754 half precision, rounding to nearest even
+    static inline uint16_t fp32_to_fp16(float x)
+    {
+      uint32_t bits;
+      memcpy(&bits, &x, sizeof(bits));
+      const uint32_t sign = bits & 0x80000000;
+      bits ^= sign;
+      uint32_t h;
+      if (bits >= 0x47800000) {
+        h = bits > 0x7f800000 ? 0x7e00 : 0x7c00; // nan, or too large: inf
+      } else if (bits < 0x38800000) {
+        // subnormal or zero: let the float unit round the mantissa by adding 0.5
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        f += 0.5f;
+        memcpy(&h, &f, sizeof(f));
+        h -= 0x3f000000;
+      } else {
+        const uint32_t odd = (bits >> 13) & 1;
+        bits += 0xc8000fff + odd; // rebias the exponent from 127 to 15 and round
+        h = bits >> 13;
+      }
+      return (uint16_t)(h | (sign >> 16));
+    }
+
+    // bfloat16, the upper half of a float, to float, exact
+    static inline float bf16_to_fp32(uint16_t h)
+    {
+      const uint32_t bits = (uint32_t)h << 16;
+      float f;
+      memcpy(&f, &bits, sizeof(f));
+      return f;
+    }
+
+    // float to bfloat16, rounding to nearest even
+    static inline uint16_t fp32_to_bf16(float x)
+    {
+      uint32_t bits;
+      memcpy(&bits, &x, sizeof(bits));
+      if ((bits & 0x7fffffff) > 0x7f800000) {
+        return (uint16_t)((bits >> 16) | 0x40); // quiet nan
+      }
+      bits += 0x7fff + ((bits >> 16) & 1);
+      return (uint16_t)(bits >> 16);
+    }
+
+  #if FBSDK_ML_SIMD_SSE2 || (FBSDK_ML_SIMD_AVX2 && !defined(__F16C__))
+    // fp16_to_fp32 of 4 values with integer operations, for x86 without F16C
+    MKERNEL_ALWAYS_INLINE __m128 vwiden_fp16x4(const uint16_t *p)
+    {
+      const __m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), _mm_setzero_si128());
+      const __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+      __m128i bits = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+      const __m128i exponent = _mm_and_si128(bits, _mm_set1_epi32(0x0f800000));
+      bits = _mm_add_epi32(bits, _mm_set1_epi32(0x38000000));
+      const __m128i infnan = _mm_cmpeq_epi32(exponent, _mm_set1_epi32(0x0f800000));
+      bits = _mm_add_epi32(bits, _mm_and_si128(infnan, _mm_set1_epi32(0x38000000)));
+      const __m128i subnormal = _mm_cmpeq_epi32(exponent, _mm_setzero_si128());
+      const __m128 renormalized = _mm_sub_ps(
+        _mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(0x00800000))),
+        _mm_castsi128_ps(_mm_set1_epi32(0x38800000))
+      );
+      bits = _mm_or_si128(_mm_and_si128(subnormal, _mm_castps_si128(renormalized)), _mm_andnot_si128(subnormal, bits));
+      return _mm_castsi128_ps(_mm_or_si128(bits, sign));
+    }
+
+  #endif
+
+    /*
+     Element types of the b operand of gemm: W::type is how b is stored and W::load / W::vload widen
+     one element / kVecWidth elements of it to float in registers. Widening is exact, so a gemm over
+     half precision weights computes bit for bit what the float gemm computes over the widened matrix.
+     */
+    struct WeightsF32 {
+      typedef float type;
+      static MKERNEL_ALWAYS_INLINE float load(const float *p) { return *p; }
+    #if FBSDK_ML_SIMD
+      static MKERNEL_ALWAYS_INLINE vfloat vload(const float *p) { return kernels::vload(p); }
+    #endif
+    };
+
+    struct WeightsF16 {
+      typedef uint16_t type;
+      static MKERNEL_ALWAYS_INLINE float load(const uint16_t *p) { return fp16_to_fp32(*p); }
+    #if FBSDK_ML_SIMD_AVX2 && defined(__F16C__)
+      static MKERNEL_ALWAYS_INLINE vfloat vload(const uint16_t *p) { return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))); }
+    #elif FBSDK_ML_SIMD_AVX2
+      static MKERNEL_ALWAYS_INLINE vfloat vload(const uint16_t *p) { return _mm256_insertf128_ps(_mm256_castps128_ps256(vwiden_fp16x4(p)), vwiden_fp16x4(p + 4), 1); }
+    #elif FBSDK_ML_SIMD_SSE2
+      static MKERNEL_ALWAYS_INLINE vfloat vload(const uint16_t *p) { return vwiden_fp16x4(p); }
+    #elif FBSDK_ML_SIMD_NEON && defined(__aarch64__)
+      static MKERNEL_ALWAYS_INLINE vfloat vload(const uint16_t *p) { return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(p))); }
+    #elif FBSDK_ML_SIMD_NEON
+      static MKERNEL_ALWAYS_INLINE vfloat vload(const uint16_t *p)
+      {
+        const float f[4] = {load(p), load(p + 1), load(p + 2), load(p + 3)};
+        return vld1q_f32(f);
+      }
+    #endif
+    };
+
+    struct WeightsBF16 {
+      typedef uint16_t type;
+      static MKERNEL_ALWAYS_INLINE float load(const uint16_t *p) { return bf16_to_fp32(*p); }
+    #if FBSDK_ML_SIMD_AVX2
+      static MKERNEL_ALWAYS_INLINE vfloat vload(const uint16_t *p)
+      {
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))), 16));
+      }
+    #elif FBSDK_ML_SIMD_SSE2
+      static MKERNEL_ALWAYS_INLINE vfloat vload(const uint16_t *p)
+      {
+        return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));
+      }
+    #elif FBSDK_ML_SIMD_NEON
+      static MKERNEL_ALWAYS_INLINE vfloat vload(const uint16_t *p) { return vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(p), 16)); }
+    #endif
+    };
+
+    // y[0..n) = x[0..n) widened to float
+    template <typename W>
+    static inline void widen(const typename W::type *x, float *y, int n)
+    {
+      int i = 0;
+    #if FBSDK_ML_SIMD
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        vstore(y + i, W::vload(x + i));
+      }
+    #endif
+      for (; i < n; i++) {
+        y[i] = W::load(x + i);
+      }
+    }
+
+  #if !FBSDK_ML_USE_ACCELERATE
+    /*
+     Portable gemm with the epilogue applied in registers, b is widened from W::type as it is loaded.
+     b and c have row strides of ldb and ldc; e.bias is indexed by the column of this call.
+     N and K, when not 0, fix n and k at compile time, so that the loops over them can be unrolled and
+     the offsets into b become constants; see gemm_fixed.
+     */
+    template <typename W, int N = 0, int K = 0>
+    static inline void gemm_tiled(const float *a, int lda, const typename W::type *b, int ldb, float *c, int ldc, int m, int runtime_n, int runtime_k, const GemmEpilogue &e)
+    {
+      const int n = N > 0 ? N : runtime_n;
+      const int k = K > 0 ? K : runtime_k;
+      const int out_len = m - e.pool_size + 1;
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      // 4 x (2 * kVecWidth) register tile, the accumulators stay in registers across all of k and the
+      // epilogue is applied before the tile is stored
+      const int tile_n = 2 * kVecWidth;
+      for (; i + 4 <= m; i += 4) {
+        const float *a0 = a + i * lda;
+        const float *a1 = a0 + lda;
+        const float *a2 = a1 + lda;
+        const float *a3 = a2 + lda;
+        int j = 0;
+        for (; j + tile_n <= n; j += tile_n) {
+          vfloat c00 = vdup(0), c01 = vdup(0);
+          vfloat c10 = vdup(0), c11 = vdup(0);
+          vfloat c20 = vdup(0), c21 = vdup(0);
+          vfloat c30 = vdup(0), c31 = vdup(0);
+          for (int p = 0; p < k; p++) {
+            const typename W::type *b_row = b + p * ldb + j;
+            const vfloat b0 = W::vload(b_row);
+            const vfloat b1 = W::vload(b_row + kVecWidth);
+            vfloat va = vdup(a0[p]);
+            c00 = vfma(c00, va, b0);
+            c01 = vfma(c01, va, b1);
+            va = vdup(a1[p]);
+            c10 = vfma(c10, va, b0);
+            c11 = vfma(c11, va, b1);
+            va = vdup(a2[p]);
+            c20 = vfma(c20, va, b0);
+            c21 = vfma(c21, va, b1);
+            va = vdup(a3[p]);
+            c30 = vfma(c30, va, b0);
+            c31 = vfma(c31, va, b1);
+          }
+          const int j1 = j + kVecWidth;
+          store_pooled_vector(epilogue_vector(c00, e, j), i, j, ldc, out_len, e.pool_size, c);
+          store_pooled_vector(epilogue_vector(c01, e, j1), i, j1, ldc, out_len, e.pool_size, c);
+          store_pooled_vector(epilogue_vector(c10, e, j), i + 1, j, ldc, out_len, e.pool_size, c);
+          store_pooled_vector(epilogue_vector(c11, e, j1), i + 1, j1, ldc, out_len, e.pool_size, c);
+          store_pooled_vector(epilogue_vector(c20, e, j), i + 2, j, ldc, out_len, e.pool_size, c);
+          store_pooled_vector(epilogue_vector(c21, e, j1), i + 2, j1, ldc, out_len, e.pool_size, c);
+          store_pooled_vector(epilogue_vector(c30, e, j), i + 3, j, ldc, out_len, e.pool_size, c);
+          store_pooled_vector(epilogue_vector(c31, e, j1), i + 3, j1, ldc, out_len, e.pool_size, c);
+        }
+        for (; j < n; j++) {
+          float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+          for (int p = 0; p < k; p++) {
+            const float b_pj = W::load(b + p * ldb + j);
+            s0 += a0[p] * b_pj;
+            s1 += a1[p] * b_pj;
+            s2 += a2[p] * b_pj;
+            s3 += a3[p] * b_pj;
+          }
+          store_pooled_scalar(epilogue_scalar(s0, e, j), i, j, ldc, out_len, e.pool_size, c);
+          store_pooled_scalar(epilogue_scalar(s1, e, j), i + 1, j, ldc, out_len, e.pool_size, c);
+          store_pooled_scalar(epilogue_scalar(s2, e, j), i + 2, j, ldc, out_len, e.pool_size, c);
+          store_pooled_scalar(epilogue_scalar(s3, e, j), i + 3, j, ldc, out_len, e.pool_size, c);
+        }
+      }
+     #endif
+      for (; i < m; i++) {
+        const float *a_row = a + i * lda;
+        int j = 0;
+      #if FBSDK_ML_SIMD
+        if (N > 0 && N % (4 * kVecWidth) == 0) {
+          // a single row has no other rows to hide the latency of its fmas behind, so with the columns
+          // known to come in blocks of 4 vectors it accumulates 4 of them at once
+          for (; j < n; j += 4 * kVecWidth) {
+            vfloat acc0 = vdup(0), acc1 = vdup(0), acc2 = vdup(0), acc3 = vdup(0);
+            for (int p = 0; p < k; p++) {
+              const typename W::type *b_row = b + p * ldb + j;
+              const vfloat va = vdup(a_row[p]);
+              acc0 = vfma(acc0, va, W::vload(b_row));
+              acc1 = vfma(acc1, va, W::vload(b_row + kVecWidth));
+              acc2 = vfma(acc2, va, W::vload(b_row + 2 * kVecWidth));
+              acc3 = vfma(acc3, va, W::vload(b_row + 3 * kVecWidth));
+            }
+            store_pooled_vector(epilogue_vector(acc0, e, j), i, j, ldc, out_len, e.pool_size, c);
+            store_pooled_vector(epilogue_vector(acc1, e, j + kVecWidth), i, j + kVecWidth, ldc, out_len, e.pool_size, c);
+            store_pooled_vector(epilogue_vector(acc2, e, j + 2 * kVecWidth), i, j + 2 * kVecWidth, ldc, out_len, e.pool_size, c);
+            store_pooled_vector(epilogue_vector(acc3, e, j + 3 * kVecWidth), i, j + 3 * kVecWidth, ldc, out_len, e.pool_size, c);
+          }
+        }
+        for (; j + kVecWidth <= n; j += kVecWidth) {
+          vfloat acc = vdup(0);
+          for (int p = 0; p < k; p++) {
+            acc = vfma(acc, vdup(a_row[p]), W::vload(b + p * ldb + j));
+          }
+          store_pooled_vector(epilogue_vector(acc, e, j), i, j, ldc, out_len, e.pool_size, c);
+        }
+      #endif
+        for (; j < n; j++) {
+          float acc = 0;
+          for (int p = 0; p < k; p++) {
+            acc += a_row[p] * W::load(b + p * ldb + j);
+          }
+          store_pooled_scalar(epilogue_scalar(acc, e, j), i, j, ldc, out_len, e.pool_size, c);
+        }
+      }
+    }
+
+  #endif
+
+  #if FBSDK_ML_USE_ACCELERATE
+    /*
+     c = a * b through cblas_sgemm, which rejects a row stride lda smaller than k. Overlapping rows, as
+     in the implicit im2col of conv1D, are therefore multiplied in slices of lda columns of a, each a
+     plain matrix of row stride lda, and accumulated into c.
+     */
+    static inline void sgemm(const float *a, int lda, const float *b, int ldb, float *c, int ldc, int m, int n, int k)
+    {
+      if (lda >= k) {
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, 1, a, lda, b, ldb, 0, c, ldc);
+        return;
+      }
+      for (int p = 0; p < k; p += lda) {
+        const int slice = k - p < lda ? k - p : lda;
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, slice, 1, a + p, lda, b + p * ldb, ldb, p == 0 ? 0 : 1, c, ldc);
+      }
+    }
+
+    // gemm with b and c of row strides ldb and ldc, e.bias indexed by the column of this call
+    static inline void gemm_accelerate(const float *a, int lda, const float *b, int ldb, float *c, int ldc, int m, int n, int k, const GemmEpilogue &e)
+    {
+      const int out_len = m - e.pool_size + 1;
+      if (!e.bias && !e.relu && e.pool_size == 1) {
+        if (lda == k && ldb == n && ldc == n) {
+          vDSP_mmul(a, 1, b, 1, c, 1, (vDSP_Length)m, (vDSP_Length)n, (vDSP_Length)k);
+        } else {
+          sgemm(a, lda, b, ldb, c, ldc, m, n, k);
+        }
+        return;
+      }
+      // Accelerate cannot fuse the epilogue, so blocks of up to 16 rows and 128 columns go through a
+      // buffer that stays in L1
+      const int block_rows = 16;
+      const int block_cols = 128;
+      float block[block_rows * block_cols];
+      float lower = 0;
+      float upper = FLT_MAX;
+      for (int j0 = 0; j0 < n; j0 += block_cols) {
+        const int cols = n - j0 < block_cols ? n - j0 : block_cols;
+        for (int i = 0; i < m; i += block_rows) {
+          const int rows = m - i < block_rows ? m - i : block_rows;
+          sgemm(a + i * lda, lda, b + j0, ldb, block, cols, rows, cols, k);
+          for (int r = 0; r < rows; r++) {
+            float *row = block + r * cols;
+            if (e.bias) {
+              vDSP_vadd(row, 1, e.bias + j0, 1, row, 1, (vDSP_Length)cols);
+            }
+            if (e.relu) {
+              vDSP_vclip(row, 1, &lower, &upper, row, 1, (vDSP_Length)cols);
+            }
+            store_pooled_row(row, i + r, cols, ldc, out_len, e.pool_size, c + j0);
+          }
+        }
+      }
+    }
+
+  #endif
+
+    /*
+     c = epilogue(a * b)
+     a shape: m, k with a row stride of lda (lda may be smaller than k for overlapping rows)
+     b shape: k, n
+     c shape: m - e.pool_size + 1, n
+     */
+    static inline void gemm(const float *a, int lda, const float *b, float *c, int m, int n, int k, const GemmEpilogue &e)
+    {
+      const int out_len = m - e.pool_size + 1;
+      if (out_len <= 0 || n <= 0) {
+        return;
+      }
+    #if FBSDK_ML_USE_ACCELERATE
+      gemm_accelerate(a, lda, b, n, c, n, m, n, k, e);
+    #else
+      gemm_tiled<WeightsF32>(a, lda, b, n, c, n, m, n, k, e);
+    #endif
+    }
+
+    static inline void gemm(const float *a, int lda, const float *b, float *c, int m, int n, int k)
+    {
+      gemm(a, lda, b, c, m, n, k, kNoEpilogue);
+    }
+
+    /*
+     c = a * b
+     a shape: m, k
+     b shape: k, n
+     c shape: m, n
+     */
+    static inline void gemm(const float *a, const float *b, float *c, int m, int n, int k)
+    {
+      gemm(a, k, b, c, m, n, k);
+    }
+
+    /*
+     Whether the convs of a batch run faster as one gemm over all examples stacked along M than as a gemm of
+     m rows per example. Stacking computes kernel_size - 1 rows per example that are thrown away; in return
+     it runs the rows a gemm leaves over after its 4 row register tiles, which take about 3 times as long
+     per row, once for the batch instead of once per example. Accelerate saves a call per example.
+     */
+    static inline bool gemm_stacks_conv_rows(int m, int kernel_size)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      return true;
+    #elif FBSDK_ML_SIMD
+      return 2 * (m % 4) > kernel_size - 1;
+    #else
+      return false;
+    #endif
+    }
+
+    // gemm with n = N and k = K known at compile time; Accelerate takes no advantage of them
+    template <int N, int K>
+    static inline void gemm_fixed(const float *a, int lda, const float *b, float *c, int m, const GemmEpilogue &e)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      gemm(a, lda, b, c, m, N, K, e);
+    #else
+      if (m - e.pool_size + 1 > 0) {
+        gemm_tiled<WeightsF32, N, K>(a, lda, b, N, c, N, m, N, K, e);
+      }
+    #endif
+    }
+
+    /*
+     Kernel of a dense layer, with the shape passed at runtime. The template of the same name has it fixed
+     at compile time for the shapes of the production models and ignores the shape arguments;
+     dense_for_shape picks one once, when a model is loaded.
+     x shape: m, in_size
+     w shape: in_size, out_size
+     y shape: m, out_size
+     */
+    typedef void (*DenseKernel)(const float *x, const float *w, float *y, int m, int in_size, int out_size, const GemmEpilogue &e);
+
+    static inline void dense(const float *x, const float *w, float *y, int m, int in_size, int out_size, const GemmEpilogue &e)
+    {
+      gemm(x, in_size, w, y, m, out_size, in_size, e);
+    }
+
+    template <int InSize, int OutSize>
+    static inline void dense(const float *x, const float *w, float *y, int m, int, int, const GemmEpilogue &e)
+    {
+      gemm_fixed<OutSize, InSize>(x, InSize, w, y, m, e);
+    }
+
+    static inline DenseKernel dense_for_shape(int in_size, int out_size)
+    {
+      if (in_size == 190 && out_size == 128) {
+        return dense<190, 128>;
+      }
+      if (in_size == 128 && out_size == 64) {
+        return dense<128, 64>;
+      }
+      return dense;
+    }
+
+    /*
+     The head of a classifier over m rows of a: probs = softmax(a * w + bias) row by row, and classes[r] the
+     first class of row r whose probability reaches its threshold, or -1. Each row is scanned right after
+     its softmax, while it is still in L1.
+     a shape: m, k with leading dimension lda
+     w shape: k, n
+     probs shape: m, n
+     */
+    static inline void classify_with_thresholds(const float *a, int lda, const float *w, const float *bias, float *probs, int m, int n, int k, const float *thresholds, int n_thresholds, int *classes)
+    {
+      const GemmEpilogue e = {bias, false, 1};
+      gemm(a, lda, w, probs, m, n, k, e);
+      for (int r = 0; r < m; r++) {
+        float *row = probs + r * n;
+        softmax(row, n);
+        classes[r] = first_over_threshold(row, thresholds, n_thresholds < n ? n_thresholds : n);
+      }
+    }
+
+    /*
+     gemm with b stored as W::type, e.g. WeightsF16 or WeightsBF16. Panels of columns of b are widened onto
+     the stack once and shared by every row of a; the portable backend widens b in registers instead when a
+     has a single row tile. The portable result is bit-exact with gemm() of the widened b.
+     */
+    template <typename W>
+    static inline void gemm_widening(const float *a, int lda, const typename W::type *b, float *c, int m, int n, int k, const GemmEpilogue &e)
+    {
+      if (m - e.pool_size + 1 <= 0 || n <= 0) {
+        return;
+      }
+      const int panel_floats = 4096;
+    #if FBSDK_ML_USE_ACCELERATE
+      const int panel_cols = panel_floats / k;
+      if (panel_cols == 0) {
+        // not even one column fits, which no shipped model comes close to
+        float *wide = (float *)malloc((size_t)k * n * sizeof(float));
+        widen<W>(b, wide, k * n);
+        gemm_accelerate(a, lda, wide, n, c, n, m, n, k, e);
+        free(wide);
+        return;
+      }
+    #else
+      // a multiple of every register tile width, so that each column is computed as by the full gemm
+      const int panel_cols = panel_floats / k / 16 * 16;
+      if (m <= 4 || panel_cols == 0) {
+        gemm_tiled<W>(a, lda, b, n, c, n, m, n, k, e);
+        return;
+      }
+    #endif
+      float panel[panel_floats];
+      for (int j0 = 0; j0 < n; j0 += panel_cols) {
+        const int cols = n - j0 < panel_cols ? n - j0 : panel_cols;
+        for (int p = 0; p < k; p++) {
+          widen<W>(b + p * n + j0, panel + p * cols, cols);
+        }
+        const GemmEpilogue panel_e = {e.bias ? e.bias + j0 : nullptr, e.relu, e.pool_size};
+      #if FBSDK_ML_USE_ACCELERATE
+        gemm_accelerate(a, lda, panel, cols, c + j0, n, m, cols, k, panel_e);
+      #else
+        gemm_tiled<WeightsF32>(a, lda, panel, cols, c + j0, n, m, cols, k, panel_e);
+      #endif
+      }
+    }
+
+    /*
+     c = a * b + bias for b in block compressed sparse row format, see MBlockSparseTensor. Each row of a
+     scatters its nonzero entries into its row of c, so the work is proportional to the stored blocks, and
+     zero activations, e.g. after a relu, cost nothing. The rows of c are summed in a different order than
+     by gemm, which changes the result by rounding only. The values are stored as W::type and widened as
+     they are loaded, like the b operand of gemm_widening.
+     a shape: m, k with a row stride of lda
+     b shape: k, n
+     c shape: m, n
+     */
+    template <int Block, typename W = WeightsF32>
+    static inline void gemm_block_sparse(const float *a, int lda, const int *row_offsets, const int *block_cols, const typename W::type *values, const float *bias, float *c, int m, int n, int k)
+    {
+      for (int i = 0; i < m; i++) {
+        const float *a_row = a + i * lda;
+        float *c_row = c + i * n;
+        if (bias) {
+          memcpy(c_row, bias, (size_t)n * sizeof(float));
+        } else {
+          memset(c_row, 0, (size_t)n * sizeof(float));
+        }
+        for (int p = 0; p < k; p++) {
+          const float x = a_row[p];
+          if (x == 0) {
+            continue;
+          }
+          for (int q = row_offsets[p]; q < row_offsets[p + 1]; q++) {
+            float *dst = c_row + block_cols[q];
+            const typename W::type *v = values + q * Block;
+          #if FBSDK_ML_SIMD
+            if (Block % kVecWidth == 0) {
+              const vfloat vx = vdup(x);
+              for (int j = 0; j < Block; j += kVecWidth) {
+                vstore(dst + j, vfma(vload(dst + j), vx, W::vload(v + j)));
+              }
+              continue;
+            }
+          #endif
+          #if FBSDK_ML_SIMD_AVX2
+            // half a register; the scalar loop below would stall on forwarding its stores to the next block
+            if (Block == 4) {
+              const float w[4] = {W::load(v), W::load(v + 1), W::load(v + 2), W::load(v + 3)};
+              _mm_storeu_ps(dst, _mm_fmadd_ps(_mm_set1_ps(x), _mm_loadu_ps(w), _mm_loadu_ps(dst)));
+              continue;
+            }
+          #endif
+            // with a constant Block, clang vectorizes this loop for NEON
+            for (int j = 0; j < Block; j++) {
+              dst[j] += x * W::load(v + j);
+            }
+          }
+        }
+      }
+    }
+
+    // Symmetric int8 quantization q = round(x / scale) with scale = max|x| / 127. Returns the scale,
+    // 0 if x is all zeros.
+    static inline float quantize_s8(const float *x, int n, int8_t *q)
+    {
+      float amax = 0;
+    #if FBSDK_ML_USE_ACCELERATE
+      vDSP_maxmgv(x, 1, &amax, (vDSP_Length)n);
+    #else
+      int i = 0;
+     #if FBSDK_ML_SIMD
+      vfloat vamax = vdup(0);
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        vamax = vmax(vamax, vabs(vload(x + i)));
+      }
+      amax = vreduce_max(vamax);
+     #endif
+      for (; i < n; i++) {
+        amax = fmaxf(amax, fabsf(x[i]));
+      }
+    #endif
+      if (amax == 0) {
+        memset(q, 0, (size_t)n);
+        return 0;
+      }
+      float inv_scale = 127 / amax;
+    #if FBSDK_ML_USE_ACCELERATE
+      // scaled through a block on the stack, vDSP_vfixr8 rounds to the nearest integer
+      float block[256];
+      for (int i = 0; i < n; i += 256) {
+        const vDSP_Length len = (vDSP_Length)(n - i < 256 ? n - i : 256);
+        vDSP_vsmul(x + i, 1, &inv_scale, block, 1, len);
+        vDSP_vfixr8(block, 1, reinterpret_cast<char *>(q + i), 1, len);
+      }
+    #else
+      i = 0;
+     #if FBSDK_ML_SIMD
+      const vfloat vinv_scale = vdup(inv_scale);
+      for (; i + kVecWidth <= n; i += kVecWidth) {
+        vstore_rounded_s8(q + i, vmul(vload(x + i), vinv_scale));
+      }
+     #endif
+      for (; i < n; i++) {
+        q[i] = (int8_t)lrintf(x[i] * inv_scale);
+      }
+    #endif
+      return amax / 127;
+    }
+
+    // Bytes of an int8 k x n matrix in the k-pair interleaved layout of gemm_s8
+    static inline size_t packed_s8_size(int k, int n)
+    {
+      return (size_t)((k + 1) / 2) * 2 * (size_t)n;
+    }
+
+    /*
+     Quantizes every column of w with its own scale, e.g. per output channel of a weight in kernel layout,
+     into the layout gemm_s8 expects: rows p and p + 1 interleaved, b[p / 2][j][p % 2], with a zero row
+     appended if k is odd.
+     w shape: k, n
+     q size: packed_s8_size(k, n)
+     scales shape: n
+     */
+    static inline void quantize_columns_s8(const float *w, int k, int n, int8_t *q, float *scales)
+    {
+      memset(q, 0, packed_s8_size(k, n));
+      for (int j = 0; j < n; j++) {
+        float amax = 0;
+        for (int p = 0; p < k; p++) {
+          amax = fmaxf(amax, fabsf(w[p * n + j]));
+        }
+        scales[j] = amax / 127;
+        const float inv_scale = amax == 0 ? 0 : 127 / amax;
+        for (int p = 0; p < k; p++) {
+          q[(p / 2) * 2 * n + 2 * j + p % 2] = (int8_t)lrintf(w[p * n + j] * inv_scale);
+        }
+      }
+    }
+
+    // a[p] and a[p + 1] as two int16 in one int32, the operand layout of a 16 bit multiply-add
+    MKERNEL_ALWAYS_INLINE int32_t load_pair_s16(const int16_t *a)
+    {
+      int32_t pair;
+      memcpy(&pair, a, sizeof(pair));
+      return pair;
+    }
+
+    // dst[0, 2 * pairs) = a[p0, p0 + 2 * pairs) widened to int16, zero past k
+    MKERNEL_ALWAYS_INLINE void widen_pairs_s8(const int8_t *a, int p0, int k, int pairs, int16_t *dst)
+    {
+      const int len = k - p0 < 2 * pairs ? k - p0 : 2 * pairs;
+      for (int p = 0; p < len; p++) {
+        dst[p] = a[p0 + p];
+      }
+      for (int p = len; p < 2 * pairs; p++) {
+        dst[p] = 0;
+      }
+    }
+
+  // The int8 gemm has SIMD tiles on x86 and on arm64, with Accelerate too: vDSP has no int8 product
+  #if FBSDK_ML_SIMD_AVX2 || FBSDK_ML_SIMD_SSE2 || ((FBSDK_ML_SIMD_NEON || FBSDK_ML_USE_ACCELERATE) && defined(__aarch64__) && !defined(FBSDK_ML_DISABLE_SIMD))
+   #define FBSDK_ML_SIMD_S8 1
+    // int32 accumulators of kS8Width columns, updated with the products of one k pair
+   #if FBSDK_ML_SIMD_AVX2
+    typedef __m256i vint;
+    static const int kS8Width = 8;
+    MKERNEL_ALWAYS_INLINE vint vzero_s32() { return _mm256_setzero_si256(); }
+    MKERNEL_ALWAYS_INLINE vint vload_s32(const int32_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+    MKERNEL_ALWAYS_INLINE void vstore_s32(int32_t *p, vint v) { _mm256_storeu_si256((__m256i *)p, v); }
+    // kS8Width columns of one k pair, widened to int16
+    MKERNEL_ALWAYS_INLINE vint vload_pairs_s8(const int8_t *b) { return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)b)); }
+    // the tile accumulators are plain vints
+    typedef vint vacc;
+    MKERNEL_ALWAYS_INLINE vacc vzero_acc() { return vzero_s32(); }
+    MKERNEL_ALWAYS_INLINE vacc vload_acc(const int32_t *p) { return vload_s32(p); }
+    MKERNEL_ALWAYS_INLINE void vstore_acc(int32_t *p, vacc acc) { vstore_s32(p, acc); }
+    MKERNEL_ALWAYS_INLINE vacc vmadd_pairs(vacc acc, vint b, int32_t a_pair) { return _mm256_add_epi32(acc, _mm256_madd_epi16(b, _mm256_set1_epi32(a_pair))); }
+    MKERNEL_ALWAYS_INLINE vfloat vcvt_f32(vint v) { return _mm256_cvtepi32_ps(v); }
+   #elif FBSDK_ML_SIMD_SSE2
+    typedef __m128i vint;
+    static const int kS8Width = 4;
+    MKERNEL_ALWAYS_INLINE vint vzero_s32() { return _mm_setzero_si128(); }
+    MKERNEL_ALWAYS_INLINE vint vload_s32(const int32_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+    MKERNEL_ALWAYS_INLINE void vstore_s32(int32_t *p, vint v) { _mm_storeu_si128((__m128i *)p, v); }
+    MKERNEL_ALWAYS_INLINE vint vload_pairs_s8(const int8_t *b)
+    {
+      const __m128i x = _mm_loadl_epi64((const __m128i *)b);
+      return _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+    }
+
+    // the tile accumulators are plain vints
+    typedef vint vacc;
+    MKERNEL_ALWAYS_INLINE vacc vzero_acc() { return vzero_s32(); }
+    MKERNEL_ALWAYS_INLINE vacc vload_acc(const int32_t *p) { return vload_s32(p); }
+    MKERNEL_ALWAYS_INLINE void vstore_acc(int32_t *p, vacc acc) { vstore_s32(p, acc); }
+    MKERNEL_ALWAYS_INLINE vacc vmadd_pairs(vacc acc, vint b, int32_t a_pair) { return _mm_add_epi32(acc, _mm_madd_epi16(b, _mm_set1_epi32(a_pair))); }
+    MKERNEL_ALWAYS_INLINE vfloat vcvt_f32(vint v) { return _mm_cvtepi32_ps(v); }
+   #else
+    typedef int32x4_t vint;
+    static const int kS8Width = 4;
+    MKERNEL_ALWAYS_INLINE vint vload_s32(const int32_t *p) { return vld1q_s32(p); }
+    MKERNEL_ALWAYS_INLINE int16x8_t vload_pairs_s8(const int8_t *b) { return vmovl_s8(vld1_s8(b)); }
+    // The products of the two halves of a pair stay in separate lanes, columns 0, 1 in lo and 2, 3 in hi,
+    // so the pairwise add runs once per tile instead of once per pair.
+    struct vacc {
+      int32x4_t lo;
+      int32x4_t hi;
+    };
+    MKERNEL_ALWAYS_INLINE vacc vzero_acc() { return {vdupq_n_s32(0), vdupq_n_s32(0)}; }
+    MKERNEL_ALWAYS_INLINE vacc vload_acc(const int32_t *p)
+    {
+      const int32x4_t v = vld1q_s32(p);
+      return {vzip1q_s32(v, vdupq_n_s32(0)), vzip2q_s32(v, vdupq_n_s32(0))};
+    }
+
+    MKERNEL_ALWAYS_INLINE void vstore_acc(int32_t *p, vacc acc) { vst1q_s32(p, vpaddq_s32(acc.lo, acc.hi)); }
+    MKERNEL_ALWAYS_INLINE vacc vmadd_pairs(vacc acc, int16x8_t b, int32_t a_pair)
+    {
+      const int16x8_t a = vreinterpretq_s16_s32(vdupq_n_s32(a_pair));
+      return {vmlal_s16(acc.lo, vget_low_s16(b), vget_low_s16(a)), vmlal_high_s16(acc.hi, b, a)};
+    }
+
+    #if !FBSDK_ML_USE_ACCELERATE
+    MKERNEL_ALWAYS_INLINE vfloat vcvt_f32(vint v) { return vcvtq_f32_s32(v); }
+    #endif
+   #endif
+
+    /*
+     acc[r][0, 2 * kS8Width) (+)= the products of row r of a with 2 * kS8Width columns of b over pairs k pairs,
+     for 4 rows of a, respectively 1 in gemm_s8_tile_1.
+     a16: a widened by widen_pairs_s8, rows lda16 apart
+     b: the first column of the first k pair, k pairs 2 * n bytes apart
+     acc: rows ldacc apart, overwritten unless accumulate
+     */
+    MKERNEL_ALWAYS_INLINE void gemm_s8_tile_4(const int16_t *a16, int lda16, const int8_t *b, int n, int pairs, int32_t *acc, int ldacc, bool accumulate)
+    {
+      const int16_t *p0 = a16;
+      const int16_t *p1 = p0 + lda16;
+      const int16_t *p2 = p1 + lda16;
+      const int16_t *p3 = p2 + lda16;
+      int32_t *acc0 = acc;
+      int32_t *acc1 = acc0 + ldacc;
+      int32_t *acc2 = acc1 + ldacc;
+      int32_t *acc3 = acc2 + ldacc;
+      vacc c00 = vzero_acc(), c01 = vzero_acc();
+      vacc c10 = vzero_acc(), c11 = vzero_acc();
+      vacc c20 = vzero_acc(), c21 = vzero_acc();
+      vacc c30 = vzero_acc(), c31 = vzero_acc();
+      if (accumulate) {
+        c00 = vload_acc(acc0);
+        c01 = vload_acc(acc0 + kS8Width);
+        c10 = vload_acc(acc1);
+        c11 = vload_acc(acc1 + kS8Width);
+        c20 = vload_acc(acc2);
+        c21 = vload_acc(acc2 + kS8Width);
+        c30 = vload_acc(acc3);
+        c31 = vload_acc(acc3 + kS8Width);
+      }
+      for (int q = 0; q < pairs; q++, b += 2 * n) {
+        const auto b0 = vload_pairs_s8(b);
+        const auto b1 = vload_pairs_s8(b + 2 * kS8Width);
+        c00 = vmadd_pairs(c00, b0, load_pair_s16(p0 + 2 * q));
+        c01 = vmadd_pairs(c01, b1, load_pair_s16(p0 + 2 * q));
+        c10 = vmadd_pairs(c10, b0, load_pair_s16(p1 + 2 * q));
+        c11 = vmadd_pairs(c11, b1, load_pair_s16(p1 + 2 * q));
+        c20 = vmadd_pairs(c20, b0, load_pair_s16(p2 + 2 * q));
+        c21 = vmadd_pairs(c21, b1, load_pair_s16(p2 + 2 * q));
+        c30 = vmadd_pairs(c30, b0, load_pair_s16(p3 + 2 * q));
+        c31 = vmadd_pairs(c31, b1, load_pair_s16(p3 + 2 * q));
+      }
+      vstore_acc(acc0, c00);
+      vstore_acc(acc0 + kS8Width, c01);
+      vstore_acc(acc1, c10);
+      vstore_acc(acc1 + kS8Width, c11);
+      vstore_acc(acc2, c20);
+      vstore_acc(acc2 + kS8Width, c21);
+      vstore_acc(acc3, c30);
+      vstore_acc(acc3 + kS8Width, c31);
+    }
+
+    MKERNEL_ALWAYS_INLINE void gemm_s8_tile_1(const int16_t *a16, const int8_t *b, int n, int pairs, int32_t *acc, bool accumulate)
+    {
+      vacc c0 = accumulate ? vload_acc(acc) : vzero_acc();
+      vacc c1 = accumulate ? vload_acc(acc + kS8Width) : vzero_acc();
+      for (int q = 0; q < pairs; q++, b += 2 * n) {
+        const int32_t a_pair = load_pair_s16(a16 + 2 * q);
+        c0 = vmadd_pairs(c0, vload_pairs_s8(b), a_pair);
+        c1 = vmadd_pairs(c1, vload_pairs_s8(b + 2 * kS8Width), a_pair);
+      }
+      vstore_acc(acc, c0);
+      vstore_acc(acc + kS8Width, c1);
+    }
+
+  #endif
+
+    // row[j] = epilogue(acc[j] * a_scale * b_scales[j]) for the n columns of a row of gemm_s8
+    static inline void finish_s8_row(const int32_t *acc, float a_scale, const float *b_scales, const GemmEpilogue &e, int j0, float *row, int n)
+    {
+    #if FBSDK_ML_USE_ACCELERATE
+      vDSP_vflt32(acc, 1, row, 1, (vDSP_Length)n);
+      vDSP_vmul(row, 1, b_scales + j0, 1, row, 1, (vDSP_Length)n);
+      if (e.bias) {
+        vDSP_vsma(row, 1, &a_scale, e.bias + j0, 1, row, 1, (vDSP_Length)n);
+      } else {
+        vDSP_vsmul(row, 1, &a_scale, row, 1, (vDSP_Length)n);
+      }
+      if (e.relu) {
+        float lower = 0;
+        float upper = FLT_MAX;
+        vDSP_vclip(row, 1, &lower, &upper, row, 1, (vDSP_Length)n);
+      }
+    #else
+      int j = 0;
+     #if FBSDK_ML_SIMD_S8
+      const vfloat va = vdup(a_scale);
+      for (; j + kVecWidth <= n; j += kVecWidth) {
+        vstore(row + j, epilogue_vector(vmul(vcvt_f32(vload_s32(acc + j)), vmul(va, vload(b_scales + j0 + j))), e, j0 + j));
+      }
+     #endif
+      for (; j < n; j++) {
+        row[j] = epilogue_scalar((float)acc[j] * (a_scale * b_scales[j0 + j]), e, j0 + j);
+      }
+    #endif
+    }
+
+    /*
+     gemm on int8 inputs, accumulated in int32 and scaled back to float before the epilogue.
+     a shape: m, k with a row stride of lda, row i quantized with a_scales[i * a_scales_stride]; a stride of 0
+     shares a_scales[0] between all rows, e.g. the overlapping rows of a conv
+     b: k x n in the layout written by quantize_columns_s8, column j quantized with b_scales[j]
+     c shape: m - e.pool_size + 1, n
+     */
+    static inline void gemm_s8(const int8_t *a, int lda, const float *a_scales, int a_scales_stride, const int8_t *b, const float *b_scales, float *c, int m, int n, int k, const GemmEpilogue &e)
+    {
+      const int out_len = m - e.pool_size + 1;
+      if (out_len <= 0 || n <= 0) {
+        return;
+      }
+      // Blocks of up to 4 rows and 128 columns are accumulated over k, in chunks of up to 256 k pairs, then
+      // finished and stored in row order for the pooling. The scratch of a block stays on the stack.
+      const int block_rows = 4;
+      const int block_cols = 128;
+      const int block_pairs = 256;
+      const int k_pairs = (k + 1) / 2;
+      int32_t acc[block_rows * block_cols];
+      float row[block_cols];
+    #if FBSDK_ML_SIMD_S8
+      // the a operands of every k pair of a block, widened once and reused for every column tile
+      int16_t a16[block_rows * 2 * block_pairs];
+      const int tile_n = 2 * kS8Width;
+    #endif
+      for (int i = 0; i < m; i += block_rows) {
+        const int rows = m - i < block_rows ? m - i : block_rows;
+        for (int j0 = 0; j0 < n; j0 += block_cols) {
+          const int cols = n - j0 < block_cols ? n - j0 : block_cols;
+          int q0 = 0;
+          do {
+            const int pairs = k_pairs - q0 < block_pairs ? k_pairs - q0 : block_pairs;
+            const bool accumulate = q0 > 0;
+            const int8_t *b_block = b + q0 * 2 * n + 2 * j0;
+            int j = 0;
+          #if FBSDK_ML_SIMD_S8
+            for (int r = 0; r < rows; r++) {
+              widen_pairs_s8(a + (i + r) * lda, 2 * q0, k, pairs, a16 + r * 2 * block_pairs);
+            }
+            for (; j + tile_n <= cols; j += tile_n) {
+              if (rows == block_rows) {
+                gemm_s8_tile_4(a16, 2 * block_pairs, b_block + 2 * j, n, pairs, acc + j, block_cols, accumulate);
+              } else {
+                // the rows left over at the end of a, e.g. the single example of a dense layer
+                for (int r = 0; r < rows; r++) {
+                  gemm_s8_tile_1(a16 + r * 2 * block_pairs, b_block + 2 * j, n, pairs, acc + r * block_cols + j, accumulate);
+                }
+              }
+            }
+          #endif
+            for (int r = 0; r < rows; r++) {
+              const int8_t *a_row = a + (i + r) * lda;
+              int32_t *acc_row = acc + r * block_cols;
+              if (!accumulate) {
+                memset(acc_row + j, 0, (size_t)(cols - j) * sizeof(int32_t));
+              }
+              for (int q = 0; q < pairs; q++) {
+                const int p = 2 * (q0 + q);
+                const int32_t a_lo = a_row[p];
+                const int32_t a_hi = p + 1 < k ? a_row[p + 1] : 0;
+                const int8_t *b_pair = b_block + q * 2 * n + 2 * j;
+                for (int jj = j; jj < cols; jj++, b_pair += 2) {
+                  acc_row[jj] += a_lo * b_pair[0] + a_hi * b_pair[1];
+                }
+              }
+            }
+            q0 += block_pairs;
+          } while (q0 < k_pairs);
+          for (int r = 0; r < rows; r++) {
+            // without pooling the finished row goes straight to c
+            float *dst = e.pool_size == 1 ? c + (i + r) * n + j0 : row;
+            finish_s8_row(acc + r * block_cols, a_scales[(i + r) * a_scales_stride], b_scales, e, j0, dst, cols);
+            if (e.pool_size > 1) {
+              store_pooled_row(row, i + r, cols, n, out_len, e.pool_size, c + j0);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif
+
+#endif /* FBSDKModelKernels_hpp */
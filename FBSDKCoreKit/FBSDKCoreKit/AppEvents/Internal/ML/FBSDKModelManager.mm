@@ -10,13 +10,22 @@
 
 #import "FBSDKModelManager.h"
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #import <FBSDKCoreKit/FBSDKAppEventName.h>
 
+#import "FBSDKBatchEventProcessing.h"
+#import "FBSDKBatchIntegrityProcessing.h"
 #import "FBSDKIntegrityManager.h"
 #import "FBSDKMLMacros.h"
 #import "FBSDKModelParser.h"
 #import "FBSDKModelRuntime.hpp"
+#import "FBSDKModelSnapshot.hpp"
 #import "FBSDKModelUtility.h"
+#import "FBSDKModelWeights.hpp"
+#import "FBSDKPredictionCache.hpp"
 
 static NSString *const INTEGRITY_NONE = @"none";
 static NSString *const INTEGRITY_ADDRESS = @"address";
@@ -24,11 +33,34 @@ static NSString *const INTEGRITY_HEALTH = @"health";
 
 static NSString *_directoryPath;
 static NSMutableDictionary<NSString *, id> *_modelInfo;
-static std::unordered_map<std::string, fbsdk::MTensor> _MTMLWeights;
+// predictions run on the snapshot current when they start, loading a model publishes a new one
+static fbsdk::MSnapshotHolder<fbsdk::MTMLSnapshot> _MTMLSnapshot;
+static std::atomic<uint64_t> _MTMLSnapshotVersion(0);
+// softmax outputs of recent predictions, apps keep logging the same parameter keys and texts
+static fbsdk::MPredictionCache _MTMLPredictionCache(128 * 1024);
+
+#if FBSDK_ML_PROFILING
+fbsdk::MModelProfiler &fbsdk::MModelManagerProfiler()
+{
+  static fbsdk::MModelProfiler profiler;
+  return profiler;
+}
+#endif
+
+// Thresholds of a task as the plain floats the classifiers compare against, unboxed once per batch
+static std::vector<float> FBSDKThresholdValues(NSArray<NSNumber *> *thresholds)
+{
+  std::vector<float> values;
+  values.reserve(thresholds.count);
+  for (NSNumber *threshold in thresholds) {
+    values.push_back(threshold.floatValue);
+  }
+  return values;
+}
 
 NS_ASSUME_NONNULL_BEGIN
 
-@interface FBSDKModelManager ()
+@interface FBSDKModelManager () <FBSDKBatchEventProcessing, FBSDKBatchIntegrityProcessing>
 
 @property (nullable, nonatomic) id<FBSDKFeatureChecking> featureChecker;
 @property (nullable, nonatomic) id<FBSDKGraphRequestFactory> graphRequestFactory;
@@ -200,71 +232,181 @@ static dispatch_once_t enableNonce;
 // Used by the `integrityParametersProcessor` which holds a weak reference to this instance
 - (BOOL)processIntegrity:(nullable NSString *)param
 {
-  NSString *integrityType = INTEGRITY_NONE;
+  if (param.length == 0) {
+    return false;
+  }
+  return [[self processIntegrityForParameters:@[param]].firstObject boolValue];
+}
+
+- (NSArray<NSNumber *> *)processIntegrityForParameters:(NSArray<NSString *> *)parameters
+{
+  NSMutableArray<NSNumber *> *results = [NSMutableArray arrayWithCapacity:parameters.count];
+  for (NSUInteger i = 0; i < parameters.count; i++) {
+    [FBSDKTypeUtility array:results addObject:@NO];
+  }
   @try {
-    if (param.length == 0 || _MTMLWeights.size() == 0) {
-      return false;
+    const std::shared_ptr<const fbsdk::MTMLSnapshot> snapshot = _MTMLSnapshot.Load();
+    if (parameters.count == 0 || !snapshot || snapshot->empty()) {
+      return results;
     }
     NSArray<NSString *> *integrityMapping = [self.class getIntegrityMapping];
-    NSString *text = [FBSDKModelUtility normalizedText:param];
-    const char *bytes = [text UTF8String];
-    if ((int)strlen(bytes) == 0) {
-      return false;
-    }
     NSArray<NSNumber *> *thresholds = [FBSDKModelManager.shared getThresholdsForKey:MTMLTaskIntegrityDetectKey];
     if (thresholds.count != integrityMapping.count) {
-      return false;
+      return results;
     }
-    const fbsdk::MTensor &res = fbsdk::predictOnMTML("integrity_detect", bytes, _MTMLWeights, nullptr);
-    if (res.count() == 0) {
-      return false;
+    const std::vector<float> &thresholdValues = FBSDKThresholdValues(thresholds);
+
+    // normalized texts are retained here so that their UTF8 buffers outlive the prediction
+    NSMutableArray<NSString *> *texts = [NSMutableArray arrayWithCapacity:parameters.count];
+    std::vector<const char *> bytes;
+    std::vector<NSUInteger> indices;
+    // class of every parameter, -1 for none; cached probabilities are classified here, only the misses
+    // are run through the model
+    std::vector<int> classes(parameters.count, -1);
+    std::vector<float> cached;
+    fbsdk::MPredictionKey key = {"integrity_detect", snapshot->version, 0, 0, ""};
+    for (NSUInteger i = 0; i < parameters.count; i++) {
+      NSString *param = [FBSDKTypeUtility array:parameters objectAtIndex:i];
+      if (![param isKindOfClass:NSString.class] || param.length == 0) {
+        continue;
+      }
+      NSString *text = [FBSDKModelUtility normalizedText:param];
+      const char *textBytes = [text UTF8String];
+      if (!textBytes || (int)strlen(textBytes) == 0) {
+        continue;
+      }
+      key.SetText(textBytes);
+      if (_MTMLPredictionCache.Lookup(key, cached)) {
+        if (cached.size() >= thresholdValues.size()) {
+          classes[i] = fbsdk::firstClassOverThreshold(cached.data(), thresholdValues.data(), (int)thresholdValues.size());
+        }
+        continue;
+      }
+      [FBSDKTypeUtility array:texts addObject:text];
+      bytes.push_back(textBytes);
+      indices.push_back(i);
     }
-    const float *res_data = res.data();
-    for (int i = 0; i < thresholds.count; i++) {
-      if ((float)res_data[i] >= (float)[[FBSDKTypeUtility array:thresholds objectAtIndex:i] floatValue]) {
-        integrityType = [FBSDKTypeUtility array:integrityMapping objectAtIndex:i];
-        break;
+
+    if (!bytes.empty()) {
+      fbsdk::MTMLInferenceOptions options;
+      options.arena = fbsdk::threadLocalArena();
+#if FBSDK_ML_PROFILING
+      options.profiler = &fbsdk::MModelManagerProfiler();
+#endif
+      options.quantized = snapshot->quantized_tasks.count("integrity_detect") > 0;
+      std::vector<int> predicted;
+      const fbsdk::MTensor &res = fbsdk::classifyOnMTMLSnapshot("integrity_detect", bytes, *snapshot, nullptr, thresholdValues.data(), (int)thresholdValues.size(), predicted, options);
+      if (res.count() == 0) {
+        return results;
+      }
+      for (size_t n = 0; n < indices.size(); n++) {
+        classes[indices[n]] = predicted[n];
+        key.SetText(bytes[n]);
+        _MTMLPredictionCache.Insert(key, res.Slice((int)n).data(), res.size(1));
+      }
+    }
+
+    for (NSUInteger n = 0; n < parameters.count; n++) {
+      if (classes[n] >= 0) {
+        NSString *integrityType = [FBSDKTypeUtility array:integrityMapping objectAtIndex:classes[n]];
+        results[n] = @(![integrityType isEqualToString:INTEGRITY_NONE]);
       }
     }
   } @catch (NSException *exception) {
     NSLog(@"Fail to process parameter for integrity usecase, exception reason: %@", exception.reason);
   }
-  return ![integrityType isEqualToString:INTEGRITY_NONE];
+  return results;
 }
 
 #pragma mark - SuggestedEvents Inferencer method
 
 - (NSString *)processSuggestedEvents:(NSString *)textFeature denseData:(nullable float *)denseData
 {
+  if (textFeature.length == 0 || !denseData) {
+    return SUGGESTED_EVENT_OTHER;
+  }
+  return [self processSuggestedEventsForTextFeatures:@[textFeature] denseData:denseData].firstObject ?: SUGGESTED_EVENT_OTHER;
+}
+
+- (NSArray<NSString *> *)processSuggestedEventsForTextFeatures:(NSArray<NSString *> *)textFeatures denseData:(nullable float *)denseData
+{
+  NSMutableArray<NSString *> *events = [NSMutableArray arrayWithCapacity:textFeatures.count];
+  for (NSUInteger i = 0; i < textFeatures.count; i++) {
+    [FBSDKTypeUtility array:events addObject:SUGGESTED_EVENT_OTHER];
+  }
   @try {
     NSArray<NSString *> *eventMapping = [FBSDKModelManager getSuggestedEventsMapping];
-    if (textFeature.length == 0 || _MTMLWeights.size() == 0 || !denseData) {
-      return SUGGESTED_EVENT_OTHER;
-    }
-    const char *bytes = [textFeature UTF8String];
-    if ((int)strlen(bytes) == 0) {
-      return SUGGESTED_EVENT_OTHER;
+    const std::shared_ptr<const fbsdk::MTMLSnapshot> snapshot = _MTMLSnapshot.Load();
+    if (textFeatures.count == 0 || !snapshot || snapshot->empty() || !denseData) {
+      return events;
     }
 
     NSArray<NSNumber *> *thresholds = [FBSDKModelManager.shared getThresholdsForKey:MTMLTaskAppEventPredKey];
     if (thresholds.count != eventMapping.count) {
-      return SUGGESTED_EVENT_OTHER;
+      return events;
+    }
+    const std::vector<float> &thresholdValues = FBSDKThresholdValues(thresholds);
+
+    std::vector<const char *> bytes;
+    std::vector<NSUInteger> indices;
+    std::vector<float> dense;
+    // class of every text, -1 for none; cached probabilities are classified here, only the misses are run
+    // through the model
+    std::vector<int> classes(textFeatures.count, -1);
+    std::vector<float> cached;
+    fbsdk::MPredictionKey key = {"app_event_pred", snapshot->version, 0, 0, ""};
+    for (NSUInteger i = 0; i < textFeatures.count; i++) {
+      NSString *textFeature = [FBSDKTypeUtility array:textFeatures objectAtIndex:i];
+      if (![textFeature isKindOfClass:NSString.class] || textFeature.length == 0) {
+        continue;
+      }
+      const char *textBytes = [textFeature UTF8String];
+      if (!textBytes || (int)strlen(textBytes) == 0) {
+        continue;
+      }
+      const float *row = denseData + i * DENSE_FEATURE_LEN;
+      key.SetText(textBytes);
+      key.dense_hash = fbsdk::MHashDenseFeatures(row, DENSE_FEATURE_LEN);
+      if (_MTMLPredictionCache.Lookup(key, cached)) {
+        if (cached.size() >= thresholdValues.size()) {
+          classes[i] = fbsdk::firstClassOverThreshold(cached.data(), thresholdValues.data(), (int)thresholdValues.size());
+        }
+        continue;
+      }
+      bytes.push_back(textBytes);
+      indices.push_back(i);
+      dense.insert(dense.end(), row, row + DENSE_FEATURE_LEN);
     }
 
-    const fbsdk::MTensor &res = fbsdk::predictOnMTML("app_event_pred", bytes, _MTMLWeights, denseData);
-    if (res.count() == 0) {
-      return SUGGESTED_EVENT_OTHER;
+    if (!bytes.empty()) {
+      fbsdk::MTMLInferenceOptions options;
+      options.arena = fbsdk::threadLocalArena();
+#if FBSDK_ML_PROFILING
+      options.profiler = &fbsdk::MModelManagerProfiler();
+#endif
+      options.quantized = snapshot->quantized_tasks.count("app_event_pred") > 0;
+      std::vector<int> predicted;
+      const fbsdk::MTensor &res = fbsdk::classifyOnMTMLSnapshot("app_event_pred", bytes, *snapshot, dense.data(), thresholdValues.data(), (int)thresholdValues.size(), predicted, options);
+      if (res.count() == 0) {
+        return events;
+      }
+      for (size_t n = 0; n < indices.size(); n++) {
+        classes[indices[n]] = predicted[n];
+        key.SetText(bytes[n]);
+        key.dense_hash = fbsdk::MHashDenseFeatures(dense.data() + n * DENSE_FEATURE_LEN, DENSE_FEATURE_LEN);
+        _MTMLPredictionCache.Insert(key, res.Slice((int)n).data(), res.size(1));
+      }
     }
-    const float *res_data = res.data();
-    for (int i = 0; i < thresholds.count; i++) {
-      if ((float)res_data[i] >= (float)[[FBSDKTypeUtility array:thresholds objectAtIndex:i] floatValue]) {
-        return [FBSDKTypeUtility array:eventMapping objectAtIndex:i];
+
+    for (NSUInteger n = 0; n < textFeatures.count; n++) {
+      if (classes[n] >= 0) {
+        events[n] = [FBSDKTypeUtility array:eventMapping objectAtIndex:classes[n]];
       }
     }
   } @catch (NSException *exception) {
     NSLog(@"Fail to process suggested events, exception reason: %@", exception.reason);
   }
-  return SUGGESTED_EVENT_OTHER;
+  return events;
 }
 
 #pragma mark - Private methods
@@ -305,12 +447,53 @@ static dispatch_once_t enableNonce;
   }
 }
 
+// Builds the model of the MTML weights data and publishes it to the predictions, NO if data holds no valid model
+- (BOOL)publishMTMLWeights:(nullable NSData *)data
+{
+  std::unordered_map<std::string, fbsdk::MTensor> weights = [FBSDKModelParser parseWeightsData:data];
+  // the new model is completed before it is published, in-flight predictions keep the previous one
+  std::shared_ptr<fbsdk::MTMLSnapshot> snapshot = std::make_shared<fbsdk::MTMLSnapshot>();
+  const uint32_t flags = [FBSDKModelParser weightsFlags:data];
+  fbsdk::MOpGraph graph;
+  if ([FBSDKModelParser parseOpGraph:data graph:graph] && !fbsdk::isMTMLOpGraph(graph)) {
+    // the graph describes a new architecture, so it replaces the fixed MTML one and its shape checks;
+    // planOpGraph validates the weights against it. Planned graphs run in fp32 only.
+    if (graph.dense_length != DENSE_FEATURE_LEN
+        || (flags & (fbsdk::kWeightsFlagFloat16Storage | fbsdk::kWeightsFlagBFloat16Storage))) {
+      return NO;
+    }
+    snapshot->graph = fbsdk::planOpGraph(graph, weights);
+    if (snapshot->graph.empty()) {
+      return NO;
+    }
+  } else {
+    if (![FBSDKModelParser validateWeights:weights forKey:MTMLKey]) {
+      return NO;
+    }
+    // transpose the weights into kernel layout once instead of on every prediction
+    snapshot->model = fbsdk::packMTMLWeights(weights);
+    fbsdk::precomputeMTMLEmbeddingConv(snapshot->model);
+#if FBSDK_ML_QUANTIZED_INFERENCE
+    fbsdk::quantizeMTMLModel(snapshot->model);
+    snapshot->quantized_tasks = {"app_event_pred", "integrity_detect"};
+#endif
+    if (flags & fbsdk::kWeightsFlagBFloat16Storage) {
+      fbsdk::storeMTMLModelInHalfPrecision(snapshot->model, fbsdk::kHalfBFloat16);
+    } else if (flags & fbsdk::kWeightsFlagFloat16Storage) {
+      fbsdk::storeMTMLModelInHalfPrecision(snapshot->model, fbsdk::kHalfFloat16);
+    }
+  }
+  snapshot->version = ++_MTMLSnapshotVersion;
+  snapshot->model_id = snapshot->version;
+  _MTMLSnapshot.Publish(snapshot);
+  _MTMLPredictionCache.Clear();
+  return YES;
+}
+
 - (void)checkFeaturesAndExecuteForMTML
 {
   [self getModelAndRules:MTMLKey onSuccess:^() {
-    NSData *data = [self getWeightsForKey:MTMLKey];
-    _MTMLWeights = [FBSDKModelParser parseWeightsData:data];
-    if (![FBSDKModelParser validateWeights:_MTMLWeights forKey:MTMLKey]) {
+    if (![self publishMTMLWeights:[self getWeightsForKey:MTMLKey]]) {
       return;
     }
 
@@ -403,6 +586,10 @@ static dispatch_once_t enableNonce;
     queue, ^{
       NSURL *url = [NSURL URLWithString:urlString];
       NSData *urlData = [NSData dataWithContentsOfURL:url];
+      if (urlData && [filePath hasSuffix:@".weights"] && ![FBSDKModelParser isWeightsContainer:urlData]) {
+        // Convert weights in the legacy format before they are written, loads map the container without parsing it
+        urlData = [FBSDKModelParser convertLegacyWeightsData:urlData] ?: urlData;
+      }
       if (urlData) {
         [urlData writeToFile:filePath atomically:YES];
       }
@@ -476,6 +663,8 @@ static dispatch_once_t enableNonce;
   }
   _directoryPath = nil;
   _modelInfo = nil;
+  _MTMLSnapshot.Publish(nullptr);
+  _MTMLPredictionCache.Clear();
 
   self.shared.featureChecker = nil;
   self.shared.graphRequestFactory = nil;
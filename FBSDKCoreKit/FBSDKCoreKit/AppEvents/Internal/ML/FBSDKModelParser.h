@@ -10,6 +10,7 @@
 
 #import <Foundation/Foundation.h>
 
+#import "FBSDKModelGraph.hpp"
 #import "FBSDKTensor.hpp"
 
 NS_ASSUME_NONNULL_BEGIN
@@ -17,7 +18,16 @@ NS_ASSUME_NONNULL_BEGIN
 NS_SWIFT_NAME(ModelParser)
 @interface FBSDKModelParser : NSObject
 
+// Parses weights in either the binary container format (see FBSDKModelWeights.hpp) or the legacy
+// format of a JSON header of shapes followed by the floats in sorted key order.
 + (std::unordered_map<std::string, fbsdk::MTensor>)parseWeightsData:(NSData *)weightsData;
++ (BOOL)isWeightsContainer:(NSData *)weightsData;
+// fbsdk::MWeightsFlag bits of a binary container, 0 for legacy weights.
++ (uint32_t)weightsFlags:(NSData *)weightsData;
+// Reads the op graph of a binary container into graph, returns NO if it does not ship one.
++ (BOOL)parseOpGraph:(NSData *)weightsData graph:(fbsdk::MOpGraph &)graph;
+// Returns the legacy weightsData as a binary container, or nil if it is not valid legacy weights.
++ (nullable NSData *)convertLegacyWeightsData:(NSData *)weightsData;
 + (bool)validateWeights:(std::unordered_map<std::string, fbsdk::MTensor>)weights forKey:(NSString *)key;
 
 @end
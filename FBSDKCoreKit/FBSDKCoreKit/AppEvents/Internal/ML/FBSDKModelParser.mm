@@ -13,9 +13,18 @@
 #import <FBSDKCoreKit_Basics/FBSDKCoreKit_Basics.h>
 
 #import "FBSDKMLMacros.h"
+#import "FBSDKModelWeights.hpp"
 
 NS_ASSUME_NONNULL_BEGIN
 
+// Owner for tensors that point into data, which is usually memory mapped
+static std::shared_ptr<void> FBSDKRetainedData(NSData *data)
+{
+  return std::shared_ptr<void>(const_cast<void *>(CFBridgingRetain(data)), [](void *ptr) {
+    CFRelease(ptr);
+  });
+}
+
 @implementation FBSDKModelParser
 
 + (std::unordered_map<std::string, fbsdk::MTensor>)parseWeightsData:(NSData *)weightsData
@@ -28,6 +37,11 @@ NS_ASSUME_NONNULL_BEGIN
   const void *data = weightsData.bytes;
   NSUInteger totalLength = weightsData.length;
 
+  if (fbsdk::MIsWeightsContainer(data, totalLength)) {
+    fbsdk::MParseWeights(data, totalLength, FBSDKRetainedData(weightsData), weights);
+    return weights;
+  }
+
   if (totalLength < 4) {
     // Make sure data length is valid
     return weights;
@@ -48,8 +62,18 @@ NS_ASSUME_NONNULL_BEGIN
       return [key1 compare:key2];
     }];
 
+    // Tensors point into weightsData, which is usually memory mapped, and keep it alive. If the float
+    // payload is not aligned for float access, it is copied once into a single aligned buffer.
+    std::shared_ptr<void> owner = FBSDKRetainedData(weightsData);
+    const char *floats = json + length;
+    if (reinterpret_cast<uintptr_t>(floats) % alignof(float) != 0) {
+      const size_t payloadLength = totalLength - 4 - (NSUInteger)length;
+      owner = std::shared_ptr<void>(fbsdk::MAllocateMemory(payloadLength), fbsdk::MFreeMemory);
+      memcpy(owner.get(), floats, payloadLength);
+      floats = (const char *)owner.get();
+    }
+
     int totalFloats = 0;
-    float *floats = (float *)(json + length);
     NSDictionary<NSString *, NSString *> *keysMapping = [self getKeysMapping];
     for (NSString *key in keys) {
       NSString *finalKey = key;
@@ -59,8 +83,12 @@ NS_ASSUME_NONNULL_BEGIN
       }
       std::string s_name([finalKey UTF8String]);
 
-      std::vector<int> v_shape;
+      fbsdk::MShape v_shape;
       NSArray<NSString *> *shape = [FBSDKTypeUtility dictionary:info objectForKey:key ofType:NSObject.class];
+      if ((int)shape.count > fbsdk::MShape::kMaxRank) {
+        // Tensors of higher rank are not supported
+        break;
+      }
       int count = 1;
       for (NSNumber *_s in shape) {
         int i = [_s intValue];
@@ -74,9 +102,8 @@ NS_ASSUME_NONNULL_BEGIN
         // Make sure data length is valid
         break;
       }
-      fbsdk::MTensor tensor(v_shape);
-      memcpy(tensor.mutable_data(), floats, sizeof(float) * count);
-      floats += count;
+      fbsdk::MTensor tensor = fbsdk::MTensor::Borrow(v_shape, floats, owner);
+      floats += sizeof(float) * count;
 
       weights[s_name] = tensor;
     }
@@ -85,6 +112,42 @@ NS_ASSUME_NONNULL_BEGIN
   return weights;
 }
 
++ (BOOL)isWeightsContainer:(NSData *)weightsData
+{
+  return fbsdk::MIsWeightsContainer(weightsData.bytes, weightsData.length);
+}
+
++ (uint32_t)weightsFlags:(NSData *)weightsData
+{
+  return fbsdk::MGetWeightsFlags(weightsData.bytes, weightsData.length);
+}
+
++ (BOOL)parseOpGraph:(NSData *)weightsData graph:(fbsdk::MOpGraph &)graph
+{
+  std::vector<char> section;
+  if (!fbsdk::MFindWeightsSection(weightsData.bytes, weightsData.length, fbsdk::kOpGraphSection, section)) {
+    graph = fbsdk::MOpGraph();
+    return NO;
+  }
+  return fbsdk::MParseOpGraph(section, graph);
+}
+
++ (nullable NSData *)convertLegacyWeightsData:(NSData *)weightsData
+{
+  if ([self isWeightsContainer:weightsData]) {
+    return nil;
+  }
+  const std::unordered_map<std::string, fbsdk::MTensor> &weights = [self parseWeightsData:weightsData];
+  if (weights.empty()) {
+    return nil;
+  }
+  const std::vector<char> &container = fbsdk::MSerializeWeights(weights);
+  if (container.empty()) {
+    return nil;
+  }
+  return [NSData dataWithBytes:container.data() length:container.size()];
+}
+
 + (bool)validateWeights:(std::unordered_map<std::string, fbsdk::MTensor>)weights forKey:(NSString *)key
 {
   NSMutableDictionary<NSString *, NSArray<NSNumber *> *> *weightsInfoDict = [NSMutableDictionary new];
@@ -142,7 +205,7 @@ NS_ASSUME_NONNULL_BEGIN
         return false;
       }
       fbsdk::MTensor tensor = weights[std::string([key UTF8String])];
-      const std::vector<int> &actualSize = tensor.sizes();
+      const fbsdk::MShape &actualSize = tensor.sizes();
       NSArray<NSNumber *> *expectedSize = weightsInfoDict[key];
       if (actualSize.size() != expectedSize.count) {
         return false;
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef FBSDKModelProfiler_hpp
+#define FBSDKModelProfiler_hpp
+
+#if !TARGET_OS_TV
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Set to 1 to build the profiling hooks of the model runtime: every stage of a prediction run with an
+// MTMLInferenceOptions::profiler is timed and its allocations counted. When 0 the hooks compile to nothing.
+#ifndef FBSDK_ML_PROFILING
+ #define FBSDK_ML_PROFILING 0
+#endif
+
+namespace fbsdk {
+  // Heap allocations made through MAllocateMemory, counted per thread when FBSDK_ML_PROFILING is set
+  struct MAllocationCounters {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+  };
+
+  static inline MAllocationCounters &MThreadAllocationCounters()
+  {
+    static thread_local MAllocationCounters counters;
+    return counters;
+  }
+
+  /*
+   Histogram of non-negative values in power of two buckets: bucket 0 holds 0 and bucket b the values in
+   [2^(b - 1), 2^b). Count, sum, min and max are exact, percentiles are bucket upper bounds.
+   */
+  class MHistogram {
+  public:
+    enum { kBucketCount = 65 };
+
+    static int BucketOf(uint64_t value)
+    {
+      int bucket = 0;
+      while (value != 0) {
+        value >>= 1;
+        bucket++;
+      }
+      return bucket;
+    }
+
+    void Add(uint64_t value)
+    {
+      buckets_[BucketOf(value)]++;
+      min_ = count_ == 0 ? value : std::min(min_, value);
+      max_ = std::max(max_, value);
+      sum_ += value;
+      count_++;
+    }
+
+    // Smallest bucket upper bound that at least a fraction q of the values fall under, capped by max()
+    uint64_t Percentile(double q) const
+    {
+      if (count_ == 0) {
+        return 0;
+      }
+      const double rank = std::max(q, 0.0) * (double)count_;
+      uint64_t seen = 0;
+      for (int b = 0; b < kBucketCount; b++) {
+        seen += buckets_[b];
+        if ((double)seen >= rank && seen > 0) {
+          const uint64_t upper = b == 0 ? 0 : (b >= 64 ? UINT64_MAX : ((uint64_t)1 << b) - 1);
+          return std::min(upper, max_);
+        }
+      }
+      return max_;
+    }
+
+    uint64_t count() const
+    {
+      return count_;
+    }
+
+    uint64_t sum() const
+    {
+      return sum_;
+    }
+
+    uint64_t min() const
+    {
+      return min_;
+    }
+
+    uint64_t max() const
+    {
+      return max_;
+    }
+
+    double mean() const
+    {
+      return count_ > 0 ? (double)sum_ / (double)count_ : 0;
+    }
+
+    uint64_t bucket(int b) const
+    {
+      return buckets_[b];
+    }
+
+  private:
+    uint64_t buckets_[kBucketCount] = {};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = 0;
+    uint64_t max_ = 0;
+  };
+
+  // Aggregate of every run of one stage, e.g. "conv1"; allocations and bytes include nested stages
+  struct MStageProfile {
+    std::string name;
+    MHistogram ns;
+    MHistogram allocations;
+    MHistogram bytes;
+  };
+
+  /*
+   Collects the stages of the predictions it is passed to, from any number of threads: a histogram of the
+   duration and the allocations of each stage, a histogram of the input lengths, and up to
+   max_trace_events trace events, which ChromeTraceJSON() exports for chrome://tracing or Perfetto.
+   Stage names are string literals.
+   */
+  class MModelProfiler {
+  public:
+    explicit MModelProfiler(size_t max_trace_events = 100000) :
+      epoch_(std::chrono::steady_clock::now()),
+      max_trace_events_(max_trace_events) {};
+
+    // Nanoseconds since the profiler was created
+    uint64_t Now() const
+    {
+      return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+    }
+
+    // n_texts and max_length describe the inputs of a whole prediction, they are -1 for the other stages
+    void Record(const char *stage, uint64_t start_ns, uint64_t end_ns, const MAllocationCounters &allocated, int n_texts = -1, int max_length = -1)
+    {
+      const uint64_t ns = end_ns > start_ns ? end_ns - start_ns : 0;
+      std::lock_guard<std::mutex> lock(mutex_);
+      MStageProfile &profile = StageLocked(stage);
+      profile.ns.Add(ns);
+      profile.allocations.Add(allocated.allocations);
+      profile.bytes.Add(allocated.bytes);
+      if (events_.size() < max_trace_events_) {
+        events_.push_back({stage, start_ns, ns, ThreadLocked(), allocated, n_texts, max_length});
+      } else {
+        dropped_events_++;
+      }
+    }
+
+    // Adds the length of every text, up to max_length bytes, to the input length histogram
+    void RecordInputs(const std::vector<const char *> &texts, int max_length)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const char *text : texts) {
+        input_lengths_.Add(strnlen(text, (size_t)max_length));
+      }
+    }
+
+    // Copy of the profile of every stage seen so far, in the order they first ran
+    std::vector<MStageProfile> Stages() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return stages_;
+    }
+
+    // Copy of the profile of stage, or an empty one if it has not run
+    MStageProfile Stage(const char *stage) const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const MStageProfile &profile : stages_) {
+        if (profile.name == stage) {
+          return profile;
+        }
+      }
+      MStageProfile profile;
+      profile.name = stage;
+      return profile;
+    }
+
+    MHistogram InputLengths() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return input_lengths_;
+    }
+
+    // Trace events that did not fit in max_trace_events; their stages are still in the histograms
+    uint64_t dropped_trace_events() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return dropped_events_;
+    }
+
+    // The trace events as complete ("X") events of the Chrome trace event format
+    std::string ChromeTraceJSON() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+      char buffer[256];
+      for (size_t i = 0; i < events_.size(); i++) {
+        const TraceEvent &event = events_[i];
+        json += i == 0 ? "\n" : ",\n";
+        json += "{\"name\":\"";
+        AppendEscaped(json, event.stage);
+        snprintf(buffer, sizeof(buffer), "\",\"cat\":\"mtml\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                 "\"args\":{\"allocations\":%llu,\"bytes\":%llu",
+                 event.thread, (double)event.start_ns / 1000, (double)event.ns / 1000,
+                 (unsigned long long)event.allocated.allocations, (unsigned long long)event.allocated.bytes);
+        json += buffer;
+        if (event.n_texts >= 0) {
+          snprintf(buffer, sizeof(buffer), ",\"texts\":%d,\"max_length\":%d", event.n_texts, event.max_length);
+          json += buffer;
+        }
+        json += "}}";
+      }
+      json += "\n]}\n";
+      return json;
+    }
+
+    void Reset()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stages_.clear();
+      input_lengths_ = MHistogram();
+      events_.clear();
+      dropped_events_ = 0;
+    }
+
+  private:
+    struct TraceEvent {
+      const char *stage;
+      uint64_t start_ns;
+      uint64_t ns;
+      int thread;
+      MAllocationCounters allocated;
+      int n_texts;
+      int max_length;
+    };
+
+    MStageProfile &StageLocked(const char *stage)
+    {
+      for (MStageProfile &profile : stages_) {
+        if (profile.name == stage) {
+          return profile;
+        }
+      }
+      stages_.push_back(MStageProfile());
+      stages_.back().name = stage;
+      return stages_.back();
+    }
+
+    // Small id of the calling thread, for the tid of its trace events
+    int ThreadLocked()
+    {
+      const std::thread::id id = std::this_thread::get_id();
+      for (size_t i = 0; i < threads_.size(); i++) {
+        if (threads_[i] == id) {
+          return (int)i + 1;
+        }
+      }
+      threads_.push_back(id);
+      return (int)threads_.size();
+    }
+
+    static void AppendEscaped(std::string &json, const char *s)
+    {
+      for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+          json += '\\';
+        }
+        json += *s;
+      }
+    }
+
+    std::chrono::steady_clock::time_point epoch_;
+    size_t max_trace_events_;
+    std::vector<MStageProfile> stages_;
+    MHistogram input_lengths_;
+    std::vector<TraceEvent> events_;
+    uint64_t dropped_events_ = 0;
+    std::vector<std::thread::id> threads_;
+    mutable std::mutex mutex_;
+  };
+
+  /*
+   Times the enclosing scope as stage of profiler and counts the allocations made on this thread meanwhile.
+   Does nothing when profiler is null. Use it through FBSDK_ML_PROFILE_SCOPE, which compiles it out.
+   */
+  class MProfileScope {
+  public:
+    MProfileScope(MModelProfiler *profiler, const char *stage) :
+      profiler_(profiler),
+      stage_(stage)
+    {
+      if (profiler_) {
+        allocated_ = MThreadAllocationCounters();
+        start_ns_ = profiler_->Now();
+      }
+    }
+
+    // A whole prediction, which also records the input lengths
+    MProfileScope(MModelProfiler *profiler, const char *stage, const std::vector<const char *> &texts, int max_length) :
+      MProfileScope(profiler, stage)
+    {
+      if (profiler_) {
+        n_texts_ = (int)texts.size();
+        for (const char *text : texts) {
+          max_length_ = std::max(max_length_, (int)strnlen(text, (size_t)max_length));
+        }
+        profiler_->RecordInputs(texts, max_length);
+        // keep the bookkeeping out of the timing
+        start_ns_ = profiler_->Now();
+      }
+    }
+
+    ~MProfileScope()
+    {
+      if (profiler_) {
+        const uint64_t end_ns = profiler_->Now();
+        const MAllocationCounters &counters = MThreadAllocationCounters();
+        MAllocationCounters allocated;
+        allocated.allocations = counters.allocations - allocated_.allocations;
+        allocated.bytes = counters.bytes - allocated_.bytes;
+        profiler_->Record(stage_, start_ns_, end_ns, allocated, n_texts_, n_texts_ >= 0 ? max_length_ : -1);
+      }
+    }
+
+    MProfileScope(const MProfileScope &) = delete;
+    MProfileScope &operator=(const MProfileScope &) = delete;
+
+  private:
+    MModelProfiler *profiler_;
+    const char *stage_;
+    uint64_t start_ns_ = 0;
+    MAllocationCounters allocated_;
+    int n_texts_ = -1;
+    int max_length_ = 0;
+  };
+
+#if FBSDK_ML_PROFILING
+  // Profiler of every prediction FBSDKModelManager makes, defined in FBSDKModelManager.mm
+  MModelProfiler &MModelManagerProfiler();
+#endif
+}
+
+#define FBSDK_ML_PROFILE_CONCAT_(a, b) a##b
+#define FBSDK_ML_PROFILE_CONCAT(a, b) FBSDK_ML_PROFILE_CONCAT_(a, b)
+
+#if FBSDK_ML_PROFILING
+ // Profiles the rest of the enclosing scope as stage, a string literal, if profiler is not null
+ #define FBSDK_ML_PROFILE_SCOPE(profiler, stage) \
+  fbsdk::MProfileScope FBSDK_ML_PROFILE_CONCAT(fbsdk_profile_scope_, __LINE__)((profiler), (stage))
+ // Profiles the rest of the enclosing scope as a prediction over texts of up to max_length bytes
+ #define FBSDK_ML_PROFILE_PREDICTION(profiler, texts, max_length) \
+  fbsdk::MProfileScope FBSDK_ML_PROFILE_CONCAT(fbsdk_profile_scope_, __LINE__)((profiler), "prediction", (texts), (max_length))
+ #define FBSDK_ML_PROFILE_ALLOCATION(nbytes) \
+  do { \
+    fbsdk::MAllocationCounters &fbsdk_counters = fbsdk::MThreadAllocationCounters(); \
+    fbsdk_counters.allocations++; \
+    fbsdk_counters.bytes += (nbytes); \
+  } while (0)
+#else
+ #define FBSDK_ML_PROFILE_SCOPE(profiler, stage) (void)(profiler)
+ #define FBSDK_ML_PROFILE_PREDICTION(profiler, texts, max_length) (void)(profiler)
+ #define FBSDK_ML_PROFILE_ALLOCATION(nbytes) do {} while (0)
+#endif
+
+#endif
+
+#endif /* FBSDKModelProfiler_hpp */
@@ -6,34 +6,41 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#ifndef FBSDKModelRuntime_hpp
+#define FBSDKModelRuntime_hpp
+
 #if !TARGET_OS_TV
 
+#include <algorithm>
 #include <unordered_map>
 
 #include <float.h>
 #include <math.h>
 #include <stdint.h>
 
-#import <Accelerate/Accelerate.h>
-
+#include "FBSDKModelKernels.hpp"
 #include "FBSDKTensor.hpp"
 
 #define SEQ_LEN 128
 #define DENSE_FEATURE_LEN 30
 
+// Set to 1 to quantize the MTML model when it is loaded and run its tasks with int8 weights and
+// activations. Only for a model whose classes were checked against fp32 on a real corpus with the
+// --accuracy_corpus mode of run_model_benchmarks.sh (see countQuantizedMismatches).
+#ifndef FBSDK_ML_QUANTIZED_INFERENCE
+ #define FBSDK_ML_QUANTIZED_INFERENCE 0
+#endif
+
 namespace fbsdk {
   static void relu(MTensor &x)
   {
-    float min = 0;
-    float max = FLT_MAX;
-    float *x_data = x.mutable_data();
-    vDSP_vclip(x_data, 1, &min, &max, x_data, 1, x.count());
+    kernels::relu(x.mutable_data(), x.count());
   }
 
   static void flatten(MTensor &x, int start_dim)
   {
-    const std::vector<int> &shape = x.sizes();
-    std::vector<int> new_shape;
+    const MShape &shape = x.sizes();
+    MShape new_shape;
     for (int i = 0; i < start_dim; i++) {
       new_shape.push_back(shape[i]);
     }
@@ -45,16 +52,16 @@ namespace fbsdk {
     x.Reshape(new_shape);
   }
 
-  static MTensor concatenate(std::vector<MTensor *> &tensors)
+  static MTensor concatenate(MTensor *const *tensors, const int n_tensors, MTensorArena *arena = nullptr)
   {
     int n_examples = tensors[0]->size(0);
     int count = 0;
-    for (int i = 0; i < tensors.size(); i++) {
+    for (int i = 0; i < n_tensors; i++) {
       count += tensors[i]->size(1);
     }
-    MTensor y({n_examples, count});
+    MTensor y = MAllocateTensor({n_examples, count}, arena);
     float *y_data = y.mutable_data();
-    for (int i = 0; i < tensors.size(); i++) {
+    for (int i = 0; i < n_tensors; i++) {
       int this_count = (int)tensors[i]->size(1);
       const float *this_data = tensors[i]->data();
       for (int n = 0; n < n_examples; n++) {
@@ -65,81 +72,247 @@ namespace fbsdk {
     return y;
   }
 
+  static inline MTensor concatenate(std::vector<MTensor *> &tensors)
+  {
+    return concatenate(tensors.data(), (int)tensors.size());
+  }
+
   static void softmax(MTensor &x)
   {
     int n_examples = x.size(0);
     int n_channel = x.size(1);
     float *x_data = x.mutable_data();
-    float max;
-    float sum;
     for (int n = 0; n < n_examples; n++) {
-      vDSP_maxv(x_data, 1, &max, n_channel);
-      max = -max;
-      vDSP_vsadd(x_data, 1, &max, x_data, 1, n_channel);
-      vvexpf(x_data, x_data, &n_channel);
-      vDSP_sve(x_data, 1, &sum, n_channel);
-      vDSP_vsdiv(x_data, 1, &sum, x_data, 1, n_channel);
+      kernels::softmax(x_data, n_channel);
       x_data += n_channel;
     }
   }
 
-  static std::vector<int> vectorize(const char *texts, const int seq_length)
+  /*
+   return shape: texts.size(), seq_length, embedding_size
+   */
+  static MTensor embedding(const std::vector<const char *> &texts, const int seq_length, const MTensor &w, MTensorArena *arena = nullptr)
   {
-    int str_len = (int)strlen(texts);
-    std::vector<int> vec(seq_length, 0);
-    for (int i = 0; i < seq_length; i++) {
-      if (i < str_len) {
-        vec[i] = static_cast<unsigned char>(texts[i]);
+    int n_examples = (int)texts.size();
+    int embedding_size = w.size(1);
+    MTensor y = MAllocateTensor({n_examples, seq_length, embedding_size}, arena);
+    const float *w_data = w.data();
+    float *y_data = y.mutable_data();
+    for (int i = 0; i < n_examples; i++) {
+      // byte tokens, padded with 0 past the end of the text
+      const unsigned char *text = reinterpret_cast<const unsigned char *>(texts[i]);
+      int str_len = (int)strlen(texts[i]);
+      for (int j = 0; j < seq_length; j++) {
+        int index = j < str_len ? text[j] : 0;
+        memcpy(y_data, w_data + index * embedding_size, (size_t)(embedding_size * sizeof(float)));
+        y_data += embedding_size;
       }
     }
-    return vec;
+    return y;
+  }
+
+  // y[0..n) = w.data()[offset..offset + n) widened to float
+  static void widen(const MHalfTensor &w, int offset, float *y, int n)
+  {
+    if (w.type() == kHalfBFloat16) {
+      kernels::widen<kernels::WeightsBF16>(w.data() + offset, y, n);
+    } else {
+      kernels::widen<kernels::WeightsF16>(w.data() + offset, y, n);
+    }
+  }
+
+  static MHalfTensor toHalfPrecision(const MTensor &x, MHalfType type)
+  {
+    MHalfTensor y(x.sizes(), type);
+    const float *x_data = x.data();
+    uint16_t *y_data = y.mutable_data();
+    for (int i = 0; i < x.count(); i++) {
+      y_data[i] = type == kHalfBFloat16 ? kernels::fp32_to_bf16(x_data[i]) : kernels::fp32_to_fp16(x_data[i]);
+    }
+    return y;
   }
 
-  static MTensor embedding(const char *texts, const int seq_length, const MTensor &w)
+  static MTensor toFloat(const MHalfTensor &x)
   {
-    // TODO: T65152708 support batch prediction
-    const std::vector<int> &vec = vectorize(texts, seq_length);
-    int n_examples = 1;
+    MTensor y(x.sizes());
+    widen(x, 0, y.mutable_data(), x.count());
+    return y;
+  }
+
+  /*
+   Half precision variant of embedding, the looked up rows are widened to float.
+   return shape: texts.size(), seq_length, embedding_size
+   */
+  static MTensor embedding(const std::vector<const char *> &texts, const int seq_length, const MHalfTensor &w, MTensorArena *arena = nullptr)
+  {
+    int n_examples = (int)texts.size();
     int embedding_size = w.size(1);
-    MTensor y({n_examples, seq_length, embedding_size});
-    const float *w_data = w.data();
+    MTensor y = MAllocateTensor({n_examples, seq_length, embedding_size}, arena);
     float *y_data = y.mutable_data();
     for (int i = 0; i < n_examples; i++) {
+      const unsigned char *text = reinterpret_cast<const unsigned char *>(texts[i]);
+      int str_len = (int)strlen(texts[i]);
       for (int j = 0; j < seq_length; j++) {
-        memcpy(y_data, w_data + vec[i * seq_length + j] * embedding_size, (size_t)(embedding_size * sizeof(float)));
+        int index = j < str_len ? text[j] : 0;
+        widen(w, index * embedding_size, y_data, embedding_size);
         y_data += embedding_size;
       }
     }
     return y;
   }
 
+  /*
+   conv1D of every possible token against the weight of the first conv, so that the conv of an embedded
+   text becomes a lookup and add of kernel_size table rows per output position:
+   table[k][v][c] = sum_i embed[v][i] * w[k][i][c]
+   embed shape: vocab_size, embedding_size
+   w shape: kernel_size, embedding_size, output_size
+   return shape: kernel_size, vocab_size, output_size
+   */
+  static MTensor embeddingConvTable(const MTensor &embed, const MTensor &w)
+  {
+    int vocab_size = embed.size(0);
+    int embedding_size = embed.size(1);
+    int kernel_size = w.size(0);
+    int output_size = w.size(2);
+    MTensor table({kernel_size, vocab_size, output_size});
+    for (int k = 0; k < kernel_size; k++) {
+      kernels::gemm(
+        embed.data(),
+        w.data() + k * (embedding_size * output_size),
+        table.mutable_data() + k * (vocab_size * output_size),
+        vocab_size,
+        output_size,
+        embedding_size
+      );
+    }
+    return table;
+  }
+
+  /*
+   conv1DBiasReLU(embedding(texts, seq_length, embed), w, b) computed from table = embeddingConvTable(embed, w)
+   without materializing the embedding. Matches the unfused result up to float rounding.
+   table shape: kernel_size, vocab_size, output_size
+   return shape: texts.size(), seq_length - kernel_size + 1, output_size
+   */
+  static MTensor embeddingConv1DBiasReLU(const std::vector<const char *> &texts, const int seq_length, const MTensor &table, const MTensor &b, MTensorArena *arena = nullptr)
+  {
+    int n_examples = (int)texts.size();
+    int kernel_size = table.size(0);
+    int vocab_size = table.size(1);
+    int output_size = table.size(2);
+    int output_len = seq_length - kernel_size + 1;
+    if (output_len <= 0 || n_examples <= 0) {
+      return MTensor();
+    }
+    MTensor y = MAllocateTensor({n_examples, output_len, output_size}, arena);
+    const float *table_data = table.data();
+    float *y_data = y.mutable_data();
+    for (int i = 0; i < n_examples; i++) {
+      // byte tokens, padded with 0 past the end of the text
+      const unsigned char *text = reinterpret_cast<const unsigned char *>(texts[i]);
+      int str_len = (int)strlen(texts[i]);
+      for (int t = 0; t < output_len; t++) {
+        memcpy(y_data, b.data(), (size_t)output_size * sizeof(float));
+        for (int k = 0; k < kernel_size; k++) {
+          int index = t + k < str_len ? text[t + k] : 0;
+          kernels::add_into(table_data + (k * vocab_size + index) * output_size, y_data, output_size);
+        }
+        kernels::relu(y_data, output_size);
+        y_data += output_size;
+      }
+    }
+    return y;
+  }
+
+  static inline MTensor embedding(const char *texts, const int seq_length, const MTensor &w)
+  {
+    return embedding(std::vector<const char *> { texts }, seq_length, w);
+  }
+
   /*
    x shape: n_examples, in_vector_size
    w shape: in_vector_size, out_vector_size
    b shape: out_vector_size
    return shape: n_examples, out_vector_size
+   kernel may be the kernels::dense specialized for the shape of w.
    */
-  static MTensor dense(const MTensor &x, const MTensor &w, const MTensor &b)
+  static MTensor dense(const MTensor &x, const MTensor &w, const MTensor &b, MTensorArena *arena = nullptr, kernels::DenseKernel kernel = kernels::dense)
   {
     int n_examples = x.size(0);
     int in_vector_size = x.size(1);
     int out_vector_size = w.size(1);
-    MTensor y({n_examples, out_vector_size});
+    MTensor y = MAllocateTensor({n_examples, out_vector_size}, arena);
+    const kernels::GemmEpilogue epilogue = {b.data(), false, 1};
+    kernel(x.data(), w.data(), y.mutable_data(), n_examples, in_vector_size, out_vector_size, epilogue);
+    return y;
+  }
+
+  // Whether conv1DGemm stacks the examples of x along M, see kernels::gemm_stacks_conv_rows
+  static inline bool conv1DStacksExamples(const MTensor &x, const int kernel_size)
+  {
+    return x.size(0) > 1 && kernels::gemm_stacks_conv_rows(x.size(1) - kernel_size + 1, kernel_size);
+  }
+
+  /*
+   The output of conv1DGemm, with room for the rows it computes. Allocated before anything else a conv
+   allocates, so that it takes the place the arena planned for it.
+   */
+  static MTensor allocateConv1DOutput(const MTensor &x, const int kernel_size, const int output_size, const int pool_size, MTensorArena *arena)
+  {
+    const int n_examples = x.size(0);
+    const int seq_len = x.size(1);
+    if (conv1DStacksExamples(x, kernel_size)) {
+      return MAllocateTensor({n_examples * seq_len - kernel_size - pool_size + 2, output_size}, arena);
+    }
+    return MAllocateTensor({n_examples, seq_len - kernel_size - pool_size + 2, output_size}, arena);
+  }
+
+  /*
+   The implicit GEMM of a conv over every example of x: the kernel_size * input_size window of output
+   position i starts at row i of x and is contiguous, so x is used in place as the im2col matrix with a row
+   stride of input_size. gemm(row, m, c) computes m conv positions, pooled by its epilogue, from the rows
+   of x that start at row into c.
+
+   If conv1DStacksExamples, the examples are stacked along M into a single gemm over the
+   (n_examples * seq_len, input_size) matrix x; output position i of example n is then row n * seq_len + i.
+   The kernel_size - 1 rows of each example whose windows run into the next one are computed too and
+   dropped afterwards. Otherwise each example is a gemm of its own.
+   y: from allocateConv1DOutput
+   y shape after: n_examples, seq_len - kernel_size - pool_size + 2, output_size
+   */
+  template <typename Gemm>
+  static void conv1DGemm(const MTensor &x, const int kernel_size, const int pool_size, MTensor &y, const Gemm &gemm)
+  {
+    const int n_examples = x.size(0);
+    const int seq_len = x.size(1);
+    const int output_size = y.size(y.sizes().size() - 1);
+    const int conv_len = seq_len - kernel_size + 1;
+    const int output_len = conv_len - pool_size + 1;
     float *y_data = y.mutable_data();
-    const float *b_data = b.data();
-    vDSP_mmul(x.data(), 1, w.data(), 1, y_data, 1, n_examples, out_vector_size, in_vector_size);
-    for (int i = 0; i < out_vector_size; i++) {
-      vDSP_vsadd(y_data + i, out_vector_size, b_data + i, y_data + i, out_vector_size, n_examples);
+    if (!conv1DStacksExamples(x, kernel_size)) {
+      for (int n = 0; n < n_examples; n++) {
+        gemm(n * seq_len, conv_len, y_data + n * (output_len * output_size));
+      }
+      return;
     }
-    return y;
+    gemm(0, n_examples * seq_len - kernel_size + 1, y_data);
+    // the examples start seq_len rows apart, output_len < seq_len so none is overwritten before it moves
+    for (int n = 1; n < n_examples; n++) {
+      memmove(y_data + n * (output_len * output_size), y_data + n * (seq_len * output_size), (size_t)output_len * output_size * sizeof(float));
+    }
+    y.Reshape({n_examples, output_len, output_size});
   }
 
   /*
    x shape: n_examples, seq_len, input_size
    w shape: kernel_size, input_size, output_size
    return shape: n_examples, seq_len - kernel_size + 1, output_size
+
+   Every example is an (output_len, kernel_size * input_size) x (kernel_size * input_size, output_size)
+   matrix multiply against w, see conv1DGemm.
    */
-  static MTensor conv1D(const MTensor &x, const MTensor &w)
+  static MTensor conv1D(const MTensor &x, const MTensor &w, MTensorArena *arena = nullptr)
   {
     int n_examples = x.size(0);
     int seq_len = x.size(1);
@@ -150,29 +323,339 @@ namespace fbsdk {
     if (output_len <= 0 || input_size <= 0 || output_size <= 0 || n_examples <= 0) {
       return MTensor();
     }
-    MTensor y({n_examples, output_len, output_size});
-    MTensor temp_x({kernel_size, input_size});
-    MTensor temp_w({kernel_size, input_size});
+    MTensor y = allocateConv1DOutput(x, kernel_size, output_size, 1, arena);
     const float *x_data = x.data();
     const float *w_data = w.data();
-    float *y_data = y.mutable_data();
-    float *temp_x_data = temp_x.mutable_data();
-    float *temp_w_data = temp_w.mutable_data();
-    float sum;
+    conv1DGemm(x, kernel_size, 1, y, [&](const int row, const int m, float *c) {
+      kernels::gemm(x_data + row * input_size, input_size, w_data, c, m, output_size, kernel_size * input_size);
+    });
+    return y;
+  }
+
+  /*
+   Fused conv1D + addmv + relu, followed by maxPool1D when pool_size > 1. The bias, activation and
+   pooling are applied to each output tile before it is written, so the conv output is never
+   materialized.
+   x shape: n_examples, seq_len, input_size
+   w shape: kernel_size, input_size, output_size
+   b shape: output_size
+   return shape: n_examples, seq_len - kernel_size - pool_size + 2, output_size
+   */
+  static MTensor conv1DBiasReLUMaxPool1D(const MTensor &x, const MTensor &w, const MTensor &b, const int pool_size, MTensorArena *arena = nullptr)
+  {
+    int n_examples = x.size(0);
+    int seq_len = x.size(1);
+    int input_size = x.size(2);
+    int kernel_size = w.size(0);
+    int output_size = w.size(2);
+    int conv_len = seq_len - kernel_size + 1;
+    int output_len = conv_len - pool_size + 1;
+    if (output_len <= 0 || pool_size <= 0 || input_size <= 0 || output_size <= 0 || n_examples <= 0) {
+      return MTensor();
+    }
+    MTensor y = allocateConv1DOutput(x, kernel_size, output_size, pool_size, arena);
+    const float *x_data = x.data();
+    const float *w_data = w.data();
+    const kernels::GemmEpilogue epilogue = {b.data(), true, pool_size};
+    conv1DGemm(x, kernel_size, pool_size, y, [&](const int row, const int m, float *c) {
+      kernels::gemm(x_data + row * input_size, input_size, w_data, c, m, output_size, kernel_size * input_size, epilogue);
+    });
+    return y;
+  }
+
+  static MTensor conv1DBiasReLU(const MTensor &x, const MTensor &w, const MTensor &b, MTensorArena *arena = nullptr)
+  {
+    return conv1DBiasReLUMaxPool1D(x, w, b, 1, arena);
+  }
+
+  /*
+   Per output channel int8 quantization of a weight in kernel layout, stored in the layout of kernels::gemm_s8.
+   w shape: ..., n
+   */
+  static MQuantizedTensor quantizePerChannel(const MTensor &w)
+  {
+    const int n = w.size(w.sizes().size() - 1);
+    if (n <= 0) {
+      return MQuantizedTensor();
+    }
+    const int k = w.count() / n;
+    MQuantizedTensor q(w.sizes(), std::shared_ptr<void>(MAllocateMemory(kernels::packed_s8_size(k, n)), MFreeMemory));
+    q.mutable_scales() = MTensor({n});
+    kernels::quantize_columns_s8(w.data(), k, n, q.mutable_data(), q.mutable_scales().mutable_data());
+    return q;
+  }
+
+  /*
+   int8 variant of conv1DBiasReLUMaxPool1D. Each example is quantized with its own scale, products are
+   accumulated in int32 and scaled back to float before the bias, relu and pooling.
+   x shape: n_examples, seq_len, input_size
+   w shape: kernel_size, input_size, output_size, quantized per output channel
+   return shape: n_examples, seq_len - kernel_size + 1 - pool_size + 1, output_size
+   */
+  static MTensor conv1DBiasReLUMaxPool1D(const MTensor &x, const MQuantizedTensor &w, const MTensor &b, const int pool_size, MTensorArena *arena = nullptr)
+  {
+    int n_examples = x.size(0);
+    int seq_len = x.size(1);
+    int input_size = x.size(2);
+    int kernel_size = w.size(0);
+    int output_size = w.size(2);
+    int conv_len = seq_len - kernel_size + 1;
+    int output_len = conv_len - pool_size + 1;
+    if (output_len <= 0 || pool_size <= 0 || input_size <= 0 || output_size <= 0 || n_examples <= 0) {
+      return MTensor();
+    }
+    MTensor y = allocateConv1DOutput(x, kernel_size, output_size, pool_size, arena);
+    MQuantizedTensor x_q = MAllocateQuantizedTensor({n_examples * seq_len, input_size}, arena);
+    // the scale of every row of x, i.e. of the example it belongs to
+    MTensor x_scales = MAllocateTensor({n_examples * seq_len}, arena);
+    const float *x_data = x.data();
+    float *x_scales_data = x_scales.mutable_data();
+    for (int n = 0; n < n_examples; n++) {
+      const int offset = n * (seq_len * input_size);
+      const float x_scale = kernels::quantize_s8(x_data + offset, seq_len * input_size, x_q.mutable_data() + offset);
+      std::fill(x_scales_data + n * seq_len, x_scales_data + (n + 1) * seq_len, x_scale);
+    }
+    const kernels::GemmEpilogue epilogue = {b.data(), true, pool_size};
+    conv1DGemm(x, kernel_size, pool_size, y, [&](const int row, const int m, float *c) {
+      kernels::gemm_s8(x_q.data() + row * input_size, input_size, x_scales_data + row, 1, w.data(), w.scales().data(), c, m, output_size, kernel_size * input_size, epilogue);
+    });
+    return y;
+  }
+
+  static MTensor conv1DBiasReLU(const MTensor &x, const MQuantizedTensor &w, const MTensor &b, MTensorArena *arena = nullptr)
+  {
+    return conv1DBiasReLUMaxPool1D(x, w, b, 1, arena);
+  }
+
+  /*
+   int8 variant of dense, every example is quantized with its own scale and the batch goes through a single
+   gemm_s8.
+   x shape: n_examples, in_vector_size
+   w shape: in_vector_size, out_vector_size, quantized per output channel
+   */
+  static MTensor dense(const MTensor &x, const MQuantizedTensor &w, const MTensor &b, MTensorArena *arena = nullptr)
+  {
+    int n_examples = x.size(0);
+    int in_vector_size = x.size(1);
+    int out_vector_size = w.size(1);
+    MTensor y = MAllocateTensor({n_examples, out_vector_size}, arena);
+    MQuantizedTensor x_q = MAllocateQuantizedTensor({n_examples, in_vector_size}, arena);
+    MTensor x_scales = MAllocateTensor({n_examples}, arena);
+    float *x_scales_data = x_scales.mutable_data();
     for (int n = 0; n < n_examples; n++) {
-      for (int o = 0; o < output_size; o++) {
-        for (int i = 0; i < output_len; i++) {
-          for (int m = 0; m < kernel_size; m++) {
-            for (int k = 0; k < input_size; k++) {
-              temp_x_data[m * input_size + k] = x_data[n * (seq_len * input_size) + (m + i) * input_size + k];
-              temp_w_data[m * input_size + k] = w_data[(m * input_size + k) * output_size + o];
-            }
-          }
-          vDSP_dotpr(temp_x_data, 1, temp_w_data, 1, &sum, (size_t)(kernel_size * input_size));
-          y_data[(n * (output_size * output_len) + i * output_size + o)] = sum;
+      x_scales_data[n] = kernels::quantize_s8(x.data() + n * in_vector_size, in_vector_size, x_q.mutable_data() + n * in_vector_size);
+    }
+    const kernels::GemmEpilogue epilogue = {b.data(), false, 1};
+    kernels::gemm_s8(x_q.data(), in_vector_size, x_scales_data, 1, w.data(), w.scales().data(), y.mutable_data(), n_examples, out_vector_size, in_vector_size, epilogue);
+    return y;
+  }
+
+  static void gemm(const float *a, int lda, const MHalfTensor &b, float *c, int m, int n, int k, const kernels::GemmEpilogue &e)
+  {
+    if (b.type() == kHalfBFloat16) {
+      kernels::gemm_widening<kernels::WeightsBF16>(a, lda, b.data(), c, m, n, k, e);
+    } else {
+      kernels::gemm_widening<kernels::WeightsF16>(a, lda, b.data(), c, m, n, k, e);
+    }
+  }
+
+  /*
+   Half precision variant of conv1DBiasReLUMaxPool1D, bit-exact with it over toFloat(w).
+   w shape: kernel_size, input_size, output_size
+   */
+  static MTensor conv1DBiasReLUMaxPool1D(const MTensor &x, const MHalfTensor &w, const MTensor &b, const int pool_size, MTensorArena *arena = nullptr)
+  {
+    int n_examples = x.size(0);
+    int seq_len = x.size(1);
+    int input_size = x.size(2);
+    int kernel_size = w.size(0);
+    int output_size = w.size(2);
+    int conv_len = seq_len - kernel_size + 1;
+    int output_len = conv_len - pool_size + 1;
+    if (output_len <= 0 || pool_size <= 0 || input_size <= 0 || output_size <= 0 || n_examples <= 0) {
+      return MTensor();
+    }
+    MTensor y = allocateConv1DOutput(x, kernel_size, output_size, pool_size, arena);
+    const float *x_data = x.data();
+    const kernels::GemmEpilogue epilogue = {b.data(), true, pool_size};
+    conv1DGemm(x, kernel_size, pool_size, y, [&](const int row, const int m, float *c) {
+      gemm(x_data + row * input_size, input_size, w, c, m, output_size, kernel_size * input_size, epilogue);
+    });
+    return y;
+  }
+
+  static MTensor conv1DBiasReLU(const MTensor &x, const MHalfTensor &w, const MTensor &b, MTensorArena *arena = nullptr)
+  {
+    return conv1DBiasReLUMaxPool1D(x, w, b, 1, arena);
+  }
+
+  /*
+   Half precision variant of dense, bit-exact with it over toFloat(w).
+   w shape: in_vector_size, out_vector_size
+   */
+  static MTensor dense(const MTensor &x, const MHalfTensor &w, const MTensor &b, MTensorArena *arena = nullptr)
+  {
+    int n_examples = x.size(0);
+    int in_vector_size = x.size(1);
+    int out_vector_size = w.size(1);
+    MTensor y = MAllocateTensor({n_examples, out_vector_size}, arena);
+    float *y_data = y.mutable_data();
+    gemm(x.data(), in_vector_size, w, y_data, n_examples, out_vector_size, in_vector_size, kernels::kNoEpilogue);
+    kernels::add_bias(y_data, b.data(), n_examples, out_vector_size);
+    return y;
+  }
+
+  // Blocks of block_size consecutive columns of w (rows, cols) that hold a nonzero weight
+  static int nonzeroBlocks(const MTensor &w, const int block_size)
+  {
+    const float *w_data = w.data();
+    int n_blocks = 0;
+    for (int i = 0; i < w.count(); i += block_size) {
+      for (int j = 0; j < block_size; j++) {
+        if (w_data[i + j] != 0) {
+          n_blocks++;
+          break;
+        }
+      }
+    }
+    return n_blocks;
+  }
+
+  // Fraction of the blocks of block_size consecutive columns of w (rows, cols) that hold a nonzero weight
+  static float blockDensity(const MTensor &w, const int block_size)
+  {
+    const int rows = w.size(0);
+    const int cols = w.size(1);
+    if (rows <= 0 || cols <= 0 || block_size <= 0 || cols % block_size != 0) {
+      return 1;
+    }
+    return (float)nonzeroBlocks(w, block_size) / (rows * cols / block_size);
+  }
+
+  /*
+   Block-sparse copy of w (rows, cols) with blocks of block_size columns, block_size 4 or 8. Empty if cols is
+   not a multiple of block_size.
+   */
+  static MBlockSparseTensor toBlockSparse(const MTensor &w, const int block_size)
+  {
+    const int rows = w.size(0);
+    const int cols = w.size(1);
+    if (rows <= 0 || cols <= 0 || (block_size != 4 && block_size != 8) || cols % block_size != 0) {
+      return MBlockSparseTensor();
+    }
+    MBlockSparseTensor y({rows, cols}, block_size, nonzeroBlocks(w, block_size));
+    const float *w_data = w.data();
+    int *row_offsets = y.mutable_row_offsets();
+    int *block_cols = y.mutable_block_cols();
+    float *values = y.mutable_values();
+    int q = 0;
+    for (int p = 0; p < rows; p++) {
+      row_offsets[p] = q;
+      for (int c = 0; c < cols; c += block_size) {
+        const float *block = w_data + p * cols + c;
+        bool nonzero = false;
+        for (int j = 0; j < block_size; j++) {
+          nonzero = nonzero || block[j] != 0;
+        }
+        if (nonzero) {
+          block_cols[q] = c;
+          memcpy(values + q * block_size, block, block_size * sizeof(float));
+          q++;
         }
       }
     }
+    row_offsets[rows] = q;
+    return y;
+  }
+
+  // Half precision copy of a float block-sparse x, sharing its block indices
+  static MBlockSparseTensor toHalfPrecision(const MBlockSparseTensor &x, MHalfType type)
+  {
+    MBlockSparseTensor y(x, type);
+    const float *x_values = x.values();
+    uint16_t *y_values = y.mutable_half_values();
+    for (int i = 0; i < x.count(); i++) {
+      y_values[i] = type == kHalfBFloat16 ? kernels::fp32_to_bf16(x_values[i]) : kernels::fp32_to_fp16(x_values[i]);
+    }
+    return y;
+  }
+
+  /*
+   quantizePerChannel of the dense weight whose nonzero blocks w holds, the int8 gemm has no block-sparse
+   variant.
+   w shape: in_vector_size, out_vector_size
+   */
+  static MQuantizedTensor quantizePerChannel(const MBlockSparseTensor &w)
+  {
+    const int cols = w.size(1);
+    const int block_size = w.block_size();
+    MTensor dense_weight({w.size(0), cols});
+    float *dense_data = dense_weight.mutable_data();
+    memset(dense_data, 0, (size_t)dense_weight.count() * sizeof(float));
+    for (int p = 0; p < w.size(0); p++) {
+      for (int q = w.row_offsets()[p]; q < w.row_offsets()[p + 1]; q++) {
+        float *dst = dense_data + p * cols + w.block_cols()[q];
+        if (!w.half_precision()) {
+          memcpy(dst, w.values() + q * block_size, block_size * sizeof(float));
+        } else if (w.type() == kHalfBFloat16) {
+          kernels::widen<kernels::WeightsBF16>(w.half_values() + q * block_size, dst, block_size);
+        } else {
+          kernels::widen<kernels::WeightsF16>(w.half_values() + q * block_size, dst, block_size);
+        }
+      }
+    }
+    return quantizePerChannel(dense_weight);
+  }
+
+  // Block densities up to which kernels::gemm_block_sparse beats the dense gemm on the fc layers, batched
+  // or not; blocks of 4 lose to the tiled gemm earlier
+  static const float kMaxBlockSparseDensity8 = 0.5;
+  static const float kMaxBlockSparseDensity4 = 0.25;
+
+  /*
+   Block-sparse copy of the weight of a dense layer if its measured block density makes it faster than
+   the dense gemm, else an empty tensor. Blocks of 8 columns are preferred, they take half the index loads.
+   w shape: in_vector_size, out_vector_size
+   */
+  static MBlockSparseTensor toBlockSparseIfFaster(const MTensor &w)
+  {
+    if (blockDensity(w, 8) <= kMaxBlockSparseDensity8) {
+      return toBlockSparse(w, 8);
+    }
+    if (blockDensity(w, 4) <= kMaxBlockSparseDensity4) {
+      return toBlockSparse(w, 4);
+    }
+    return MBlockSparseTensor();
+  }
+
+  template <int Block>
+  static void gemmBlockSparse(const MTensor &x, const MBlockSparseTensor &w, const MTensor &b, MTensor &y)
+  {
+    const int n_examples = x.size(0);
+    const int in_vector_size = x.size(1);
+    const int out_vector_size = w.size(1);
+    if (!w.half_precision()) {
+      kernels::gemm_block_sparse<Block>(x.data(), in_vector_size, w.row_offsets(), w.block_cols(), w.values(), b.data(), y.mutable_data(), n_examples, out_vector_size, in_vector_size);
+    } else if (w.type() == kHalfBFloat16) {
+      kernels::gemm_block_sparse<Block, kernels::WeightsBF16>(x.data(), in_vector_size, w.row_offsets(), w.block_cols(), w.half_values(), b.data(), y.mutable_data(), n_examples, out_vector_size, in_vector_size);
+    } else {
+      kernels::gemm_block_sparse<Block, kernels::WeightsF16>(x.data(), in_vector_size, w.row_offsets(), w.block_cols(), w.half_values(), b.data(), y.mutable_data(), n_examples, out_vector_size, in_vector_size);
+    }
+  }
+
+  /*
+   Block-sparse variant of dense, for pruned weights in float or half precision; equal to dense over the
+   dense weight up to rounding.
+   w shape: in_vector_size, out_vector_size
+   */
+  static MTensor dense(const MTensor &x, const MBlockSparseTensor &w, const MTensor &b, MTensorArena *arena = nullptr)
+  {
+    MTensor y = MAllocateTensor({x.size(0), w.size(1)}, arena);
+    if (w.block_size() == 8) {
+      gemmBlockSparse<8>(x, w, b, y);
+    } else {
+      gemmBlockSparse<4>(x, w, b, y);
+    }
     return y;
   }
 
@@ -180,27 +663,25 @@ namespace fbsdk {
    input shape: n_examples, len, n_channel
    return shape: n_examples, len - pool_size + 1, n_channel
    */
-  static MTensor maxPool1D(const MTensor &x, const int pool_size)
+  static MTensor maxPool1D(const MTensor &x, const int pool_size, MTensorArena *arena = nullptr)
   {
     int n_examples = x.size(0);
     int input_len = x.size(1);
     int n_channel = x.size(2);
     int output_len = input_len - pool_size + 1;
-    if (output_len <= 0 || n_channel <= 0 || n_examples <= 0) {
+    if (pool_size <= 0 || output_len <= 0 || n_channel <= 0 || n_examples <= 0) {
       return MTensor();
     }
-    MTensor y({n_examples, output_len, n_channel});
+    MTensor y = MAllocateTensor({n_examples, output_len, n_channel}, arena);
     const float *x_data = x.data();
     float *y_data = y.mutable_data();
     for (int n = 0; n < n_examples; n++) {
-      for (int c = 0; c < n_channel; c++) {
-        for (int i = 0; i < output_len; i++) {
-          float this_max = -FLT_MAX;
-          for (int r = i; r < i + pool_size; r++) {
-            this_max = fmax(this_max, x_data[n * (n_channel * input_len) + r * n_channel + c]);
-          }
-          y_data[n * (n_channel * output_len) + i * n_channel + c] = this_max;
-        }
+      const float *x_example = x_data + n * (n_channel * input_len);
+      float *y_example = y_data + n * (n_channel * output_len);
+      if (output_len == 1) {
+        kernels::max_rows(x_example, y_example, input_len, n_channel);
+      } else {
+        kernels::max_pool_rows(x_example, y_example, input_len, n_channel, pool_size);
       }
     }
     return y;
@@ -252,103 +733,807 @@ namespace fbsdk {
     int m = y.size(0);
     int n = y.size(1);
     int p = y.size(2);
-    float *y_data = y.mutable_data();
-    const float *x_data = x.data();
-    for (int i = 0; i < p; i++) {
-      vDSP_vsadd(y_data + i, p, x_data + i, y_data + i, p, m * n);
-    }
+    kernels::add_bias(y.mutable_data(), x.data(), m * n, p);
   }
 
-  static MTensor getDenseTensor(const float *df)
+  /*
+   df: n_examples rows of DENSE_FEATURE_LEN floats, or nullptr for all zeros
+   return shape: n_examples, DENSE_FEATURE_LEN
+   */
+  static MTensor getDenseTensor(const float *df, const int n_examples = 1, MTensorArena *arena = nullptr)
   {
-    MTensor dense_tensor({1, DENSE_FEATURE_LEN});
+    MTensor dense_tensor = MAllocateTensor({n_examples, DENSE_FEATURE_LEN}, arena);
     if (df) {
-      memcpy(dense_tensor.mutable_data(), df, DENSE_FEATURE_LEN * sizeof(float));
+      memcpy(dense_tensor.mutable_data(), df, (size_t)n_examples * DENSE_FEATURE_LEN * sizeof(float));
     } else {
-      memset(dense_tensor.mutable_data(), 0, DENSE_FEATURE_LEN * sizeof(float));
+      memset(dense_tensor.mutable_data(), 0, (size_t)n_examples * DENSE_FEATURE_LEN * sizeof(float));
     }
     return dense_tensor;
   }
 
-  static MTensor predictOnMTML(const std::string task, const char *texts, const std::unordered_map<std::string, MTensor> &weights, const float *df)
-  {
-    MTensor dense_tensor = getDenseTensor(df);
-    std::string final_layer_weight_key = task + ".weight";
-    std::string final_layer_bias_key = task + ".bias";
-
-    const MTensor &embed_t = weights.at("embed.weight");
-    const MTensor &conv0w_t = weights.at("convs.0.weight");
-    const MTensor &conv1w_t = weights.at("convs.1.weight");
-    const MTensor &conv2w_t = weights.at("convs.2.weight");
-    const MTensor &conv0b_t = weights.at("convs.0.bias");
-    const MTensor &conv1b_t = weights.at("convs.1.bias");
-    const MTensor &conv2b_t = weights.at("convs.2.bias");
-    const MTensor &fc1w_t = weights.at("fc1.weight"); // (128, 190)
-    const MTensor &fc1b_t = weights.at("fc1.bias"); // 128
-    const MTensor &fc2w_t = weights.at("fc2.weight"); // (64, 128)
-    const MTensor &fc2b_t = weights.at("fc2.bias"); // 64
-    const MTensor &final_layer_weight_t = weights.at(final_layer_weight_key); // (2, 64) or (5, 64)
-    const MTensor &final_layer_bias_t = weights.at(final_layer_bias_key); // 2 or 5
-
-    const MTensor &convs_0_weight = transpose3D(conv0w_t);
-    const MTensor &convs_1_weight = transpose3D(conv1w_t);
-    const MTensor &convs_2_weight = transpose3D(conv2w_t);
-    const MTensor &fc1_weight = transpose2D(fc1w_t);
-    const MTensor &fc2_weight = transpose2D(fc2w_t);
-    const MTensor &final_layer_weight = transpose2D(final_layer_weight_t);
-
-    // embedding
-    const MTensor &embed_x = embedding(texts, SEQ_LEN, embed_t);
-
-    // conv0
-    MTensor c0 = conv1D(embed_x, convs_0_weight); // (1, 126, 32)
+  /*
+   MTML weights rearranged once at load time into the layouts consumed by conv1D and dense,
+   so that inference does not have to transpose them on every call.
+   */
+  struct MTMLHead {
+    MTensor weight; // (64, n_class)
+    MTensor bias; // n_class
+  };
+
+  /*
+   Padding is token 0, so every conv output position whose receptive field lies entirely in the padding
+   has the same value. This is that value for each conv, i.e. what the padding contributes to its global
+   max pool.
+   */
+  struct MTMLPaddingSummary {
+    MTensor c0; // 32
+    MTensor c1; // 64
+    MTensor c2; // 64
+  };
+
+  // The intermediates of predictMTMLEmbedding, in the order they are written
+  enum MTMLBuffer {
+    kMTMLEmbedX,
+    kMTMLC0,
+    kMTMLCa,
+    kMTMLC1Unpooled, // unfused reference path only
+    kMTMLC1,
+    kMTMLCb,
+    kMTMLC2,
+    kMTMLCc,
+    kMTMLDenseFeatures,
+    kMTMLConcat,
+    kMTMLDense1,
+    kMTMLDense2,
+    kMTMLBufferCount,
+  };
+
+  struct PackedMTMLModel {
+    MTensor embed_weight; // (256, 32)
+    MTensor convs_0_weight; // (3, 32, 32)
+    MTensor convs_0_bias; // 32
+    MTensor convs_1_weight; // (3, 32, 64)
+    MTensor convs_1_bias; // 64
+    MTensor convs_2_weight; // (3, 64, 64)
+    MTensor convs_2_bias; // 64
+    MTensor fc1_weight; // (190, 128)
+    MTensor fc1_bias; // 128
+    MTensor fc2_weight; // (128, 64)
+    MTensor fc2_bias; // 64
+    std::unordered_map<std::string, MTMLHead> heads;
+    // int8 copies of the conv and fc weights, empty unless quantizeMTMLModel was called
+    MQuantizedTensor convs_0_qweight;
+    MQuantizedTensor convs_1_qweight;
+    MQuantizedTensor convs_2_qweight;
+    MQuantizedTensor fc1_qweight;
+    MQuantizedTensor fc2_qweight;
+    // half precision replacements of the embedding, conv and fc weights, whose float tensors are then
+    // empty; set by storeMTMLModelInHalfPrecision
+    MHalfTensor embed_hweight;
+    MHalfTensor convs_0_hweight;
+    MHalfTensor convs_1_hweight;
+    MHalfTensor convs_2_hweight;
+    MHalfTensor fc1_hweight;
+    MHalfTensor fc2_hweight;
+    // block-sparse replacements of the fc weights, empty unless their measured density makes them faster,
+    // see toBlockSparseIfFaster; the dense fc weight is then empty, and so is its half precision copy
+    MBlockSparseTensor fc1_sweight;
+    MBlockSparseTensor fc2_sweight;
+    // kernels::dense specialized for the shapes of the fp32 fc weights, if there are specializations for
+    // them; set by packMTMLWeights
+    kernels::DenseKernel fc_kernels[2] = {kernels::dense, kernels::dense};
+    // embeddingConvTable of the embedding and the first conv, empty unless precomputeMTMLEmbeddingConv was called
+    MTensor embed_conv0_table; // (3, 256, 32)
+    // tokens that one output position of the last conv depends on
+    int receptive_field = 0;
+    // global max pool of the convs over padding only, for MTMLInferenceOptions::length_buckets; indexed by
+    // whether conv0 runs from embed_conv0_table
+    MTMLPaddingSummary padding[2];
+    // placement of the MTMLBuffer intermediates in floats per example, indexed by whether the convs run
+    // unfused, see mtmlWorkspaceBytes
+    MBufferPlan buffer_plans[2];
+
+    MAT_ALWAYS_INLINE bool empty() const
+    {
+      return embed_weight.count() == 0 && embed_hweight.count() == 0;
+    }
+
+    MAT_ALWAYS_INLINE bool half_precision() const
+    {
+      return embed_hweight.count() > 0;
+    }
+
+    MAT_ALWAYS_INLINE bool quantized() const
+    {
+      return fc2_qweight.count() > 0;
+    }
+  };
+
+  struct MTMLInferenceOptions {
+    // run each conv stage as a single fused conv + bias + relu (+ maxpool) kernel; the unfused
+    // sequence of ops is kept as the reference implementation
+    bool fuse_conv_layers = true;
+    // when set, intermediates and the returned tensor are allocated from this arena, and the result
+    // is only valid until the arena is used by the next prediction
+    MTensorArena *arena = nullptr;
+    // run the conv and fc layers with int8 weights and activations; ignored, i.e. fp32 is used, if the
+    // model has not been quantized. The embedding and the task heads always run in fp32.
+    bool quantized = false;
+    // A model stored in half precision always runs the fused conv layers, fuse_conv_layers is ignored.
+    // compute the first conv from the model's embed_conv0_table, if it has one, instead of embedding the
+    // texts first; not used by the unfused reference path
+    bool fuse_embedding = true;
+    // run the convs over the shortest of 16, 32, 64 and 128 tokens that covers the longest text and
+    // complete their global max pools with the model's padding summary, giving the same result as the
+    // full 128 token pass; not used by the unfused reference path. Quantized inference takes a bucket with
+    // one more position, so that every conv sees the padding of the full pass itself: its activation
+    // scales depend on it, and the padding summary would not match them.
+    bool length_buckets = true;
+    // times every stage of the prediction and counts its allocations; ignored unless the runtime is built
+    // with FBSDK_ML_PROFILING
+    MModelProfiler *profiler = nullptr;
+  };
+
+  // Per-thread arena for callers that consume a prediction before making the next one on the same thread
+  static inline MTensorArena *threadLocalArena()
+  {
+    static thread_local MTensorArena arena;
+    return &arena;
+  }
+
+  static const MTensor *findWeight(const std::unordered_map<std::string, MTensor> &weights, const std::string &key)
+  {
+    auto it = weights.find(key);
+    if (it == weights.end()) {
+      return nullptr;
+    }
+    return &it->second;
+  }
+
+  static bool mtmlUsesEmbeddingConvTable(const PackedMTMLModel &model, const MTMLInferenceOptions &options)
+  {
+    return options.fuse_embedding
+      && model.embed_conv0_table.count() > 0
+      && ((options.quantized && model.quantized()) || model.half_precision() || options.fuse_conv_layers);
+  }
+
+  // Whether options run the convs of model as the unfused sequence of reference ops
+  static bool mtmlRunsUnfusedConvs(const PackedMTMLModel &model, const MTMLInferenceOptions &options)
+  {
+    return !(options.quantized && model.quantized()) && !model.half_precision() && !options.fuse_conv_layers;
+  }
+
+  /*
+   The conv layers of predictOnMTMLBatch over the first seq_length tokens of every text and the global max
+   pool of each, returns false if seq_length is too short for them. Each pool runs right after its conv, so
+   that the conv output is dead once the next conv has read it.
+   ca shape: texts.size(), 1, 32
+   cb shape: texts.size(), 1, 64
+   cc shape: texts.size(), 1, 64
+   */
+  static bool mtmlConvs(const std::vector<const char *> &texts, const int seq_length, const PackedMTMLModel &model, const MTMLInferenceOptions &options, MTensorArena *arena, MTensor &ca, MTensor &cb, MTensor &cc)
+  {
+    const MTensor &embed_t = model.embed_weight;
+    const MTensor &convs_0_weight = model.convs_0_weight;
+    const MTensor &convs_1_weight = model.convs_1_weight;
+    const MTensor &convs_2_weight = model.convs_2_weight;
+    const MTensor &conv0b_t = model.convs_0_bias;
+    const MTensor &conv1b_t = model.convs_1_bias;
+    const MTensor &conv2b_t = model.convs_2_bias;
+
+    const int n_examples = (int)texts.size();
+    const bool half_precision = model.half_precision();
+    const bool quantized = options.quantized && model.quantized();
+    const bool fuse_embedding = mtmlUsesEmbeddingConvTable(model, options);
+    const bool unfused = mtmlRunsUnfusedConvs(model, options);
+    const MBufferPlan &plan = model.buffer_plans[unfused ? 1 : 0];
+
+    // embedding + conv0, or conv0 from the embedding conv table
+    MTensor c0;
+    if (fuse_embedding) {
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "conv0");
+      MPlaceNextTensor(arena, plan, kMTMLC0, n_examples);
+      c0 = embeddingConv1DBiasReLU(texts, seq_length, model.embed_conv0_table, conv0b_t, arena); // (n_examples, seq_length - 2, 32)
+    } else {
+      MTensor embed_x;
+      {
+        FBSDK_ML_PROFILE_SCOPE(options.profiler, "embedding");
+        MPlaceNextTensor(arena, plan, kMTMLEmbedX, n_examples);
+        if (half_precision) {
+          embed_x = embedding(texts, seq_length, model.embed_hweight, arena);
+        } else {
+          embed_x = embedding(texts, seq_length, embed_t, arena);
+        }
+      }
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "conv0");
+      MPlaceNextTensor(arena, plan, kMTMLC0, n_examples);
+      if (quantized) {
+        c0 = conv1DBiasReLU(embed_x, model.convs_0_qweight, conv0b_t, arena);
+      } else if (half_precision) {
+        c0 = conv1DBiasReLU(embed_x, model.convs_0_hweight, conv0b_t, arena);
+      } else if (!unfused) {
+        c0 = conv1DBiasReLU(embed_x, convs_0_weight, conv0b_t, arena); // (n_examples, seq_length - 2, 32)
+      } else {
+        c0 = conv1D(embed_x, convs_0_weight, arena); // (n_examples, seq_length - 2, 32)
+        if (c0.count() > 0) {
+          addmv(c0, conv0b_t);
+          relu(c0);
+        }
+      }
+    }
     if (c0.count() == 0) {
-      return MTensor();
+      return false;
+    }
+    {
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "global_max_pool");
+      MPlaceNextTensor(arena, plan, kMTMLCa, n_examples);
+      ca = maxPool1D(c0, c0.size(1), arena);
     }
-    addmv(c0, conv0b_t);
-    relu(c0);
 
-    // conv1
-    MTensor c1 = conv1D(c0, convs_1_weight); // (1, 124, 64)
-    if (c1.count() == 0) {
-      return MTensor();
+    // conv1 + max pool
+    MTensor c1;
+    {
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "conv1");
+      if (quantized) {
+        MPlaceNextTensor(arena, plan, kMTMLC1, n_examples);
+        c1 = conv1DBiasReLUMaxPool1D(c0, model.convs_1_qweight, conv1b_t, 2, arena);
+      } else if (half_precision) {
+        MPlaceNextTensor(arena, plan, kMTMLC1, n_examples);
+        c1 = conv1DBiasReLUMaxPool1D(c0, model.convs_1_hweight, conv1b_t, 2, arena);
+      } else if (!unfused) {
+        MPlaceNextTensor(arena, plan, kMTMLC1, n_examples);
+        c1 = conv1DBiasReLUMaxPool1D(c0, convs_1_weight, conv1b_t, 2, arena); // (n_examples, seq_length - 5, 64)
+      } else {
+        MPlaceNextTensor(arena, plan, kMTMLC1Unpooled, n_examples);
+        c1 = conv1D(c0, convs_1_weight, arena); // (n_examples, seq_length - 4, 64)
+        if (c1.count() == 0) {
+          return false;
+        }
+        addmv(c1, conv1b_t);
+        relu(c1);
+        MPlaceNextTensor(arena, plan, kMTMLC1, n_examples);
+        c1 = maxPool1D(c1, 2, arena); // (n_examples, seq_length - 5, 64)
+      }
     }
-    addmv(c1, conv1b_t);
-    relu(c1);
-    c1 = maxPool1D(c1, 2); // (1, 123, 64)
     if (c1.count() == 0) {
-      return MTensor();
+      return false;
+    }
+    c0 = MTensor();
+    {
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "global_max_pool");
+      MPlaceNextTensor(arena, plan, kMTMLCb, n_examples);
+      cb = maxPool1D(c1, c1.size(1), arena);
     }
 
     // conv2
-    MTensor c2 = conv1D(c1, convs_2_weight); // (1, 121, 64)
+    MTensor c2;
+    {
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "conv2");
+      MPlaceNextTensor(arena, plan, kMTMLC2, n_examples);
+      if (quantized) {
+        c2 = conv1DBiasReLU(c1, model.convs_2_qweight, conv2b_t, arena);
+      } else if (half_precision) {
+        c2 = conv1DBiasReLU(c1, model.convs_2_hweight, conv2b_t, arena);
+      } else if (!unfused) {
+        c2 = conv1DBiasReLU(c1, convs_2_weight, conv2b_t, arena); // (n_examples, seq_length - 7, 64)
+      } else {
+        c2 = conv1D(c1, convs_2_weight, arena); // (n_examples, seq_length - 7, 64)
+        if (c2.count() > 0) {
+          addmv(c2, conv2b_t);
+          relu(c2);
+        }
+      }
+    }
     if (c2.count() == 0) {
+      return false;
+    }
+    c1 = MTensor();
+    FBSDK_ML_PROFILE_SCOPE(options.profiler, "global_max_pool");
+    MPlaceNextTensor(arena, plan, kMTMLCc, n_examples);
+    cc = maxPool1D(c2, c2.size(1), arena);
+    return true;
+  }
+
+  // Padding summary for the conv path options select, or nullptr if that path cannot use length buckets
+  static const MTMLPaddingSummary *mtmlPaddingSummary(const PackedMTMLModel &model, const MTMLInferenceOptions &options)
+  {
+    if ((options.quantized && model.quantized()) || (!options.fuse_conv_layers && !model.half_precision())) {
+      return nullptr;
+    }
+    const MTMLPaddingSummary &summary = model.padding[mtmlUsesEmbeddingConvTable(model, options) ? 1 : 0];
+    return summary.c2.count() > 0 ? &summary : nullptr;
+  }
+
+  // Fills model.padding by running the convs over a text that is all padding
+  static void precomputeMTMLPadding(PackedMTMLModel &model)
+  {
+    const std::vector<const char *> texts = {""};
+    for (int fuse_embedding = 0; fuse_embedding < 2; fuse_embedding++) {
+      MTMLPaddingSummary &summary = model.padding[fuse_embedding];
+      summary = MTMLPaddingSummary();
+      MTMLInferenceOptions options;
+      options.fuse_embedding = fuse_embedding == 1;
+      if (mtmlUsesEmbeddingConvTable(model, options) != options.fuse_embedding) {
+        continue;
+      }
+      if (!mtmlConvs(texts, model.receptive_field, model, options, nullptr, summary.c0, summary.c1, summary.c2)) {
+        summary = MTMLPaddingSummary();
+        continue;
+      }
+      flatten(summary.c0, 0);
+      flatten(summary.c1, 0);
+      flatten(summary.c2, 0);
+    }
+  }
+
+  /*
+   The shortest length bucket that covers the longest of texts together with its receptive field, and with
+   padding_positions more outputs of the last conv that only see padding
+   */
+  static int mtmlBucketLength(const std::vector<const char *> &texts, const PackedMTMLModel &model, const int padding_positions = 0)
+  {
+    static const int buckets[] = {16, 32, 64};
+    int max_len = 0;
+    for (const char *text : texts) {
+      max_len = std::max(max_len, (int)strnlen(text, SEQ_LEN));
+    }
+    for (int bucket : buckets) {
+      if (max_len + model.receptive_field - 1 + padding_positions <= bucket) {
+        return bucket;
+      }
+    }
+    return SEQ_LEN;
+  }
+
+  // x[n, ...] = max(x[n, ...], row) for every example n
+  static void maxIntoRows(MTensor &x, const MTensor &row)
+  {
+    float *x_data = x.mutable_data();
+    for (int n = 0; n < x.size(0); n++) {
+      kernels::max_into(row.data(), x_data + n * row.count(), row.count());
+    }
+  }
+
+  /*
+   Lifetimes of the intermediates of predictMTMLEmbedding over SEQ_LEN tokens, in floats per example; the
+   shorter length buckets fit in the same places. The embedding is returned, so it stays alive. A conv
+   output takes as many rows as the conv's input while the examples are stacked, see conv1DGemm.
+   */
+  static MBufferPlan mtmlBufferPlan(const PackedMTMLModel &model, const bool unfused)
+  {
+    const int conv0_len = SEQ_LEN - model.convs_0_weight.size(0) + 1;
+    const int conv1_len = conv0_len - model.convs_1_weight.size(0) + 1;
+    const int pool1_len = conv1_len - 1;
+    const int conv0_size = model.convs_0_weight.size(2);
+    const int conv1_size = model.convs_1_weight.size(2);
+    const int conv2_size = model.convs_2_weight.size(2);
+    std::vector<MBufferLifetime> buffers(kMTMLBufferCount);
+    buffers[kMTMLEmbedX] = {(size_t)(SEQ_LEN * model.embed_weight.size(1)), 0, 1};
+    buffers[kMTMLC0] = {(size_t)(SEQ_LEN * conv0_size), 1, 3};
+    buffers[kMTMLCa] = {(size_t)conv0_size, 2, 9};
+    buffers[kMTMLC1Unpooled] = {unfused ? (size_t)(conv0_len * conv1_size) : 0, 3, 4};
+    buffers[kMTMLC1] = {(size_t)((unfused ? pool1_len : conv0_len) * conv1_size), unfused ? 4 : 3, 6};
+    buffers[kMTMLCb] = {(size_t)conv1_size, 5, 9};
+    buffers[kMTMLC2] = {(size_t)(pool1_len * conv2_size), 6, 7};
+    buffers[kMTMLCc] = {(size_t)conv2_size, 7, 9};
+    buffers[kMTMLDenseFeatures] = {DENSE_FEATURE_LEN, 8, 9};
+    buffers[kMTMLConcat] = {(size_t)(conv0_size + conv1_size + conv2_size + DENSE_FEATURE_LEN), 9, 10};
+    buffers[kMTMLDense1] = {(size_t)model.fc1_bias.count(), 10, 11};
+    buffers[kMTMLDense2] = {(size_t)model.fc2_bias.count(), 11, 12};
+    // 64-byte aligned for any number of examples
+    return MPlanBuffers(buffers, 16);
+  }
+
+  static PackedMTMLModel packMTMLWeights(const std::unordered_map<std::string, MTensor> &weights)
+  {
+    const char *trunk_keys[] = {
+      "embed.weight",
+      "convs.0.weight", "convs.0.bias",
+      "convs.1.weight", "convs.1.bias",
+      "convs.2.weight", "convs.2.bias",
+      "fc1.weight", "fc1.bias",
+      "fc2.weight", "fc2.bias",
+    };
+    for (const char *key : trunk_keys) {
+      if (!findWeight(weights, key)) {
+        return PackedMTMLModel();
+      }
+    }
+
+    PackedMTMLModel model;
+    model.embed_weight = weights.at("embed.weight");
+    model.convs_0_weight = transpose3D(weights.at("convs.0.weight"));
+    model.convs_0_bias = weights.at("convs.0.bias");
+    model.convs_1_weight = transpose3D(weights.at("convs.1.weight"));
+    model.convs_1_bias = weights.at("convs.1.bias");
+    model.convs_2_weight = transpose3D(weights.at("convs.2.weight"));
+    model.convs_2_bias = weights.at("convs.2.bias");
+    model.fc1_weight = transpose2D(weights.at("fc1.weight"));
+    model.fc1_bias = weights.at("fc1.bias");
+    model.fc2_weight = transpose2D(weights.at("fc2.weight"));
+    model.fc2_bias = weights.at("fc2.bias");
+    model.fc_kernels[0] = kernels::dense_for_shape(model.fc1_weight.size(0), model.fc1_weight.size(1));
+    model.fc_kernels[1] = kernels::dense_for_shape(model.fc2_weight.size(0), model.fc2_weight.size(1));
+    // pruned models ship their zeros in the dense layout
+    model.fc1_sweight = toBlockSparseIfFaster(model.fc1_weight);
+    if (!model.fc1_sweight.empty()) {
+      model.fc1_weight = MTensor();
+    }
+    model.fc2_sweight = toBlockSparseIfFaster(model.fc2_weight);
+    if (!model.fc2_sweight.empty()) {
+      model.fc2_weight = MTensor();
+    }
+
+    // every remaining "<task>.weight" / "<task>.bias" pair is a task head
+    const std::string weight_suffix = ".weight";
+    for (const auto &entry : weights) {
+      const std::string &key = entry.first;
+      if (key.size() <= weight_suffix.size()
+          || key.compare(key.size() - weight_suffix.size(), weight_suffix.size(), weight_suffix) != 0) {
+        continue;
+      }
+      std::string task = key.substr(0, key.size() - weight_suffix.size());
+      if (task.find('.') != std::string::npos || task == "embed" || task == "fc1" || task == "fc2") {
+        continue;
+      }
+      const MTensor *bias = findWeight(weights, task + ".bias");
+      if (!bias) {
+        continue;
+      }
+      MTMLHead head;
+      head.weight = transpose2D(entry.second);
+      head.bias = *bias;
+      model.heads[task] = head;
+    }
+
+    model.buffer_plans[0] = mtmlBufferPlan(model, false);
+    model.buffer_plans[1] = mtmlBufferPlan(model, true);
+    // conv2 output t depends on tokens t .. t + k0 + k1 + k2 - 2, the pooling of conv1 adds one
+    model.receptive_field = model.convs_0_weight.size(0) + model.convs_1_weight.size(0) + model.convs_2_weight.size(0) - 1;
+    precomputeMTMLPadding(model);
+    return model;
+  }
+
+  // Builds model.embed_conv0_table for MTMLInferenceOptions::fuse_embedding, from the current weights
+  static void precomputeMTMLEmbeddingConv(PackedMTMLModel &model)
+  {
+    if (model.empty()) {
+      return;
+    }
+    if (model.half_precision()) {
+      model.embed_conv0_table = embeddingConvTable(toFloat(model.embed_hweight), toFloat(model.convs_0_hweight));
+    } else {
+      model.embed_conv0_table = embeddingConvTable(model.embed_weight, model.convs_0_weight);
+    }
+    precomputeMTMLPadding(model);
+  }
+
+  /*
+   Replaces the embedding, conv and fc weights of model by half precision copies, which halves their
+   resident memory. Biases and task heads are small and stay in float.
+   */
+  static void storeMTMLModelInHalfPrecision(PackedMTMLModel &model, MHalfType type)
+  {
+    if (model.empty() || model.half_precision()) {
+      return;
+    }
+    model.embed_hweight = toHalfPrecision(model.embed_weight, type);
+    model.convs_0_hweight = toHalfPrecision(model.convs_0_weight, type);
+    model.convs_1_hweight = toHalfPrecision(model.convs_1_weight, type);
+    model.convs_2_hweight = toHalfPrecision(model.convs_2_weight, type);
+    // a block-sparse fc weight stays block-sparse, only its values are rounded
+    if (model.fc1_sweight.empty()) {
+      model.fc1_hweight = toHalfPrecision(model.fc1_weight, type);
+    } else {
+      model.fc1_sweight = toHalfPrecision(model.fc1_sweight, type);
+    }
+    if (model.fc2_sweight.empty()) {
+      model.fc2_hweight = toHalfPrecision(model.fc2_weight, type);
+    } else {
+      model.fc2_sweight = toHalfPrecision(model.fc2_sweight, type);
+    }
+    model.embed_weight = MTensor();
+    model.convs_0_weight = MTensor();
+    model.convs_1_weight = MTensor();
+    model.convs_2_weight = MTensor();
+    model.fc1_weight = MTensor();
+    model.fc2_weight = MTensor();
+    // follow the rounded weights
+    if (model.embed_conv0_table.count() > 0) {
+      precomputeMTMLEmbeddingConv(model);
+    } else {
+      precomputeMTMLPadding(model);
+    }
+  }
+
+  /*
+   Float copy of a model stored in half precision, for validation: its predictions, including the
+   unfused reference path, are bit-exact with the ones of the half precision model. Block-sparse fc
+   weights are shared as they are, their kernel widens the values exactly.
+   */
+  static PackedMTMLModel widenMTMLModel(const PackedMTMLModel &model)
+  {
+    PackedMTMLModel widened = model;
+    if (!model.half_precision()) {
+      return widened;
+    }
+    widened.embed_weight = toFloat(model.embed_hweight);
+    widened.convs_0_weight = toFloat(model.convs_0_hweight);
+    widened.convs_1_weight = toFloat(model.convs_1_hweight);
+    widened.convs_2_weight = toFloat(model.convs_2_hweight);
+    if (model.fc1_sweight.empty()) {
+      widened.fc1_weight = toFloat(model.fc1_hweight);
+    }
+    if (model.fc2_sweight.empty()) {
+      widened.fc2_weight = toFloat(model.fc2_hweight);
+    }
+    widened.embed_hweight = MHalfTensor();
+    widened.convs_0_hweight = MHalfTensor();
+    widened.convs_1_hweight = MHalfTensor();
+    widened.convs_2_hweight = MHalfTensor();
+    widened.fc1_hweight = MHalfTensor();
+    widened.fc2_hweight = MHalfTensor();
+    return widened;
+  }
+
+  // Adds int8 weights to model for MTMLInferenceOptions::quantized
+  static void quantizeMTMLModel(PackedMTMLModel &model)
+  {
+    if (model.empty()) {
+      return;
+    }
+    const PackedMTMLModel &source = model.half_precision() ? widenMTMLModel(model) : model;
+    model.convs_0_qweight = quantizePerChannel(source.convs_0_weight);
+    model.convs_1_qweight = quantizePerChannel(source.convs_1_weight);
+    model.convs_2_qweight = quantizePerChannel(source.convs_2_weight);
+    model.fc1_qweight = source.fc1_sweight.empty() ? quantizePerChannel(source.fc1_weight) : quantizePerChannel(source.fc1_sweight);
+    model.fc2_qweight = source.fc2_sweight.empty() ? quantizePerChannel(source.fc2_weight) : quantizePerChannel(source.fc2_sweight);
+  }
+
+  // Planned bytes of the intermediates of predictMTMLEmbedding, i.e. its peak working set
+  static size_t mtmlPlannedBytes(const PackedMTMLModel &model, const int n_examples, const MTMLInferenceOptions &options = MTMLInferenceOptions())
+  {
+    const MBufferPlan &plan = model.buffer_plans[mtmlRunsUnfusedConvs(model, options) ? 1 : 0];
+    return (size_t)n_examples * plan.peak * sizeof(float);
+  }
+
+  // Arena bytes of one prediction: the planned intermediates followed by the output of every head
+  static size_t mtmlWorkspaceBytes(const PackedMTMLModel &model, const int n_examples, const MTMLInferenceOptions &options = MTMLInferenceOptions())
+  {
+    size_t nbytes = mtmlPlannedBytes(model, n_examples, options);
+    for (const auto &entry : model.heads) {
+      nbytes += MTensorArena::AlignedSize((size_t)n_examples * (size_t)entry.second.weight.size(1) * sizeof(float));
+    }
+    return nbytes;
+  }
+
+  /*
+   Runs all texts as one batch through the layers shared by every task, i.e. up to the relu of fc2.
+   df: texts.size() rows of DENSE_FEATURE_LEN floats, or nullptr
+   return shape: texts.size(), 64
+   */
+  static MTensor predictMTMLEmbedding(const std::vector<const char *> &texts, const PackedMTMLModel &model, const float *df, const MTMLInferenceOptions &options = MTMLInferenceOptions())
+  {
+    if (model.empty() || texts.empty()) {
       return MTensor();
     }
-    addmv(c2, conv2b_t);
-    relu(c2);
+    int n_examples = (int)texts.size();
+    MTensorArena *arena = options.arena;
+    if (arena) {
+      // grow to the previous round's demand if it overflowed, then to the planned peak
+      arena->Reset();
+      arena->Reserve(mtmlWorkspaceBytes(model, n_examples, options), mtmlPlannedBytes(model, n_examples, options));
+    }
+
+    const MTensor &fc1_weight = model.fc1_weight;
+    const MTensor &fc1b_t = model.fc1_bias;
+    const MTensor &fc2_weight = model.fc2_weight;
+    const MTensor &fc2b_t = model.fc2_bias;
+
+    const bool half_precision = model.half_precision();
+    const bool quantized = options.quantized && model.quantized();
+    const MTMLPaddingSummary *padding = options.length_buckets ? mtmlPaddingSummary(model, options) : nullptr;
+    int seq_length = SEQ_LEN;
+    if (padding) {
+      seq_length = mtmlBucketLength(texts, model);
+    } else if (quantized && options.length_buckets) {
+      seq_length = mtmlBucketLength(texts, model, 1);
+    }
 
-    // max pooling
-    MTensor ca = maxPool1D(c0, c0.size(1));
-    MTensor cb = maxPool1D(c1, c1.size(1));
-    MTensor cc = maxPool1D(c2, c2.size(1));
+    const MBufferPlan &plan = model.buffer_plans[mtmlRunsUnfusedConvs(model, options) ? 1 : 0];
+
+    // convs and their global max pools
+    MTensor ca;
+    MTensor cb;
+    MTensor cc;
+    if (!mtmlConvs(texts, seq_length, model, options, arena, ca, cb, cc)) {
+      return MTensor();
+    }
+    if (padding && seq_length < SEQ_LEN) {
+      // the positions that were not computed are all padding
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "global_max_pool");
+      maxIntoRows(ca, padding->c0);
+      maxIntoRows(cb, padding->c1);
+      maxIntoRows(cc, padding->c2);
+    }
 
     // concatenate
-    flatten(ca, 1);
-    flatten(cb, 1);
-    flatten(cc, 1);
-    std::vector<MTensor *> concat_tensors { &ca, &cb, &cc, &dense_tensor };
-    const MTensor &concat = concatenate(concat_tensors);
+    MTensor concat;
+    {
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "concat");
+      flatten(ca, 1);
+      flatten(cb, 1);
+      flatten(cc, 1);
+      MPlaceNextTensor(arena, plan, kMTMLDenseFeatures, n_examples);
+      MTensor dense_tensor = getDenseTensor(df, n_examples, arena);
+      MTensor *concat_tensors[] = { &ca, &cb, &cc, &dense_tensor };
+      MPlaceNextTensor(arena, plan, kMTMLConcat, n_examples);
+      concat = concatenate(concat_tensors, 4, arena);
+    }
 
     // dense + relu
-    MTensor dense1_x = dense(concat, fc1_weight, fc1b_t);
-    relu(dense1_x);
-    MTensor dense2_x = dense(dense1_x, fc2_weight, fc2b_t);
+    MTensor dense1_x;
+    {
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "fc1");
+      MPlaceNextTensor(arena, plan, kMTMLDense1, n_examples);
+      if (quantized) {
+        dense1_x = dense(concat, model.fc1_qweight, fc1b_t, arena);
+      } else if (!model.fc1_sweight.empty()) {
+        dense1_x = dense(concat, model.fc1_sweight, fc1b_t, arena);
+      } else if (half_precision) {
+        dense1_x = dense(concat, model.fc1_hweight, fc1b_t, arena);
+      } else {
+        dense1_x = dense(concat, fc1_weight, fc1b_t, arena, model.fc_kernels[0]);
+      }
+      relu(dense1_x);
+    }
+    FBSDK_ML_PROFILE_SCOPE(options.profiler, "fc2");
+    MTensor dense2_x;
+    MPlaceNextTensor(arena, plan, kMTMLDense2, n_examples);
+    if (quantized) {
+      dense2_x = dense(dense1_x, model.fc2_qweight, fc2b_t, arena);
+    } else if (!model.fc2_sweight.empty()) {
+      dense2_x = dense(dense1_x, model.fc2_sweight, fc2b_t, arena);
+    } else if (half_precision) {
+      dense2_x = dense(dense1_x, model.fc2_hweight, fc2b_t, arena);
+    } else {
+      dense2_x = dense(dense1_x, fc2_weight, fc2b_t, arena, model.fc_kernels[1]);
+    }
     relu(dense2_x);
-    MTensor final_layer_dense_x = dense(dense2_x, final_layer_weight, final_layer_bias_t);
+    return dense2_x;
+  }
+
+  /*
+   The head of task on embeddings from predictMTMLEmbedding, which callers may keep to run further tasks on
+   the same inputs for the cost of the head alone. An embedding allocated from an arena has to be copied
+   out before the arena's next prediction.
+   return shape: embedding.size(0), n_class
+   */
+  static MTensor predictMTMLHead(const std::string &task, const MTensor &embedding, const PackedMTMLModel &model, MTensorArena *arena = nullptr)
+  {
+    auto head = model.heads.find(task);
+    if (head == model.heads.end() || embedding.count() == 0) {
+      return MTensor();
+    }
+    MTensor final_layer_dense_x = dense(embedding, head->second.weight, head->second.bias, arena);
     softmax(final_layer_dense_x);
     return final_layer_dense_x;
   }
+
+  /*
+   predictMTMLHead with the threshold decision fused in: classes[n] is firstClassOverThreshold of example n.
+   Returns the probabilities, e.g. for caching, or an empty tensor if the model has no head for task or the
+   head has fewer than n_thresholds classes.
+   */
+  static MTensor classifyMTMLHead(const std::string &task, const MTensor &embedding, const PackedMTMLModel &model, const float *thresholds, const int n_thresholds, std::vector<int> &classes, MTensorArena *arena = nullptr)
+  {
+    auto head = model.heads.find(task);
+    if (head == model.heads.end() || embedding.count() == 0) {
+      return MTensor();
+    }
+    const MTensor &w = head->second.weight;
+    const int n_examples = embedding.size(0);
+    const int n_class = w.size(1);
+    if (n_thresholds > n_class) {
+      return MTensor();
+    }
+    MTensor probs = MAllocateTensor({n_examples, n_class}, arena);
+    classes.resize(n_examples);
+    kernels::classify_with_thresholds(embedding.data(), embedding.size(1), w.data(), head->second.bias.data(), probs.mutable_data(), n_examples, n_class, w.size(0), thresholds, n_thresholds, classes.data());
+    return probs;
+  }
+
+  /*
+   Runs all texts through the network as one batch.
+   df: texts.size() rows of DENSE_FEATURE_LEN floats, or nullptr
+   return shape: texts.size(), n_class
+   */
+  static MTensor predictOnMTMLBatch(const std::string &task, const std::vector<const char *> &texts, const PackedMTMLModel &model, const float *df, const MTMLInferenceOptions &options = MTMLInferenceOptions())
+  {
+    if (model.heads.find(task) == model.heads.end()) {
+      return MTensor();
+    }
+    FBSDK_ML_PROFILE_PREDICTION(options.profiler, texts, SEQ_LEN);
+    const MTensor &embedding = predictMTMLEmbedding(texts, model, df, options);
+    FBSDK_ML_PROFILE_SCOPE(options.profiler, "head");
+    return predictMTMLHead(task, embedding, model, options.arena);
+  }
+
+  /*
+   Runs the shared layers once and then the head of every task in tasks, returning the probabilities of
+   each task keyed by name. Tasks the model has no head for are left out.
+   */
+  static std::unordered_map<std::string, MTensor> predictOnMTMLTasks(const std::vector<std::string> &tasks, const std::vector<const char *> &texts, const PackedMTMLModel &model, const float *df, const MTMLInferenceOptions &options = MTMLInferenceOptions())
+  {
+    std::unordered_map<std::string, MTensor> probs;
+    FBSDK_ML_PROFILE_PREDICTION(options.profiler, texts, SEQ_LEN);
+    const MTensor &embedding = predictMTMLEmbedding(texts, model, df, options);
+    if (embedding.count() == 0) {
+      return probs;
+    }
+    for (const std::string &task : tasks) {
+      FBSDK_ML_PROFILE_SCOPE(options.profiler, "head");
+      const MTensor &task_probs = predictMTMLHead(task, embedding, model, options.arena);
+      if (task_probs.count() > 0) {
+        probs[task] = task_probs;
+      }
+    }
+    return probs;
+  }
+
+  // predictOnMTMLBatch that also picks the class of every text, see classifyMTMLHead
+  static MTensor classifyOnMTMLBatch(const std::string &task, const std::vector<const char *> &texts, const PackedMTMLModel &model, const float *df, const float *thresholds, const int n_thresholds, std::vector<int> &classes, const MTMLInferenceOptions &options = MTMLInferenceOptions())
+  {
+    if (model.heads.find(task) == model.heads.end()) {
+      return MTensor();
+    }
+    FBSDK_ML_PROFILE_PREDICTION(options.profiler, texts, SEQ_LEN);
+    const MTensor &embedding = predictMTMLEmbedding(texts, model, df, options);
+    // the head fused with the threshold scan
+    FBSDK_ML_PROFILE_SCOPE(options.profiler, "classify");
+    return classifyMTMLHead(task, embedding, model, thresholds, n_thresholds, classes, options.arena);
+  }
+
+  static MTensor predictOnMTML(const std::string &task, const char *texts, const PackedMTMLModel &model, const float *df, const MTMLInferenceOptions &options = MTMLInferenceOptions())
+  {
+    return predictOnMTMLBatch(task, std::vector<const char *> { texts }, model, df, options);
+  }
+
+  // Index of the first class whose probability reaches its threshold, or -1 if none does
+  static inline int firstClassOverThreshold(const float *probs, const float *thresholds, const int n_thresholds)
+  {
+    return kernels::first_over_threshold(probs, thresholds, n_thresholds);
+  }
+
+  /*
+   Accuracy check for quantized inference: runs texts through the fp32 and the int8 model and returns
+   how many of them get a different class from the threshold scan, or -1 if the model cannot run task.
+   */
+  static inline int countQuantizedMismatches(const std::string &task, const std::vector<const char *> &texts, const PackedMTMLModel &model, const float *df, const float *thresholds, const int n_thresholds)
+  {
+    MTMLInferenceOptions quantized;
+    quantized.quantized = true;
+    const MTensor &expected = predictOnMTMLBatch(task, texts, model, df);
+    const MTensor &actual = predictOnMTMLBatch(task, texts, model, df, quantized);
+    if (!model.quantized() || expected.count() == 0 || actual.count() == 0 || expected.size(1) < n_thresholds) {
+      return -1;
+    }
+    int mismatches = 0;
+    for (int n = 0; n < expected.size(0); n++) {
+      if (firstClassOverThreshold(expected.Slice(n).data(), thresholds, n_thresholds)
+          != firstClassOverThreshold(actual.Slice(n).data(), thresholds, n_thresholds)) {
+        mismatches++;
+      }
+    }
+    return mismatches;
+  }
+
+  static inline MTensor predictOnMTML(const std::string &task, const char *texts, const std::unordered_map<std::string, MTensor> &weights, const float *df)
+  {
+    return predictOnMTML(task, texts, packMTMLWeights(weights), df);
+  }
 }
 
 #endif
+
+#endif /* FBSDKModelRuntime_hpp */
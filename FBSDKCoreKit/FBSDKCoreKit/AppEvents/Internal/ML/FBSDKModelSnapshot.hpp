@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef FBSDKModelSnapshot_hpp
+#define FBSDKModelSnapshot_hpp
+
+#if !TARGET_OS_TV
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include <stdint.h>
+
+#include "FBSDKModelGraph.hpp"
+#include "FBSDKModelRuntime.hpp"
+
+namespace fbsdk {
+  // Everything an MTML prediction reads. Published as a whole and never modified afterwards.
+  struct MTMLSnapshot {
+    PackedMTMLModel model;
+    // the op graph shipped with the weights, if any, runs instead of model
+    MOpGraphPlan graph;
+    // tasks of model that run with int8 weights
+    std::unordered_set<std::string> quantized_tasks;
+    // changes with every published snapshot, part of the prediction cache keys
+    uint64_t version = 0;
+    // changes only when new weights are loaded
+    uint64_t model_id = 0;
+
+    bool empty() const
+    {
+      return model.empty() && graph.empty();
+    }
+  };
+
+  // predictOnMTMLBatch on the graph of snapshot if it has one, otherwise on its model
+  static inline MTensor predictOnMTMLSnapshot(const std::string &task, const std::vector<const char *> &texts, const MTMLSnapshot &snapshot, const float *df, const MTMLInferenceOptions &options = MTMLInferenceOptions())
+  {
+    if (snapshot.graph.empty()) {
+      return predictOnMTMLBatch(task, texts, snapshot.model, df, options);
+    }
+    FBSDK_ML_PROFILE_PREDICTION(options.profiler, texts, snapshot.graph.seq_length);
+    std::unordered_map<std::string, MTensor> outputs = runOpGraph(snapshot.graph, texts, df, options.arena, options.profiler, task.c_str());
+    auto output = outputs.find(task);
+    return output != outputs.end() ? output->second : MTensor();
+  }
+
+  // classifyOnMTMLBatch on the graph of snapshot if it has one, otherwise on its model
+  static inline MTensor classifyOnMTMLSnapshot(const std::string &task, const std::vector<const char *> &texts, const MTMLSnapshot &snapshot, const float *df, const float *thresholds, const int n_thresholds, std::vector<int> &classes, const MTMLInferenceOptions &options = MTMLInferenceOptions())
+  {
+    if (snapshot.graph.empty()) {
+      return classifyOnMTMLBatch(task, texts, snapshot.model, df, thresholds, n_thresholds, classes, options);
+    }
+    const MTensor &probs = predictOnMTMLSnapshot(task, texts, snapshot, df, options);
+    if (probs.count() == 0 || probs.size(1) < n_thresholds) {
+      return MTensor();
+    }
+    FBSDK_ML_PROFILE_SCOPE(options.profiler, "classify");
+    classes.resize(probs.size(0));
+    for (int n = 0; n < probs.size(0); n++) {
+      classes[n] = firstClassOverThreshold(probs.Slice(n).data(), thresholds, n_thresholds);
+    }
+    return probs;
+  }
+
+  /*
+   Read-copy-update holder of an immutable T. Readers Load() the current snapshot and keep using it for as
+   long as they need, e.g. a whole prediction; writers build a new snapshot and Publish() it. A snapshot is
+   freed by whoever drops its last reference, so readers never see it torn or freed and neither side waits
+   for the other beyond the pointer swap.
+   */
+  template <typename T>
+  class MSnapshotHolder {
+  public:
+    std::shared_ptr<const T> Load() const
+    {
+      return std::atomic_load(&current_);
+    }
+
+    void Publish(const std::shared_ptr<const T> &snapshot)
+    {
+      std::atomic_store(&current_, snapshot);
+    }
+
+    // Publishes snapshot only if expected is still current, otherwise loads the current snapshot into expected
+    bool Replace(std::shared_ptr<const T> &expected, const std::shared_ptr<const T> &snapshot)
+    {
+      return std::atomic_compare_exchange_strong(&current_, &expected, snapshot);
+    }
+
+  private:
+    std::shared_ptr<const T> current_;
+  };
+}
+
+#endif
+
+#endif /* FBSDKModelSnapshot_hpp */
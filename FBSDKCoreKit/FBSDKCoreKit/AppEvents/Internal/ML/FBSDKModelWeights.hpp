@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef FBSDKModelWeights_hpp
+#define FBSDKModelWeights_hpp
+
+#if !TARGET_OS_TV
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "FBSDKModelKernels.hpp"
+#include "FBSDKTensor.hpp"
+
+/*
+ Binary weights container, loaded without any JSON parsing. All integers are little-endian.
+
+ offset 0     MWeightsHeader
+ offset 32    tensor_count MWeightsEntry records, sorted by name
+ payload      tensor data, each tensor starting at a kWeightsAlignment aligned file offset
+
+ crc32 is the standard CRC-32 (as in zlib) of every byte after the header. Tensors keep the shapes
+ the model was exported with, e.g. the ones checked by FBSDKModelParser's validateWeights.
+
+ flags may ask for the weights to be kept in half precision in memory. Tensors may also be stored as
+ fp16 or bf16 in the file, they are widened to float when the container is parsed.
+
+ Entries of dtype kWeightsDTypeBytes are not tensors but named sections of rank 1, such as the op graph
+ of the model (see FBSDKModelGraph.hpp). MParseWeights skips them, MFindWeightsSection returns them.
+ */
+namespace fbsdk {
+  static const uint32_t kWeightsMagic = 0x574D4246; // "FBMW"
+  static const uint32_t kWeightsVersion = 1;
+  static const uint64_t kWeightsAlignment = 64;
+
+  enum MWeightsDType : uint8_t {
+    kWeightsDTypeFloat32 = 0,
+    kWeightsDTypeFloat16 = 1,
+    kWeightsDTypeBFloat16 = 2,
+    kWeightsDTypeBytes = 3,
+  };
+
+  enum MWeightsLayout : uint8_t {
+    kWeightsLayoutRowMajor = 0,
+  };
+
+  // MWeightsHeader::flags
+  enum MWeightsFlag : uint32_t {
+    kWeightsFlagFloat16Storage = 1 << 0, // keep the weights in memory as fp16
+    kWeightsFlagBFloat16Storage = 1 << 1, // keep the weights in memory as bf16
+  };
+
+  struct MWeightsHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tensor_count;
+    uint32_t crc32;
+    uint64_t file_size;
+    uint32_t flags;
+    uint32_t reserved;
+  };
+
+  struct MWeightsEntry {
+    char name[32]; // null-terminated
+    uint8_t dtype;
+    uint8_t layout;
+    uint8_t rank;
+    uint8_t reserved;
+    int32_t dims[MShape::kMaxRank];
+    uint32_t nbytes;
+    uint64_t offset; // from the start of the file
+  };
+
+  static_assert(sizeof(MWeightsHeader) == 32, "MWeightsHeader is part of the file format");
+  static_assert(sizeof(MWeightsEntry) == 64, "MWeightsEntry is part of the file format");
+
+  static inline uint32_t MCrc32(const void *data, size_t length)
+  {
+    static const std::vector<uint32_t> table = [] {
+      std::vector<uint32_t> t(256);
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+          c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        }
+        t[i] = c;
+      }
+      return t;
+    }();
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+      crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+  }
+
+  static inline bool MIsWeightsContainer(const void *data, size_t length)
+  {
+    uint32_t magic = 0;
+    if (length < sizeof(MWeightsHeader)) {
+      return false;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    return magic == kWeightsMagic;
+  }
+
+  // Header flags of a weights container, 0 if data is not one
+  static inline uint32_t MGetWeightsFlags(const void *data, size_t length)
+  {
+    if (!MIsWeightsContainer(data, length)) {
+      return 0;
+    }
+    MWeightsHeader header;
+    memcpy(&header, data, sizeof(header));
+    return header.flags;
+  }
+
+  /*
+   Reads a weights container into weights. Float tensors point into data and share ownership of owner,
+   which must keep data alive; half precision tensors are widened into new tensors. Returns false and leaves weights empty if data is not a valid container
+   of a supported version, if any tensor has a dtype or layout this runtime does not know, or if its data
+   overlaps the header or the directory.
+   */
+  static inline bool MParseWeights(const void *data, size_t length, const std::shared_ptr<void> &owner, std::unordered_map<std::string, MTensor> &weights)
+  {
+    weights.clear();
+    if (!MIsWeightsContainer(data, length)) {
+      return false;
+    }
+    const char *bytes = static_cast<const char *>(data);
+    MWeightsHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    if (header.version != kWeightsVersion
+        || header.file_size != length
+        || header.tensor_count > (length - sizeof(header)) / sizeof(MWeightsEntry)) {
+      return false;
+    }
+    if (MCrc32(bytes + sizeof(header), length - sizeof(header)) != header.crc32) {
+      return false;
+    }
+
+    // tensor data may not alias the header or the directory
+    const uint64_t directory_end = sizeof(header) + (uint64_t)header.tensor_count * sizeof(MWeightsEntry);
+    for (uint32_t i = 0; i < header.tensor_count; i++) {
+      MWeightsEntry entry;
+      memcpy(&entry, bytes + sizeof(header) + i * sizeof(MWeightsEntry), sizeof(entry));
+      if (entry.dtype > kWeightsDTypeBytes
+          || entry.layout != kWeightsLayoutRowMajor
+          || entry.rank > MShape::kMaxRank
+          || entry.name[sizeof(entry.name) - 1] != '\0'
+          || entry.offset % kWeightsAlignment != 0
+          || entry.offset < directory_end
+          || entry.offset > length
+          || entry.nbytes > length - entry.offset) {
+        weights.clear();
+        return false;
+      }
+      if (entry.dtype == kWeightsDTypeBytes) {
+        if (entry.rank != 1 || entry.dims[0] < 0 || (uint32_t)entry.dims[0] != entry.nbytes) {
+          weights.clear();
+          return false;
+        }
+        continue;
+      }
+      MShape sizes;
+      uint64_t count = 1;
+      for (int d = 0; d < entry.rank; d++) {
+        if (entry.dims[d] <= 0) {
+          weights.clear();
+          return false;
+        }
+        sizes.push_back(entry.dims[d]);
+        count *= (uint64_t)entry.dims[d];
+      }
+      const size_t element_size = entry.dtype == kWeightsDTypeFloat32 ? sizeof(float) : sizeof(uint16_t);
+      if (count * element_size != entry.nbytes) {
+        weights.clear();
+        return false;
+      }
+      if (entry.dtype == kWeightsDTypeFloat32) {
+        weights[std::string(entry.name)] = MTensor::Borrow(sizes, bytes + entry.offset, owner);
+        continue;
+      }
+      MTensor tensor(sizes);
+      float *tensor_data = tensor.mutable_data();
+      const char *half = bytes + entry.offset;
+      for (uint64_t k = 0; k < count; k++) {
+        uint16_t h;
+        memcpy(&h, half + k * sizeof(uint16_t), sizeof(h));
+        tensor_data[k] = entry.dtype == kWeightsDTypeFloat16 ? kernels::fp16_to_fp32(h) : kernels::bf16_to_fp32(h);
+      }
+      weights[std::string(entry.name)] = tensor;
+    }
+    return true;
+  }
+
+  /*
+   Copies the section called name of a container into section, returns false if there is none. The
+   checksum is not verified again, parse the container with MParseWeights first.
+   */
+  static inline bool MFindWeightsSection(const void *data, size_t length, const std::string &name, std::vector<char> &section)
+  {
+    section.clear();
+    if (!MIsWeightsContainer(data, length)) {
+      return false;
+    }
+    const char *bytes = static_cast<const char *>(data);
+    MWeightsHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    if (header.file_size != length || header.tensor_count > (length - sizeof(header)) / sizeof(MWeightsEntry)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < header.tensor_count; i++) {
+      MWeightsEntry entry;
+      memcpy(&entry, bytes + sizeof(header) + i * sizeof(MWeightsEntry), sizeof(entry));
+      if (entry.dtype != kWeightsDTypeBytes
+          || entry.name[sizeof(entry.name) - 1] != '\0'
+          || name != entry.name) {
+        continue;
+      }
+      if (entry.offset < sizeof(header) + (uint64_t)header.tensor_count * sizeof(MWeightsEntry)
+          || entry.offset > length
+          || entry.nbytes > length - entry.offset) {
+        return false;
+      }
+      section.assign(bytes + entry.offset, bytes + entry.offset + entry.nbytes);
+      return true;
+    }
+    return false;
+  }
+
+  /*
+   Writes weights, and optionally sections of raw bytes, as a container, e.g. to convert weights parsed
+   from the legacy format. With one of the half precision storage flags, the tensors are also written in
+   that precision, rounded to nearest even. Returns an empty buffer if a tensor cannot be represented.
+   */
+  static inline std::vector<char> MSerializeWeights(const std::unordered_map<std::string, MTensor> &weights,
+                                                    uint32_t flags = 0,
+                                                    const std::unordered_map<std::string, std::vector<char>> &sections = {})
+  {
+    MWeightsDType dtype = kWeightsDTypeFloat32;
+    if (flags & kWeightsFlagBFloat16Storage) {
+      dtype = kWeightsDTypeBFloat16;
+    } else if (flags & kWeightsFlagFloat16Storage) {
+      dtype = kWeightsDTypeFloat16;
+    }
+    const size_t element_size = dtype == kWeightsDTypeFloat32 ? sizeof(float) : sizeof(uint16_t);
+
+    std::vector<std::string> names;
+    for (const auto &entry : weights) {
+      names.push_back(entry.first);
+    }
+    for (const auto &entry : sections) {
+      if (weights.count(entry.first)) {
+        return std::vector<char>();
+      }
+      names.push_back(entry.first);
+    }
+    std::sort(names.begin(), names.end());
+
+    MWeightsHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kWeightsMagic;
+    header.version = kWeightsVersion;
+    header.tensor_count = (uint32_t)names.size();
+    header.flags = flags;
+
+    std::vector<MWeightsEntry> entries(names.size());
+    uint64_t offset = sizeof(header) + names.size() * sizeof(MWeightsEntry);
+    for (size_t i = 0; i < names.size(); i++) {
+      MWeightsEntry &entry = entries[i];
+      memset(&entry, 0, sizeof(entry));
+      if (names[i].size() >= sizeof(entry.name)) {
+        return std::vector<char>();
+      }
+      memcpy(entry.name, names[i].c_str(), names[i].size());
+      auto section = sections.find(names[i]);
+      if (section != sections.end()) {
+        entry.dtype = kWeightsDTypeBytes;
+        entry.layout = kWeightsLayoutRowMajor;
+        entry.rank = 1;
+        entry.dims[0] = (int32_t)section->second.size();
+        entry.nbytes = (uint32_t)section->second.size();
+        offset = (offset + kWeightsAlignment - 1) / kWeightsAlignment * kWeightsAlignment;
+        entry.offset = offset;
+        offset += entry.nbytes;
+        continue;
+      }
+      const MTensor &tensor = weights.at(names[i]);
+      if (tensor.sizes().empty()) {
+        return std::vector<char>();
+      }
+      entry.dtype = dtype;
+      entry.layout = kWeightsLayoutRowMajor;
+      entry.rank = (uint8_t)tensor.sizes().size();
+      for (int d = 0; d < tensor.sizes().size(); d++) {
+        entry.dims[d] = tensor.size(d);
+      }
+      entry.nbytes = (uint32_t)((size_t)tensor.count() * element_size);
+      offset = (offset + kWeightsAlignment - 1) / kWeightsAlignment * kWeightsAlignment;
+      entry.offset = offset;
+      offset += entry.nbytes;
+    }
+    header.file_size = offset;
+
+    std::vector<char> blob((size_t)offset, 0);
+    memcpy(blob.data() + sizeof(header), entries.data(), entries.size() * sizeof(MWeightsEntry));
+    for (size_t i = 0; i < names.size(); i++) {
+      char *dst = blob.data() + entries[i].offset;
+      if (entries[i].dtype == kWeightsDTypeBytes) {
+        memcpy(dst, sections.at(names[i]).data(), entries[i].nbytes);
+        continue;
+      }
+      const MTensor &tensor = weights.at(names[i]);
+      if (dtype == kWeightsDTypeFloat32) {
+        memcpy(dst, tensor.data(), entries[i].nbytes);
+        continue;
+      }
+      for (int k = 0; k < tensor.count(); k++) {
+        const uint16_t h = dtype == kWeightsDTypeFloat16 ? kernels::fp32_to_fp16(tensor.data()[k]) : kernels::fp32_to_bf16(tensor.data()[k]);
+        memcpy(dst + k * sizeof(uint16_t), &h, sizeof(h));
+      }
+    }
+    header.crc32 = MCrc32(blob.data() + sizeof(header), blob.size() - sizeof(header));
+    memcpy(blob.data(), &header, sizeof(header));
+    return blob;
+  }
+}
+
+#endif
+
+#endif /* FBSDKModelWeights_hpp */
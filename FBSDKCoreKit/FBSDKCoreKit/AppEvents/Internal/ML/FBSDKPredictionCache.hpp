@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef FBSDKPredictionCache_hpp
+#define FBSDKPredictionCache_hpp
+
+#if !TARGET_OS_TV
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace fbsdk {
+  // 64-bit FNV-1a of data[0..n)
+  static inline uint64_t MHashBytes(const void *data, size_t n)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < n; i++) {
+      h = (h ^ bytes[i]) * 0x100000001B3ULL;
+    }
+    return h;
+  }
+
+  // MHashBytes of the bytes of df[0..n), 0 for no dense features
+  static inline uint64_t MHashDenseFeatures(const float *df, int n)
+  {
+    if (!df) {
+      return 0;
+    }
+    return MHashBytes(df, (size_t)n * sizeof(float));
+  }
+
+  /*
+   A prediction is determined by the task, the model that ran it, the normalized text and the dense
+   features. The text hash only picks the bucket; keys compare the text itself, so that two texts whose
+   hashes collide never share a prediction. The dense features are keyed by their hash.
+   */
+  struct MPredictionKey {
+    std::string task;
+    uint64_t model_version;
+    uint64_t text_hash;
+    uint64_t dense_hash;
+    std::string text;
+
+    void SetText(const char *text_bytes)
+    {
+      text.assign(text_bytes);
+      text_hash = MHashBytes(text.data(), text.size());
+    }
+
+    bool operator==(const MPredictionKey &other) const
+    {
+      return model_version == other.model_version
+      && text_hash == other.text_hash
+      && dense_hash == other.dense_hash
+      && task == other.task
+      && text == other.text;
+    }
+  };
+
+  struct MPredictionKeyHash {
+    size_t operator()(const MPredictionKey &key) const
+    {
+      size_t h = (size_t)key.text_hash;
+      h = h * 31 + std::hash<std::string>()(key.task);
+      h = h * 31 + (size_t)(key.model_version ^ (key.dense_hash * 0x9E3779B97F4A7C15ULL));
+      return h;
+    }
+  };
+
+  /*
+   Thread-safe LRU cache of softmax outputs. Entries are evicted, least recently used first, once their
+   estimated memory exceeds max_bytes. Keys carry the model version, so entries of a replaced model are
+   never returned; Clear() releases them.
+   */
+  class MPredictionCache {
+  public:
+    explicit MPredictionCache(size_t max_bytes) :
+      max_bytes_(max_bytes),
+      bytes_(0),
+      hits_(0),
+      misses_(0) {};
+
+    // Copies the cached probabilities of key into probs and marks the entry as most recently used
+    bool Lookup(const MPredictionKey &key, std::vector<float> &probs)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = index_.find(key);
+      if (it == index_.end()) {
+        misses_++;
+        return false;
+      }
+      entries_.splice(entries_.begin(), entries_, it->second);
+      probs = it->second->second;
+      hits_++;
+      return true;
+    }
+
+    void Insert(const MPredictionKey &key, const float *probs, int n)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = index_.find(key);
+      if (it != index_.end()) {
+        bytes_ -= EntryBytes(it->first, it->second->second.size());
+        entries_.erase(it->second);
+        index_.erase(it);
+      }
+      const size_t nbytes = EntryBytes(key, (size_t)n);
+      if (nbytes > max_bytes_) {
+        return;
+      }
+      while (bytes_ + nbytes > max_bytes_ && !entries_.empty()) {
+        const Entry &last = entries_.back();
+        bytes_ -= EntryBytes(last.first, last.second.size());
+        index_.erase(last.first);
+        entries_.pop_back();
+      }
+      entries_.emplace_front(key, std::vector<float>(probs, probs + n));
+      index_[key] = entries_.begin();
+      bytes_ += nbytes;
+    }
+
+    void Clear()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      entries_.clear();
+      index_.clear();
+      bytes_ = 0;
+    }
+
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return entries_.size();
+    }
+
+    size_t bytes() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return bytes_;
+    }
+
+    uint64_t hits() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return hits_;
+    }
+
+    uint64_t misses() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return misses_;
+    }
+
+  private:
+    typedef std::pair<MPredictionKey, std::vector<float>> Entry;
+
+    // the key, text included, is held by both the list and the index, plus a rough allowance for node
+    // overhead
+    static size_t EntryBytes(const MPredictionKey &key, size_t n_probs)
+    {
+      return 2 * (sizeof(MPredictionKey) + key.task.size() + key.text.size()) + n_probs * sizeof(float) + 64;
+    }
+
+    size_t max_bytes_;
+    size_t bytes_;
+    uint64_t hits_;
+    uint64_t misses_;
+    std::list<Entry> entries_;
+    std::unordered_map<MPredictionKey, std::list<Entry>::iterator, MPredictionKeyHash> index_;
+    mutable std::mutex mutex_;
+  };
+}
+
+#endif
+
+#endif /* FBSDKPredictionCache_hpp */
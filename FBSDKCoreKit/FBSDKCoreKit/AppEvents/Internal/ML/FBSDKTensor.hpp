@@ -6,11 +6,16 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#ifndef FBSDKTensor_hpp
+#define FBSDKTensor_hpp
+
 #if !TARGET_OS_TV
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <initializer_list>
 #include <iostream>
 #include <memory>
 #include <unordered_map>
@@ -18,8 +23,9 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 
-#import <Accelerate/Accelerate.h>
+#include "FBSDKModelProfiler.hpp"
 
 // minimal aten implementation
 #define MAT_ALWAYS_INLINE inline __attribute__((always_inline))
@@ -37,6 +43,7 @@ namespace fbsdk {
     (void)ret;
     assert(ret == 0);
   #endif
+    FBSDK_ML_PROFILE_ALLOCATION(nbytes);
     return ptr;
   }
 
@@ -47,48 +54,163 @@ namespace fbsdk {
     }
   }
 
+  /*
+   Sizes or strides of a tensor of rank up to kMaxRank. The dims are stored inline, so creating,
+   copying and reshaping a tensor does not allocate.
+   */
+  class MShape {
+  public:
+    enum { kMaxRank = 4 };
+
+    MShape() :
+      rank_(0) {};
+    MShape(std::initializer_list<int> dims)
+    {
+      Assign(dims.begin(), (int)dims.size());
+    }
+
+    MShape(const std::vector<int> &dims)
+    {
+      Assign(dims.data(), (int)dims.size());
+    }
+
+    MAT_ALWAYS_INLINE int size() const
+    {
+      return rank_;
+    }
+
+    MAT_ALWAYS_INLINE bool empty() const
+    {
+      return rank_ == 0;
+    }
+
+    // Number of elements of a tensor of this shape
+    MAT_ALWAYS_INLINE int count() const
+    {
+      int count = 1;
+      for (int i = 0; i < rank_; i++) {
+        count *= dims_[i];
+      }
+      return count;
+    }
+
+    MAT_ALWAYS_INLINE int operator[](int i) const
+    {
+      return dims_[i];
+    }
+
+    MAT_ALWAYS_INLINE int &operator[](int i)
+    {
+      return dims_[i];
+    }
+
+    MAT_ALWAYS_INLINE const int *begin() const
+    {
+      return dims_;
+    }
+
+    MAT_ALWAYS_INLINE const int *end() const
+    {
+      return dims_ + rank_;
+    }
+
+    MAT_ALWAYS_INLINE void push_back(int dim)
+    {
+      assert(rank_ < kMaxRank);
+      dims_[rank_++] = dim;
+    }
+
+    bool operator==(const MShape &other) const
+    {
+      if (rank_ != other.rank_) {
+        return false;
+      }
+      for (int i = 0; i < rank_; i++) {
+        if (dims_[i] != other.dims_[i]) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool operator!=(const MShape &other) const
+    {
+      return !(*this == other);
+    }
+
+  private:
+    void Assign(const int *dims, int rank)
+    {
+      assert(rank <= kMaxRank);
+      rank_ = rank < kMaxRank ? rank : kMaxRank;
+      for (int i = 0; i < rank_; i++) {
+        dims_[i] = dims[i];
+      }
+    }
+
+    int dims_[kMaxRank];
+    int rank_;
+  };
+
+  class MTensorView;
+
   class MTensor {
   public:
     MTensor() :
-      storage_(nullptr),
+      count_(0),
+      capacity_(0),
       sizes_(),
       strides_(),
-      capacity_(0) {};
-    explicit MTensor(const std::vector<int> &sizes)
+      storage_(nullptr) {};
+    explicit MTensor(const MShape &sizes)
     {
-      std::vector<int> strides = std::vector<int>(sizes.size());
-      strides[strides.size() - 1] = 1;
-      for (int i = static_cast<int32_t>(strides.size()) - 2; i >= 0; --i) {
-        strides[i] = strides[i + 1] * sizes[i + 1];
-      }
-      strides_ = strides;
-      sizes_ = sizes;
-      capacity_ = 1;
-      for (int size : sizes) {
-        capacity_ *= size;
-      }
+      capacity_ = InitSizes(sizes);
       storage_ = std::shared_ptr<void>(MAllocateMemory((size_t)capacity_ * sizeof(float)), MFreeMemory);
     }
 
+    // Uses storage owned elsewhere, e.g. a slice of an MTensorArena, which must hold at least
+    // count() floats. The tensor keeps the storage alive.
+    MTensor(const MShape &sizes, const std::shared_ptr<void> &storage)
+    {
+      capacity_ = InitSizes(sizes);
+      storage_ = storage;
+    }
+
+    /*
+     Points into memory owned by owner, e.g. a memory mapped weights file, instead of copying it. The
+     tensor shares ownership of owner; pass an empty owner to borrow memory that outlives the tensor.
+     Borrowed storage is read-only. Data that is not aligned for float access is copied.
+     */
+    static MTensor Borrow(const MShape &sizes, const void *data, const std::shared_ptr<void> &owner)
+    {
+      if (reinterpret_cast<uintptr_t>(data) % alignof(float) != 0) {
+        MTensor tensor(sizes);
+        memcpy(tensor.mutable_data(), data, (size_t)tensor.count() * sizeof(float));
+        return tensor;
+      }
+      // aliasing constructor: shares owner's control block, or none if owner is empty
+      return MTensor(sizes, std::shared_ptr<void>(owner, const_cast<void *>(data)));
+    }
+
     MAT_ALWAYS_INLINE int count() const
     {
-      return capacity_;
+      return count_;
     }
 
     MAT_ALWAYS_INLINE int size(int dim) const
     {
-      if (dim < 0 || dim >= (int)sizes_.size()) {
+      if (dim < 0 || dim >= sizes_.size()) {
         return 0;
       }
       return sizes_[dim];
     }
 
-    MAT_ALWAYS_INLINE const std::vector<int> &sizes() const
+    MAT_ALWAYS_INLINE const MShape &sizes() const
     {
       return sizes_;
     }
 
-    MAT_ALWAYS_INLINE const std::vector<int> &strides() const
+    MAT_ALWAYS_INLINE const MShape &strides() const
     {
       return strides_;
     }
@@ -103,25 +225,565 @@ namespace fbsdk {
       return static_cast<float *>(storage_.get());
     }
 
-    MAT_ALWAYS_INLINE void Reshape(const std::vector<int> &sizes)
+    MAT_ALWAYS_INLINE void Reshape(const MShape &sizes)
     {
-      int count = 1;
-      for (int i = 0; i < sizes.size(); i++) {
-        count *= sizes[i];
-      }
+      int count = InitSizes(sizes);
       if (count > capacity_) {
         capacity_ = count;
         storage_.reset(MAllocateMemory((size_t)capacity_ * sizeof(float)), MFreeMemory);
       }
-      sizes_ = sizes;
     }
 
+    MAT_ALWAYS_INLINE MTensorView view() const;
+
+    // The index-th entry along the first dimension, e.g. one example of a batch
+    MAT_ALWAYS_INLINE MTensorView Slice(int index) const;
+
   private:
+    // Sets sizes and contiguous row-major strides, returns the element count
+    int InitSizes(const MShape &sizes)
+    {
+      sizes_ = sizes;
+      strides_ = sizes;
+      int stride = 1;
+      for (int i = sizes.size() - 1; i >= 0; --i) {
+        strides_[i] = stride;
+        stride *= sizes[i];
+      }
+      count_ = stride;
+      return count_;
+    }
+
+    int count_;
     int capacity_;
-    std::vector<int> sizes_;
-    std::vector<int> strides_;
+    MShape sizes_;
+    MShape strides_;
+    std::shared_ptr<void> storage_;
+  };
+
+  /*
+   Non-owning, read-only view of a tensor or a slice of one. It does not keep the storage alive, so
+   it must not outlive the tensor it was taken from.
+   */
+  class MTensorView {
+  public:
+    MTensorView() :
+      data_(nullptr) {};
+    MTensorView(const float *data, const MShape &sizes, const MShape &strides) :
+      data_(data),
+      sizes_(sizes),
+      strides_(strides) {};
+
+    MAT_ALWAYS_INLINE int count() const
+    {
+      if (!data_) {
+        return 0;
+      }
+      int count = 1;
+      for (int size : sizes_) {
+        count *= size;
+      }
+      return count;
+    }
+
+    MAT_ALWAYS_INLINE int size(int dim) const
+    {
+      if (dim < 0 || dim >= sizes_.size()) {
+        return 0;
+      }
+      return sizes_[dim];
+    }
+
+    MAT_ALWAYS_INLINE const MShape &sizes() const
+    {
+      return sizes_;
+    }
+
+    MAT_ALWAYS_INLINE const MShape &strides() const
+    {
+      return strides_;
+    }
+
+    MAT_ALWAYS_INLINE const float *data() const
+    {
+      return data_;
+    }
+
+    MAT_ALWAYS_INLINE MTensorView Slice(int index) const
+    {
+      MShape sizes;
+      MShape strides;
+      for (int i = 1; i < sizes_.size(); i++) {
+        sizes.push_back(sizes_[i]);
+        strides.push_back(strides_[i]);
+      }
+      return MTensorView(data_ + (size_t)index * (size_t)strides_[0], sizes, strides);
+    }
+
+  private:
+    const float *data_;
+    MShape sizes_;
+    MShape strides_;
+  };
+
+  MAT_ALWAYS_INLINE MTensorView MTensor::view() const
+  {
+    return MTensorView(data(), sizes_, strides_);
+  }
+
+  MAT_ALWAYS_INLINE MTensorView MTensor::Slice(int index) const
+  {
+    return view().Slice(index);
+  }
+
+  /*
+   int8 tensor for quantized inference. A weight in kernel layout carries one symmetric scale per entry
+   of its last dimension, i.e. per output channel: value = data[..., j] * scales[j]. Activations are
+   quantized on the fly with a scale per example and carry no scales.
+   */
+  class MQuantizedTensor {
+  public:
+    MQuantizedTensor() :
+      count_(0) {};
+    explicit MQuantizedTensor(const MShape &sizes) :
+      sizes_(sizes),
+      count_(sizes.count())
+    {
+      storage_ = std::shared_ptr<void>(MAllocateMemory((size_t)count_), MFreeMemory);
+    }
+
+    MQuantizedTensor(const MShape &sizes, const std::shared_ptr<void> &storage) :
+      sizes_(sizes),
+      count_(sizes.count()),
+      storage_(storage) {};
+
+    MAT_ALWAYS_INLINE int count() const
+    {
+      return count_;
+    }
+
+    MAT_ALWAYS_INLINE int size(int dim) const
+    {
+      if (dim < 0 || dim >= sizes_.size()) {
+        return 0;
+      }
+      return sizes_[dim];
+    }
+
+    MAT_ALWAYS_INLINE const MShape &sizes() const
+    {
+      return sizes_;
+    }
+
+    MAT_ALWAYS_INLINE const int8_t *data() const
+    {
+      return static_cast<const int8_t *>(storage_.get());
+    }
+
+    MAT_ALWAYS_INLINE int8_t *mutable_data()
+    {
+      return static_cast<int8_t *>(storage_.get());
+    }
+
+    MAT_ALWAYS_INLINE const MTensor &scales() const
+    {
+      return scales_;
+    }
+
+    MAT_ALWAYS_INLINE MTensor &mutable_scales()
+    {
+      return scales_;
+    }
+
+  private:
+    MShape sizes_;
+    int count_;
     std::shared_ptr<void> storage_;
+    MTensor scales_;
   };
+
+  enum MHalfType {
+    kHalfFloat16, // IEEE 754 binary16
+    kHalfBFloat16, // the upper 16 bits of a float
+  };
+
+  /*
+   16-bit floating point tensor for weights kept in half precision. The kernels widen it to float as
+   it is loaded, see kernels::gemm_widening.
+   */
+  class MHalfTensor {
+  public:
+    MHalfTensor() :
+      count_(0),
+      type_(kHalfFloat16) {};
+    MHalfTensor(const MShape &sizes, MHalfType type) :
+      sizes_(sizes),
+      count_(sizes.count()),
+      type_(type)
+    {
+      storage_ = std::shared_ptr<void>(MAllocateMemory((size_t)count_ * sizeof(uint16_t)), MFreeMemory);
+    }
+
+    MAT_ALWAYS_INLINE int count() const
+    {
+      return count_;
+    }
+
+    MAT_ALWAYS_INLINE int size(int dim) const
+    {
+      if (dim < 0 || dim >= sizes_.size()) {
+        return 0;
+      }
+      return sizes_[dim];
+    }
+
+    MAT_ALWAYS_INLINE const MShape &sizes() const
+    {
+      return sizes_;
+    }
+
+    MAT_ALWAYS_INLINE MHalfType type() const
+    {
+      return type_;
+    }
+
+    MAT_ALWAYS_INLINE const uint16_t *data() const
+    {
+      return static_cast<const uint16_t *>(storage_.get());
+    }
+
+    MAT_ALWAYS_INLINE uint16_t *mutable_data()
+    {
+      return static_cast<uint16_t *>(storage_.get());
+    }
+
+  private:
+    MShape sizes_;
+    int count_;
+    MHalfType type_;
+    std::shared_ptr<void> storage_;
+  };
+
+  /*
+   Weight of shape (rows, cols) in block compressed sparse row format, for pruned layers. The nonzero
+   weights of a row come in blocks of block_size consecutive columns; block q holds
+   values[q * block_size, (q + 1) * block_size) starting at column block_cols[q], and the blocks of row p
+   are row_offsets[p] .. row_offsets[p + 1] - 1. Blocks of zeros are not stored. The values are floats, or
+   half_values() of type() for a half precision copy, which shares the block indices of its source.
+   */
+  class MBlockSparseTensor {
+  public:
+    MBlockSparseTensor() :
+      block_size_(0),
+      n_blocks_(0),
+      half_precision_(false),
+      type_(kHalfFloat16) {};
+    MBlockSparseTensor(const MShape &sizes, int block_size, int n_blocks) :
+      sizes_(sizes),
+      block_size_(block_size),
+      n_blocks_(n_blocks),
+      half_precision_(false),
+      type_(kHalfFloat16)
+    {
+      row_offsets_ = std::shared_ptr<void>(MAllocateMemory((size_t)(sizes[0] + 1) * sizeof(int)), MFreeMemory);
+      block_cols_ = std::shared_ptr<void>(MAllocateMemory((size_t)n_blocks * sizeof(int)), MFreeMemory);
+      values_ = std::shared_ptr<void>(MAllocateMemory((size_t)n_blocks * block_size * sizeof(float)), MFreeMemory);
+    }
+
+    // the blocks of blocks with uninitialized values of type
+    MBlockSparseTensor(const MBlockSparseTensor &blocks, MHalfType type) :
+      sizes_(blocks.sizes_),
+      block_size_(blocks.block_size_),
+      n_blocks_(blocks.n_blocks_),
+      half_precision_(true),
+      type_(type),
+      row_offsets_(blocks.row_offsets_),
+      block_cols_(blocks.block_cols_)
+    {
+      values_ = std::shared_ptr<void>(MAllocateMemory((size_t)n_blocks_ * block_size_ * sizeof(uint16_t)), MFreeMemory);
+    }
+
+    MAT_ALWAYS_INLINE bool empty() const
+    {
+      return block_size_ == 0;
+    }
+
+    // stored weights, including the zeros inside blocks
+    MAT_ALWAYS_INLINE int count() const
+    {
+      return n_blocks_ * block_size_;
+    }
+
+    MAT_ALWAYS_INLINE int size(int dim) const
+    {
+      if (dim < 0 || dim >= sizes_.size()) {
+        return 0;
+      }
+      return sizes_[dim];
+    }
+
+    MAT_ALWAYS_INLINE const MShape &sizes() const
+    {
+      return sizes_;
+    }
+
+    MAT_ALWAYS_INLINE int block_size() const
+    {
+      return block_size_;
+    }
+
+    MAT_ALWAYS_INLINE int n_blocks() const
+    {
+      return n_blocks_;
+    }
+
+    MAT_ALWAYS_INLINE bool half_precision() const
+    {
+      return half_precision_;
+    }
+
+    MAT_ALWAYS_INLINE MHalfType type() const
+    {
+      return type_;
+    }
+
+    MAT_ALWAYS_INLINE const int *row_offsets() const
+    {
+      return static_cast<const int *>(row_offsets_.get());
+    }
+
+    MAT_ALWAYS_INLINE int *mutable_row_offsets()
+    {
+      return static_cast<int *>(row_offsets_.get());
+    }
+
+    MAT_ALWAYS_INLINE const int *block_cols() const
+    {
+      return static_cast<const int *>(block_cols_.get());
+    }
+
+    MAT_ALWAYS_INLINE int *mutable_block_cols()
+    {
+      return static_cast<int *>(block_cols_.get());
+    }
+
+    MAT_ALWAYS_INLINE const float *values() const
+    {
+      return static_cast<const float *>(values_.get());
+    }
+
+    MAT_ALWAYS_INLINE float *mutable_values()
+    {
+      return static_cast<float *>(values_.get());
+    }
+
+    MAT_ALWAYS_INLINE const uint16_t *half_values() const
+    {
+      return static_cast<const uint16_t *>(values_.get());
+    }
+
+    MAT_ALWAYS_INLINE uint16_t *mutable_half_values()
+    {
+      return static_cast<uint16_t *>(values_.get());
+    }
+
+  private:
+    MShape sizes_;
+    int block_size_;
+    int n_blocks_;
+    bool half_precision_;
+    MHalfType type_;
+    std::shared_ptr<void> row_offsets_;
+    std::shared_ptr<void> block_cols_;
+    std::shared_ptr<void> values_;
+  };
+
+  /*
+   Bump allocator that hands out 64-byte aligned tensors from one reusable buffer, so that the
+   intermediates of a prediction do not each go through MAllocateMemory. Tensors share ownership
+   of the buffer, but their memory is handed out again after Reset(). Not thread-safe; use one
+   arena per thread.
+
+   The first bytes of the buffer can be set aside for tensors placed by an MBufferPlan, which share
+   memory with the tensors that are dead by the time they are written.
+   */
+  class MTensorArena {
+  public:
+    MTensorArena() :
+      capacity_(0),
+      offset_(0),
+      overflow_(0),
+      planned_(0),
+      place_(kNoPlacement) {};
+
+    /*
+     Makes sure the next round of allocations up to nbytes is served from a single buffer. Its first
+     planned bytes are only handed out through PlaceNext.
+     */
+    void Reserve(size_t nbytes, size_t planned = 0)
+    {
+      if (nbytes > capacity_) {
+        capacity_ = AlignedSize(nbytes);
+        buffer_ = std::shared_ptr<void>(MAllocateMemory(capacity_), MFreeMemory);
+      }
+      planned_ = std::min(AlignedSize(planned), capacity_);
+      offset_ = planned_;
+      overflow_ = 0;
+      place_ = kNoPlacement;
+    }
+
+    // Hands out the whole buffer again. If the previous round did not fit, the buffer is grown so the
+    // next round does.
+    void Reset()
+    {
+      Reserve(offset_ + overflow_);
+    }
+
+    // Makes the next Allocate return the planned memory at offset, which must be 64-byte aligned
+    void PlaceNext(size_t offset)
+    {
+      place_ = offset;
+    }
+
+    MTensor Allocate(const MShape &sizes)
+    {
+      const size_t nbytes = (size_t)sizes.count() * sizeof(float);
+      const size_t place = place_;
+      place_ = kNoPlacement;
+      if (place != kNoPlacement && place + nbytes <= planned_) {
+        return MTensor(sizes, std::shared_ptr<void>(buffer_, static_cast<char *>(buffer_.get()) + place));
+      }
+      const std::shared_ptr<void> &slice = Take(nbytes);
+      return slice ? MTensor(sizes, slice) : MTensor(sizes);
+    }
+
+    MQuantizedTensor AllocateQuantized(const MShape &sizes)
+    {
+      const std::shared_ptr<void> &slice = Take((size_t)sizes.count());
+      return slice ? MQuantizedTensor(sizes, slice) : MQuantizedTensor(sizes);
+    }
+
+    size_t capacity() const
+    {
+      return capacity_;
+    }
+
+    size_t used() const
+    {
+      return offset_;
+    }
+
+    static size_t AlignedSize(size_t nbytes)
+    {
+      return (nbytes + 63) & ~(size_t)63;
+    }
+
+  private:
+    // Returns the next nbytes of the buffer, or null if they do not fit
+    std::shared_ptr<void> Take(size_t nbytes)
+    {
+      nbytes = AlignedSize(nbytes);
+      if (offset_ + nbytes > capacity_) {
+        overflow_ += nbytes;
+        return nullptr;
+      }
+      // aliasing constructor: shares the buffer's control block instead of allocating one
+      std::shared_ptr<void> slice(buffer_, static_cast<char *>(buffer_.get()) + offset_);
+      offset_ += nbytes;
+      return slice;
+    }
+
+    static const size_t kNoPlacement = (size_t)-1;
+
+    std::shared_ptr<void> buffer_;
+    size_t capacity_;
+    size_t offset_;
+    size_t overflow_;
+    size_t planned_;
+    size_t place_;
+  };
+
+  static inline MTensor MAllocateTensor(const MShape &sizes, MTensorArena *arena)
+  {
+    return arena ? arena->Allocate(sizes) : MTensor(sizes);
+  }
+
+  static inline MQuantizedTensor MAllocateQuantizedTensor(const MShape &sizes, MTensorArena *arena)
+  {
+    return arena ? arena->AllocateQuantized(sizes) : MQuantizedTensor(sizes);
+  }
+
+  // A tensor of a computation: its size, the step that writes it and the last step that reads it
+  struct MBufferLifetime {
+    size_t size;
+    int first;
+    int last;
+  };
+
+  /*
+   Offsets at which tensors whose lifetimes do not overlap share memory. peak is the memory they need
+   together, i.e. the peak working set of the computation, and total what they would need without reuse.
+   */
+  struct MBufferPlan {
+    std::vector<size_t> offsets;
+    size_t peak = 0;
+    size_t total = 0;
+  };
+
+  /*
+   Greedy by size: the largest tensors are placed first, each at the lowest offset where it does not
+   overlap a placed tensor that is alive at the same time. Sizes are rounded up to multiples of align.
+   */
+  static inline MBufferPlan MPlanBuffers(const std::vector<MBufferLifetime> &buffers, const size_t align = 1)
+  {
+    MBufferPlan plan;
+    std::vector<size_t> sizes(buffers.size());
+    std::vector<int> order(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+      sizes[i] = (buffers[i].size + align - 1) / align * align;
+      order[i] = (int)i;
+      plan.total += sizes[i];
+    }
+    std::stable_sort(order.begin(), order.end(), [&sizes](int a, int b) {
+      return sizes[a] > sizes[b];
+    });
+
+    plan.offsets.assign(buffers.size(), 0);
+    std::vector<int> placed;
+    for (int i : order) {
+      // ranges of the placed tensors alive together with i, by offset
+      std::vector<std::pair<size_t, size_t>> taken;
+      for (int j : placed) {
+        if (buffers[j].first <= buffers[i].last && buffers[i].first <= buffers[j].last) {
+          taken.push_back(std::make_pair(plan.offsets[j], plan.offsets[j] + sizes[j]));
+        }
+      }
+      std::sort(taken.begin(), taken.end());
+      size_t offset = 0;
+      for (const auto &range : taken) {
+        if (range.first >= offset + sizes[i]) {
+          break;
+        }
+        offset = std::max(offset, range.second);
+      }
+      plan.offsets[i] = offset;
+      plan.peak = std::max(plan.peak, offset + sizes[i]);
+      if (sizes[i] > 0) {
+        placed.push_back(i);
+      }
+    }
+    return plan;
+  }
+
+  // Makes the next tensor allocated from arena, if any, buffer of plan, whose sizes are floats per example
+  static inline void MPlaceNextTensor(MTensorArena *arena, const MBufferPlan &plan, const int buffer, const int n_examples)
+  {
+    if (arena) {
+      arena->PlaceNext((size_t)n_examples * plan.offsets[buffer] * sizeof(float));
+    }
+  }
 }
 
 #endif
+
+#endif /* FBSDKTensor_hpp */
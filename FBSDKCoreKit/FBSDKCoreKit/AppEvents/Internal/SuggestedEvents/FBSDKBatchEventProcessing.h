@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#if !TARGET_OS_TV
+
+#import <FBSDKCoreKit/FBSDKEventProcessing.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Event processors that can predict many suggested events in one pass, see FBSDKSuggestedEventsInferenceQueue
+NS_SWIFT_NAME(BatchEventProcessing)
+@protocol FBSDKBatchEventProcessing <FBSDKEventProcessing>
+
+/// Batched variant of `processSuggestedEvents:denseData:`, returns one event per text feature in the same order.
+/// denseData holds textFeatures.count rows of dense features; without it every event is other.
+- (NSArray<NSString *> *)processSuggestedEventsForTextFeatures:(NSArray<NSString *> *)textFeatures
+                                                     denseData:(nullable float *)denseData;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+#endif
@@ -20,6 +20,7 @@
 #import "FBSDKMLMacros.h"
 #import "FBSDKModelUtility.h"
 #import "FBSDKServerConfiguration.h"
+#import "FBSDKSuggestedEventsInferenceQueue.h"
 #import "FBSDKViewHierarchy.h"
 #import "FBSDKViewHierarchyMacros.h"
 
@@ -40,6 +41,7 @@ NSString *const UnconfirmedEvents = @"eligible_for_prediction_events";
 @property (nonatomic, readonly) NSMutableSet<NSString *> *optInEvents;
 @property (nonatomic, readonly) NSMutableSet<NSString *> *unconfirmedEvents;
 @property (nonatomic, readonly, weak) id<FBSDKEventProcessing> eventProcessor;
+@property (nonatomic, readonly) FBSDKSuggestedEventsInferenceQueue *inferenceQueue;
 
 @end
 
@@ -63,6 +65,8 @@ NSString *const UnconfirmedEvents = @"eligible_for_prediction_events";
     _eventLogger = eventLogger;
     _featureExtractor = featureExtractor;
     _eventProcessor = eventProcessor;
+    _inferenceQueue = [[FBSDKSuggestedEventsInferenceQueue alloc] initWithEventProcessor:eventProcessor
+                                                                        featureExtractor:featureExtractor];
   }
   return self;
 }
@@ -240,30 +244,22 @@ static dispatch_once_t setupNonce;
     [FBSDKTypeUtility dictionary:viewTree setObject:screenName ?: @"" forKey:VIEW_HIERARCHY_SCREEN_NAME_KEY];
 
     __weak typeof(self) weakSelf = self;
-    dispatch_block_t predictAndLogBlock = ^{
-      NSMutableDictionary<NSString *, id> *viewTreeCopy = viewTree.mutableCopy;
-      float *denseData = [weakSelf.featureExtractor getDenseFeatures:viewTree];
-      NSString *textFeature = [FBSDKModelUtility normalizedText:[weakSelf.featureExtractor getTextFeature:text withScreenName:viewTreeCopy[@"screenname"]]];
-      NSString *event = [weakSelf.eventProcessor processSuggestedEvents:textFeature denseData:denseData];
-      if (!event || [event isEqualToString:SUGGESTED_EVENT_OTHER]) {
-        return;
-      }
-      if ([weakSelf.optInEvents containsObject:event]) {
-        [weakSelf.eventLogger logEvent:event
-                            parameters:@{@"_is_suggested_event" : @"1",
-                                         @"_button_text" : text}];
-      } else if ([weakSelf.unconfirmedEvents containsObject:event] && denseData) {
-        // Only send back not confirmed events to advertisers
-        [weakSelf logSuggestedEvent:event text:text denseFeature:[self getDenseFeaure:denseData] ?: @""];
-      }
-      free(denseData);
-    };
-
-  #if DEBUG
-    predictAndLogBlock();
-  #else
-    fb_dispatch_on_default_thread(predictAndLogBlock);
-  #endif
+    [self.inferenceQueue predictEventForText:text
+                                  screenName:screenName ?: @""
+                                    viewTree:viewTree
+                                  completion:^(NSString *event, float *denseData, NSTimeInterval latency) {
+                                    if (!event || [event isEqualToString:SUGGESTED_EVENT_OTHER]) {
+                                      return;
+                                    }
+                                    if ([weakSelf.optInEvents containsObject:event]) {
+                                      [weakSelf.eventLogger logEvent:event
+                                                          parameters:@{@"_is_suggested_event" : @"1",
+                                                                       @"_button_text" : text}];
+                                    } else if ([weakSelf.unconfirmedEvents containsObject:event] && denseData) {
+                                      // Only send back not confirmed events to advertisers
+                                      [weakSelf logSuggestedEvent:event text:text denseFeature:[weakSelf getDenseFeaure:denseData] ?: @""];
+                                    }
+                                  }];
   });
 }
 
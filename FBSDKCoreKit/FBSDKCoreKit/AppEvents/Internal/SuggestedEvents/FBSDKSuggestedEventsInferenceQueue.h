@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#if !TARGET_OS_TV
+
+#import <Foundation/Foundation.h>
+
+@protocol FBSDKEventProcessing;
+@protocol FBSDKFeatureExtracting;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// denseData is freed once the handler returns, latency is from the request to its prediction
+typedef void (^FBSDKSuggestedEventsPredictionHandler)(NSString *event, float *_Nullable denseData, NSTimeInterval latency)
+NS_SWIFT_NAME(SuggestedEventsPredictionHandler);
+
+/**
+ Runs suggested events predictions off the main thread. Taps on the same text and screen within a short
+ window are coalesced into one prediction, the oldest pending requests are dropped once the queue is full
+ and the rest are predicted together in one batch.
+ */
+NS_SWIFT_NAME(SuggestedEventsInferenceQueue)
+@interface FBSDKSuggestedEventsInferenceQueue : NSObject
+
++ (instancetype)new NS_UNAVAILABLE;
+- (instancetype)init NS_UNAVAILABLE;
+- (instancetype)initWithEventProcessor:(nullable id<FBSDKEventProcessing>)eventProcessor
+                      featureExtractor:(Class<FBSDKFeatureExtracting>)featureExtractor;
+
+/// The handler is not called for a request that was coalesced or dropped
+- (void)predictEventForText:(NSString *)text
+                 screenName:(NSString *)screenName
+                   viewTree:(NSDictionary<NSString *, id> *)viewTree
+                 completion:(FBSDKSuggestedEventsPredictionHandler)completion;
+
+/// Predicts all pending requests on the calling thread
+- (void)drain;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#if !TARGET_OS_TV
+
+#import "FBSDKSuggestedEventsInferenceQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#import <FBSDKCoreKit/FBSDKEventProcessing.h>
+#import <FBSDKCoreKit/FBSDKFeatureExtracting.h>
+#import <FBSDKCoreKit_Basics/FBSDKCoreKit_Basics.h>
+
+#import "FBSDKBatchEventProcessing.h"
+#import "FBSDKInferenceQueue.hpp"
+#import "FBSDKMLMacros.h"
+#import "FBSDKModelUtility.h"
+
+// taps on the same button within this window are one tap
+static const uint64_t kCoalesceWindowNs = 300 * 1000 * 1000ULL;
+// a burst larger than this is mostly stale by the time it is predicted
+static const size_t kMaxPendingRequests = 16;
+static const size_t kMaxBatchSize = 8;
+
+@class FBSDKSuggestedEventsPendingRequest;
+
+typedef fbsdk::MInferenceQueue<FBSDKSuggestedEventsPendingRequest *> FBSDKSuggestedEventsRequestQueue;
+
+static uint64_t FBSDKNowNs(void)
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+@interface FBSDKSuggestedEventsPendingRequest : NSObject
+
+@property (nonatomic, readonly, copy) NSString *text;
+@property (nonatomic, readonly, copy) NSString *screenName;
+@property (nonatomic, readonly) NSDictionary<NSString *, id> *viewTree;
+@property (nonatomic, readonly, copy) FBSDKSuggestedEventsPredictionHandler completion;
+
+@end
+
+@implementation FBSDKSuggestedEventsPendingRequest
+
+- (instancetype)initWithText:(NSString *)text
+                  screenName:(NSString *)screenName
+                    viewTree:(NSDictionary<NSString *, id> *)viewTree
+                  completion:(FBSDKSuggestedEventsPredictionHandler)completion
+{
+  if ((self = [super init])) {
+    _text = [text copy];
+    _screenName = [screenName copy];
+    _viewTree = viewTree;
+    _completion = [completion copy];
+  }
+  return self;
+}
+
+@end
+
+@interface FBSDKSuggestedEventsInferenceQueue ()
+
+@property (nullable, nonatomic, readonly, weak) id<FBSDKEventProcessing> eventProcessor;
+@property (nonatomic, readonly) Class<FBSDKFeatureExtracting> featureExtractor;
+
+@end
+
+@implementation FBSDKSuggestedEventsInferenceQueue
+{
+  std::unique_ptr<FBSDKSuggestedEventsRequestQueue> _queue;
+  std::atomic<bool> _drainScheduled;
+}
+
+- (instancetype)initWithEventProcessor:(nullable id<FBSDKEventProcessing>)eventProcessor
+                      featureExtractor:(Class<FBSDKFeatureExtracting>)featureExtractor
+{
+  if ((self = [super init])) {
+    _eventProcessor = eventProcessor;
+    _featureExtractor = featureExtractor;
+    _queue.reset(new FBSDKSuggestedEventsRequestQueue(kMaxPendingRequests, kCoalesceWindowNs));
+    _drainScheduled = false;
+  }
+  return self;
+}
+
+- (void)predictEventForText:(NSString *)text
+                 screenName:(NSString *)screenName
+                   viewTree:(NSDictionary<NSString *, id> *)viewTree
+                 completion:(FBSDKSuggestedEventsPredictionHandler)completion
+{
+  if (![self submitEventForText:text screenName:screenName viewTree:viewTree completion:completion]) {
+    return;
+  }
+#if DEBUG
+  [self drain];
+#else
+  // requests arriving until the drain runs share its batch
+  if (!_drainScheduled.exchange(true)) {
+    __weak typeof(self) weakSelf = self;
+    dispatch_after(
+      dispatch_time(DISPATCH_TIME_NOW, (int64_t)kCoalesceWindowNs),
+      dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+      ^{
+        [weakSelf drainScheduledRequests];
+      }
+    );
+  }
+#endif
+}
+
+// Queues a request without draining the queue, NO if it was coalesced into a pending one
+- (BOOL)submitEventForText:(NSString *)text
+                screenName:(NSString *)screenName
+                  viewTree:(NSDictionary<NSString *, id> *)viewTree
+                completion:(FBSDKSuggestedEventsPredictionHandler)completion
+{
+  FBSDKSuggestedEventsPendingRequest *request = [[FBSDKSuggestedEventsPendingRequest alloc] initWithText:text
+                                                                                               screenName:screenName
+                                                                                                 viewTree:viewTree
+                                                                                               completion:completion];
+  const std::string key = std::string(text.UTF8String ?: "") + '\n' + (screenName.UTF8String ?: "");
+  return _queue->Submit(key, request, FBSDKNowNs()) != FBSDKSuggestedEventsRequestQueue::kCoalesced;
+}
+
+- (void)drainScheduledRequests
+{
+  _drainScheduled = false;
+  [self drain];
+}
+
+- (void)drain
+{
+  while (true) {
+    const std::vector<FBSDKSuggestedEventsRequestQueue::Request> &batch = _queue->TakeBatch(kMaxBatchSize);
+    if (batch.empty()) {
+      return;
+    }
+    [self predictBatch:batch];
+  }
+}
+
+- (void)predictBatch:(const std::vector<FBSDKSuggestedEventsRequestQueue::Request> &)batch
+{
+  const size_t n = batch.size();
+  std::vector<float *> denseData(n, nullptr);
+  NSMutableArray<NSString *> *textFeatures = [NSMutableArray arrayWithCapacity:n];
+  for (size_t i = 0; i < n; i++) {
+    FBSDKSuggestedEventsPendingRequest *request = batch[i].value;
+    denseData[i] = [self.featureExtractor getDenseFeatures:request.viewTree];
+    NSString *textFeature = [FBSDKModelUtility normalizedText:[self.featureExtractor getTextFeature:request.text withScreenName:request.screenName]];
+    [FBSDKTypeUtility array:textFeatures addObject:textFeature ?: @""];
+  }
+
+  NSMutableArray<NSString *> *events = [NSMutableArray arrayWithCapacity:n];
+  id<FBSDKEventProcessing> eventProcessor = self.eventProcessor;
+  if ([(NSObject *)eventProcessor conformsToProtocol:@protocol(FBSDKBatchEventProcessing)]) {
+    // only requests with dense features can be predicted, the others are "other"
+    NSMutableArray<NSString *> *batchTextFeatures = [NSMutableArray arrayWithCapacity:n];
+    std::vector<float> batchDenseData;
+    for (size_t i = 0; i < n; i++) {
+      [FBSDKTypeUtility array:events addObject:SUGGESTED_EVENT_OTHER];
+      if (denseData[i]) {
+        [FBSDKTypeUtility array:batchTextFeatures addObject:textFeatures[i]];
+        batchDenseData.insert(batchDenseData.end(), denseData[i], denseData[i] + DENSE_FEATURE_LEN);
+      }
+    }
+    if (batchTextFeatures.count > 0) {
+      NSArray<NSString *> *batchEvents = [(id<FBSDKBatchEventProcessing>)eventProcessor processSuggestedEventsForTextFeatures:batchTextFeatures denseData:batchDenseData.data()];
+      for (size_t i = 0, j = 0; i < n; i++) {
+        if (denseData[i]) {
+          events[i] = [FBSDKTypeUtility array:batchEvents objectAtIndex:j++] ?: SUGGESTED_EVENT_OTHER;
+        }
+      }
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      NSString *event = [eventProcessor processSuggestedEvents:textFeatures[i] denseData:denseData[i]];
+      [FBSDKTypeUtility array:events addObject:event ?: SUGGESTED_EVENT_OTHER];
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    const uint64_t latency = _queue->Complete(batch[i], FBSDKNowNs());
+    batch[i].value.completion(events[i], denseData[i], (NSTimeInterval)latency / NSEC_PER_SEC);
+    free(denseData[i]);
+  }
+}
+
+@end
+
+#endif
@@ -0,0 +1,714 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Micro-benchmarks of the model runtime: every kernel and op over the shapes of the MTML model, and
+// end-to-end predictions with synthetic weights of the shapes of getMTMLWeightsInfo. Reports ns/op,
+// allocations/op and the bytes an op has to touch at least (its inputs, weights and outputs once), and
+// compares them with a baseline. Built for Linux with the portable backend by run_model_benchmarks.sh.
+//
+// With --accuracy_weights and --accuracy_corpus it instead checks that int8 inference picks the same
+// classes as fp32 for a model, which FBSDK_ML_QUANTIZED_INFERENCE must not be turned on without.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "FBSDKModelRuntime.hpp"
+#include "FBSDKModelWeights.hpp"
+
+// Every allocation goes through one of these: the libc allocators are wrapped at link time with
+// -Wl,--wrap=malloc,--wrap=posix_memalign, operator new is replaced below.
+static size_t g_allocations = 0;
+
+extern "C" {
+  void *__real_malloc(size_t size);
+  int __real_posix_memalign(void **ptr, size_t alignment, size_t size);
+
+  void *__wrap_malloc(size_t size)
+  {
+    g_allocations++;
+    return __real_malloc(size);
+  }
+
+  int __wrap_posix_memalign(void **ptr, size_t alignment, size_t size)
+  {
+    g_allocations++;
+    return __real_posix_memalign(ptr, alignment, size);
+  }
+}
+
+// not inlined, so that the compiler does not pair the free below with the new
+__attribute__((noinline)) void *operator new(size_t size)
+{
+  g_allocations++;
+  void *ptr = __real_malloc(size > 0 ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept
+{
+  free(ptr);
+}
+
+namespace {
+  using namespace fbsdk;
+
+  struct Benchmark {
+    std::string name;
+    std::function<void()> run;
+    double bytes; // per op
+  };
+
+  struct Result {
+    std::string name;
+    double ns;
+    double allocations;
+    double bytes;
+  };
+
+  struct Options {
+    std::string filter = ".*";
+    double min_time = 0.1; // seconds per repetition
+    int repetitions = 5;
+    std::string baseline;
+    std::string save_baseline;
+    double threshold = -1; // slowdown reported as a regression, the tolerance of the baseline if negative
+    std::string accuracy_weights;
+    std::string accuracy_corpus;
+  };
+
+  // Shapes of getMTMLWeightsInfo in FBSDKModelParser.mm
+  const std::pair<const char *, MShape> kMTMLWeightsInfo[] = {
+    {"embed.weight", {256, 32}},
+    {"convs.0.weight", {32, 32, 3}},
+    {"convs.0.bias", {32}},
+    {"convs.1.weight", {64, 32, 3}},
+    {"convs.1.bias", {64}},
+    {"convs.2.weight", {64, 64, 3}},
+    {"convs.2.bias", {64}},
+    {"fc1.weight", {128, 190}},
+    {"fc1.bias", {128}},
+    {"fc2.weight", {64, 128}},
+    {"fc2.bias", {64}},
+    {"integrity_detect.weight", {3, 64}},
+    {"integrity_detect.bias", {3}},
+    {"app_event_pred.weight", {5, 64}},
+    {"app_event_pred.bias", {5}},
+  };
+
+  // Button and field texts of the lengths the SDK sees, up to past SEQ_LEN
+  const char *const kTexts[] = {
+    "email",
+    "Add to cart",
+    "fb_content_id",
+    "Enter your phone number",
+    "Sign up",
+    "password",
+    "Checkout | Continue to payment | Apply coupon code",
+    "Buy now",
+    "Street address, apartment, suite, unit, building, floor, city, state, ZIP code and country of residence for shipping",
+    "",
+  };
+
+  std::mt19937 g_rng(2021);
+
+  MTensor randomTensor(const MShape &shape, float stddev = 0.1f)
+  {
+    MTensor x(shape);
+    std::normal_distribution<float> distribution(0, stddev);
+    for (int i = 0; i < x.count(); i++) {
+      x.mutable_data()[i] = distribution(g_rng);
+    }
+    return x;
+  }
+
+  // x with every activation below 0 zeroed, as after a relu
+  MTensor randomActivations(const MShape &shape)
+  {
+    MTensor x = randomTensor(shape, 1);
+    relu(x);
+    return x;
+  }
+
+  std::unordered_map<std::string, MTensor> mtmlWeights()
+  {
+    std::unordered_map<std::string, MTensor> weights;
+    for (const auto &entry : kMTMLWeightsInfo) {
+      weights[entry.first] = randomTensor(entry.second);
+    }
+    return weights;
+  }
+
+  // w (rows, cols) with 1 - density of its blocks of block_size columns zeroed
+  MTensor pruned(const MTensor &w, int block_size, float density)
+  {
+    MTensor y(w.sizes());
+    memcpy(y.mutable_data(), w.data(), (size_t)w.count() * sizeof(float));
+    std::uniform_real_distribution<float> distribution(0, 1);
+    for (int i = 0; i < y.count(); i += block_size) {
+      if (distribution(g_rng) >= density) {
+        memset(y.mutable_data() + i, 0, (size_t)block_size * sizeof(float));
+      }
+    }
+    return y;
+  }
+
+  std::vector<const char *> texts(int n)
+  {
+    std::vector<const char *> batch;
+    for (int i = 0; i < n; i++) {
+      batch.push_back(kTexts[i % (sizeof(kTexts) / sizeof(kTexts[0]))]);
+    }
+    return batch;
+  }
+
+  double floatBytes(double count)
+  {
+    return count * sizeof(float);
+  }
+
+  double modelBytes(const PackedMTMLModel &model, const std::string &task)
+  {
+    const MTensor *tensors[] = {
+      &model.embed_weight, &model.convs_0_weight, &model.convs_0_bias, &model.convs_1_weight, &model.convs_1_bias,
+      &model.convs_2_weight, &model.convs_2_bias, &model.fc1_weight, &model.fc1_bias, &model.fc2_weight, &model.fc2_bias,
+      &model.heads.at(task).weight, &model.heads.at(task).bias,
+    };
+    double bytes = 0;
+    for (const MTensor *tensor : tensors) {
+      bytes += floatBytes(tensor->count());
+    }
+    return bytes;
+  }
+
+  // Defeats dead code elimination of results that are not used otherwise
+  volatile float g_sink;
+
+  void consume(const MTensor &x)
+  {
+    g_sink = x.count() > 0 ? x.data()[0] : 0;
+  }
+
+  std::vector<Benchmark> kernelBenchmarks()
+  {
+    std::vector<Benchmark> benchmarks;
+
+    const MTensor c1 = randomTensor({126, 64}, 1);
+    MTensor relu_x = randomTensor({126, 64}, 1);
+    benchmarks.push_back({"kernels/relu/126x64", [=]() mutable {
+      memcpy(relu_x.mutable_data(), c1.data(), (size_t)c1.count() * sizeof(float));
+      kernels::relu(relu_x.mutable_data(), relu_x.count());
+    }, floatBytes(3 * 126 * 64)});
+
+    MTensor pool_y({125, 64});
+    benchmarks.push_back({"kernels/max_pool_rows/126x64/2", [=]() mutable {
+      kernels::max_pool_rows(c1.data(), pool_y.mutable_data(), c1.size(0), c1.size(1), 2);
+    }, floatBytes(126 * 64 + 125 * 64)});
+
+    MTensor max_y({64});
+    benchmarks.push_back({"kernels/max_rows/126x64", [=]() mutable {
+      kernels::max_rows(c1.data(), max_y.mutable_data(), c1.size(0), c1.size(1));
+    }, floatBytes(126 * 64 + 64)});
+
+    const MTensor logits = randomTensor({5}, 1);
+    MTensor probs({5});
+    benchmarks.push_back({"kernels/softmax/5", [=]() mutable {
+      memcpy(probs.mutable_data(), logits.data(), 5 * sizeof(float));
+      kernels::softmax(probs.mutable_data(), 5);
+    }, floatBytes(2 * 5)});
+
+    MTensor bias_y = randomTensor({10, 128});
+    const MTensor bias = randomTensor({128});
+    benchmarks.push_back({"kernels/add_bias/10x128", [=]() mutable {
+      kernels::add_bias(bias_y.mutable_data(), bias.data(), 10, 128);
+    }, floatBytes(2 * 10 * 128 + 128)});
+
+    // fc1 over a batch of 10 texts in fp32, int8, fp16 and at a quarter of its blocks
+    const MTensor fc_x = randomActivations({10, 190});
+    const MTensor fc_w = randomTensor({190, 128});
+    MTensor fc_y({10, 128});
+    const double fc_bytes = floatBytes(10 * 190 + 10 * 128);
+    benchmarks.push_back({"kernels/gemm/10x128x190", [=]() mutable {
+      kernels::gemm(fc_x.data(), 190, fc_w.data(), fc_y.mutable_data(), 10, 128, 190, kernels::kNoEpilogue);
+    }, fc_bytes + floatBytes(190 * 128)});
+
+    const MQuantizedTensor fc_qw = quantizePerChannel(fc_w);
+    std::vector<int8_t> fc_qx(10 * 190);
+    std::vector<float> fc_x_scales(10);
+    benchmarks.push_back({"kernels/gemm_s8/10x128x190", [=]() mutable {
+      for (int n = 0; n < 10; n++) {
+        fc_x_scales[n] = kernels::quantize_s8(fc_x.data() + n * 190, 190, fc_qx.data() + n * 190);
+      }
+      kernels::gemm_s8(fc_qx.data(), 190, fc_x_scales.data(), 1, fc_qw.data(), fc_qw.scales().data(), fc_y.mutable_data(), 10, 128, 190, kernels::kNoEpilogue);
+    }, fc_bytes + kernels::packed_s8_size(190, 128) + floatBytes(128)});
+
+    const MHalfTensor fc_hw = toHalfPrecision(fc_w, kHalfFloat16);
+    benchmarks.push_back({"kernels/gemm_widening_f16/10x128x190", [=]() mutable {
+      kernels::gemm_widening<kernels::WeightsF16>(fc_x.data(), 190, fc_hw.data(), fc_y.mutable_data(), 10, 128, 190, kernels::kNoEpilogue);
+    }, fc_bytes + 190 * 128 * sizeof(uint16_t)});
+
+    for (int block_size : {4, 8}) {
+      const MBlockSparseTensor fc_sw = toBlockSparse(pruned(fc_w, block_size, 0.25f), block_size);
+      benchmarks.push_back({"kernels/gemm_block_sparse" + std::to_string(block_size) + "/10x128x190/0.25", [=]() mutable {
+        if (block_size == 8) {
+          kernels::gemm_block_sparse<8>(fc_x.data(), 190, fc_sw.row_offsets(), fc_sw.block_cols(), fc_sw.values(), nullptr, fc_y.mutable_data(), 10, 128, 190);
+        } else {
+          kernels::gemm_block_sparse<4>(fc_x.data(), 190, fc_sw.row_offsets(), fc_sw.block_cols(), fc_sw.values(), nullptr, fc_y.mutable_data(), 10, 128, 190);
+        }
+      }, fc_bytes + floatBytes(fc_sw.count()) + sizeof(int) * (191 + fc_sw.n_blocks())});
+    }
+    return benchmarks;
+  }
+
+  std::vector<Benchmark> opBenchmarks(const PackedMTMLModel &model)
+  {
+    std::vector<Benchmark> benchmarks;
+    const std::vector<const char *> text = texts(1);
+
+    benchmarks.push_back({"ops/embedding/1x128", [=]() {
+      consume(embedding(text, SEQ_LEN, model.embed_weight));
+    }, floatBytes(2 * SEQ_LEN * 32)});
+
+    benchmarks.push_back({"ops/embeddingConv1DBiasReLU/1x128", [=]() {
+      consume(embeddingConv1DBiasReLU(text, SEQ_LEN, model.embed_conv0_table, model.convs_0_bias));
+    }, floatBytes(3 * SEQ_LEN * 32 + 126 * 32)});
+
+    // the three convs of a full length text
+    struct Conv {
+      const char *name;
+      const MTensor &w;
+      const MTensor &b;
+      int pool_size;
+      MTensor x;
+    };
+    const Conv convs[] = {
+      {"conv0", model.convs_0_weight, model.convs_0_bias, 1, randomActivations({1, 128, 32})},
+      {"conv1", model.convs_1_weight, model.convs_1_bias, 2, randomActivations({1, 126, 32})},
+      {"conv2", model.convs_2_weight, model.convs_2_bias, 1, randomActivations({1, 123, 64})},
+    };
+    for (const Conv &conv : convs) {
+      const int output_len = conv.x.size(1) - conv.w.size(0) - conv.pool_size + 2;
+      const double bytes = floatBytes(conv.x.count() + conv.w.count() + conv.b.count() + output_len * conv.w.size(2));
+      const std::string shape = std::string(conv.name) + "/" + std::to_string(conv.x.size(1));
+      const MTensor x = conv.x;
+      const MTensor w = conv.w;
+      const MTensor b = conv.b;
+      const int pool_size = conv.pool_size;
+      benchmarks.push_back({"ops/conv1D/" + shape, [=]() {
+        consume(conv1D(x, w));
+      }, bytes});
+      benchmarks.push_back({"ops/conv1DBiasReLUMaxPool1D/" + shape, [=]() {
+        consume(conv1DBiasReLUMaxPool1D(x, w, b, pool_size));
+      }, bytes});
+    }
+
+    // the fused convs over batches of texts of the full length and of the 16 token bucket, each next to a
+    // gemm per example, which is what conv1DGemm runs when stacking the examples does not pay off
+    for (const Conv &conv : convs) {
+      for (const int seq_len : {conv.x.size(1), conv.x.size(1) - (SEQ_LEN - 16)}) {
+        for (const int batch : {4, 32}) {
+          const MTensor x = randomActivations({batch, seq_len, conv.x.size(2)});
+          const MTensor w = conv.w;
+          const MTensor b = conv.b;
+          const int pool_size = conv.pool_size;
+          const int conv_len = seq_len - w.size(0) + 1;
+          const int output_len = conv_len - pool_size + 1;
+          const double bytes = floatBytes(x.count() + w.count() + b.count() + batch * output_len * w.size(2));
+          const std::string shape = std::string(conv.name) + "/" + std::to_string(seq_len) + "/" + std::to_string(batch);
+          benchmarks.push_back({"ops/conv1DBiasReLUMaxPool1D/" + shape, [=]() {
+            consume(conv1DBiasReLUMaxPool1D(x, w, b, pool_size));
+          }, bytes});
+          benchmarks.push_back({"ops/conv1DBiasReLUMaxPool1D/" + shape + "/per_example", [=]() {
+            const int input_size = x.size(2);
+            const int output_size = w.size(2);
+            MTensor y({batch, output_len, output_size});
+            const kernels::GemmEpilogue epilogue = {b.data(), true, pool_size};
+            for (int n = 0; n < batch; n++) {
+              kernels::gemm(x.data() + n * (seq_len * input_size), input_size, w.data(), y.mutable_data() + n * (output_len * output_size), conv_len, output_size, w.size(0) * input_size, epilogue);
+            }
+            consume(y);
+          }, bytes});
+        }
+      }
+    }
+
+    const MTensor c2 = randomActivations({1, 121, 64});
+    benchmarks.push_back({"ops/maxPool1D/global/121x64", [=]() {
+      consume(maxPool1D(c2, c2.size(1)));
+    }, floatBytes(121 * 64 + 64)});
+
+    const MTensor concat = randomActivations({1, 190});
+    const MTensor dense1 = randomActivations({1, 128});
+    benchmarks.push_back({"ops/dense/fc1/1", [=]() {
+      consume(dense(concat, model.fc1_weight, model.fc1_bias));
+    }, floatBytes(190 + 190 * 128 + 2 * 128)});
+    benchmarks.push_back({"ops/dense/fc2/1", [=]() {
+      consume(dense(dense1, model.fc2_weight, model.fc2_bias));
+    }, floatBytes(128 + 128 * 64 + 2 * 64)});
+    // the same layers on the kernels specialized for their shapes
+    benchmarks.push_back({"ops/dense_fixed/fc1/1", [=]() {
+      consume(dense(concat, model.fc1_weight, model.fc1_bias, nullptr, model.fc_kernels[0]));
+    }, floatBytes(190 + 190 * 128 + 2 * 128)});
+    benchmarks.push_back({"ops/dense_fixed/fc2/1", [=]() {
+      consume(dense(dense1, model.fc2_weight, model.fc2_bias, nullptr, model.fc_kernels[1]));
+    }, floatBytes(128 + 128 * 64 + 2 * 64)});
+    return benchmarks;
+  }
+
+  std::vector<Benchmark> predictionBenchmarks(const std::unordered_map<std::string, MTensor> &weights, const PackedMTMLModel &model)
+  {
+    std::vector<Benchmark> benchmarks;
+    PackedMTMLModel quantized_model = model;
+    quantizeMTMLModel(quantized_model);
+    PackedMTMLModel half_model = model;
+    storeMTMLModelInHalfPrecision(half_model, kHalfFloat16);
+    // shares the arena between benchmarks, like the thread local arena of the SDK
+    std::shared_ptr<MTensorArena> arena = std::make_shared<MTensorArena>();
+
+    for (const std::string task : {"integrity_detect", "app_event_pred"}) {
+      const double weight_bytes = modelBytes(model, task);
+      for (int batch : {1, 4, 10, 32}) {
+        const std::vector<const char *> batch_texts = texts(batch);
+        const std::string suffix = "/" + task + "/" + std::to_string(batch);
+        MTMLInferenceOptions options;
+        const double bytes = weight_bytes + mtmlWorkspaceBytes(model, batch, options);
+        benchmarks.push_back({"predict/batch" + suffix, [=]() {
+          consume(predictOnMTMLBatch(task, batch_texts, model, nullptr, options));
+        }, bytes});
+        benchmarks.push_back({"predict/batch_arena" + suffix, [=]() {
+          MTMLInferenceOptions arena_options = options;
+          arena_options.arena = arena.get();
+          consume(predictOnMTMLBatch(task, batch_texts, model, nullptr, arena_options));
+        }, bytes});
+
+        MTMLInferenceOptions unfused = options;
+        unfused.fuse_conv_layers = false;
+        unfused.fuse_embedding = false;
+        unfused.length_buckets = false;
+        benchmarks.push_back({"predict/unfused" + suffix, [=]() {
+          consume(predictOnMTMLBatch(task, batch_texts, model, nullptr, unfused));
+        }, weight_bytes + mtmlWorkspaceBytes(model, batch, unfused)});
+
+        MTMLInferenceOptions int8 = options;
+        int8.quantized = true;
+        benchmarks.push_back({"predict/quantized" + suffix, [=]() {
+          consume(predictOnMTMLBatch(task, batch_texts, quantized_model, nullptr, int8));
+        }, bytes});
+        benchmarks.push_back({"predict/half" + suffix, [=]() {
+          consume(predictOnMTMLBatch(task, batch_texts, half_model, nullptr, options));
+        }, bytes});
+      }
+      // what the SDK did before the model was packed once at load
+      const char *text = kTexts[1];
+      benchmarks.push_back({"predict/legacy_weights_map/" + task + "/1", [=]() {
+        consume(predictOnMTML(task, text, weights, nullptr));
+      }, weight_bytes + mtmlWorkspaceBytes(model, 1)});
+    }
+
+    const std::vector<const char *> batch_texts = texts(10);
+    const float thresholds[] = {0.3f, 0.25f, 0.2f, 0.2f, 0.1f};
+    // the classes are reused like the arena, so a warm call allocates nothing
+    std::shared_ptr<std::vector<int>> classes = std::make_shared<std::vector<int>>();
+    benchmarks.push_back({"predict/classify/app_event_pred/10", [=]() {
+      MTMLInferenceOptions options;
+      options.arena = arena.get();
+      consume(classifyOnMTMLBatch("app_event_pred", batch_texts, model, nullptr, thresholds, 5, *classes, options));
+    }, modelBytes(model, "app_event_pred") + mtmlWorkspaceBytes(model, 10)});
+    return benchmarks;
+  }
+
+  Result measure(const Benchmark &benchmark, const Options &options)
+  {
+    typedef std::chrono::steady_clock Clock;
+    benchmark.run();
+    // enough iterations for a repetition to take min_time
+    size_t iterations = 1;
+    while (true) {
+      const Clock::time_point start = Clock::now();
+      for (size_t i = 0; i < iterations; i++) {
+        benchmark.run();
+      }
+      const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+      if (seconds >= options.min_time || iterations >= ((size_t)1 << 30)) {
+        break;
+      }
+      iterations = seconds <= 0 ? iterations * 10 : std::max(iterations + 1, (size_t)(iterations * 1.2 * options.min_time / seconds));
+    }
+    std::vector<double> ns;
+    ns.reserve(options.repetitions);
+    size_t allocations = 0;
+    for (int r = 0; r < options.repetitions; r++) {
+      const size_t allocations_before = g_allocations;
+      const Clock::time_point start = Clock::now();
+      for (size_t i = 0; i < iterations; i++) {
+        benchmark.run();
+      }
+      const Clock::time_point end = Clock::now();
+      allocations = g_allocations - allocations_before;
+      ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / iterations);
+    }
+    std::sort(ns.begin(), ns.end());
+    return {benchmark.name, ns[ns.size() / 2], (double)allocations / iterations, benchmark.bytes};
+  }
+
+  // Tolerance of a baseline that does not record one
+  const double kDefaultThreshold = 0.1;
+
+  // threshold is left unchanged if the baseline records no "# threshold" tolerance
+  std::map<std::string, Result> readBaseline(const std::string &path, std::string &backend, double &threshold)
+  {
+    std::map<std::string, Result> baseline;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+      if (line.compare(0, 10, "# backend ") == 0) {
+        backend = line.substr(10);
+      }
+      if (line.compare(0, 12, "# threshold ") == 0) {
+        threshold = atof(line.c_str() + 12);
+      }
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      std::istringstream fields(line);
+      Result result;
+      if (fields >> result.name >> result.ns >> result.allocations >> result.bytes) {
+        baseline[result.name] = result;
+      }
+    }
+    return baseline;
+  }
+
+  void writeBaseline(const std::string &path, const std::vector<Result> &results, double threshold)
+  {
+    std::ofstream file(path);
+    file << "# backend " << kernels::backendName() << "\n";
+    char tolerance[64];
+    snprintf(tolerance, sizeof(tolerance), "# threshold %.2f\n", threshold);
+    file << tolerance;
+    file << "# name ns/op allocations/op bytes/op\n";
+    for (const Result &result : results) {
+      char line[512];
+      snprintf(line, sizeof(line), "%s %.1f %.2f %.0f\n", result.name.c_str(), result.ns, result.allocations, result.bytes);
+      file << line;
+    }
+  }
+
+  std::vector<std::string> split(const std::string &line, char separator)
+  {
+    std::vector<std::string> fields;
+    std::istringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, separator)) {
+      fields.push_back(field);
+    }
+    return fields;
+  }
+
+  struct AccuracyCorpus {
+    std::vector<float> thresholds;
+    std::vector<std::string> texts;
+    std::vector<float> dense_features; // DENSE_FEATURE_LEN per text, zeros when the line has none
+  };
+
+  /*
+   Reads a tab separated corpus, one line per example and one per task threshold list:
+     thresholds  TASK  T0,T1,...
+     TASK  NORMALIZED_TEXT  [DENSE_FEATURE_LEN comma separated dense features]
+   Empty lines and lines starting with # are skipped.
+   */
+  bool readAccuracyCorpus(const std::string &path, std::map<std::string, AccuracyCorpus> &corpus)
+  {
+    std::ifstream file(path);
+    if (!file) {
+      fprintf(stderr, "cannot read %s\n", path.c_str());
+      return false;
+    }
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      const std::vector<std::string> &fields = split(line, '\t');
+      if (fields.size() == 3 && fields[0] == "thresholds") {
+        for (const std::string &threshold : split(fields[2], ',')) {
+          corpus[fields[1]].thresholds.push_back((float)atof(threshold.c_str()));
+        }
+        continue;
+      }
+      const std::vector<std::string> &dense = fields.size() == 3 ? split(fields[2], ',') : std::vector<std::string>();
+      if ((fields.size() != 2 && fields.size() != 3) || (fields.size() == 3 && dense.size() != DENSE_FEATURE_LEN)) {
+        fprintf(stderr, "%s:%d: malformed line\n", path.c_str(), number);
+        return false;
+      }
+      AccuracyCorpus &task = corpus[fields[0]];
+      task.texts.push_back(fields[1]);
+      for (int i = 0; i < DENSE_FEATURE_LEN; i++) {
+        task.dense_features.push_back(dense.empty() ? 0 : (float)atof(dense[i].c_str()));
+      }
+    }
+    return true;
+  }
+
+  // Counts the corpus texts that int8 inference classifies differently from fp32, exits with 1 if any
+  int checkQuantizedAccuracy(const Options &options)
+  {
+    std::ifstream file(options.accuracy_weights, std::ios::binary);
+    std::shared_ptr<std::vector<char>> data = std::make_shared<std::vector<char>>(
+      std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    std::unordered_map<std::string, MTensor> weights;
+    if (!MParseWeights(data->data(), data->size(), data, weights)) {
+      fprintf(stderr, "%s is not a weights container\n", options.accuracy_weights.c_str());
+      return 2;
+    }
+    std::map<std::string, AccuracyCorpus> corpus;
+    if (!readAccuracyCorpus(options.accuracy_corpus, corpus)) {
+      return 2;
+    }
+    PackedMTMLModel model = packMTMLWeights(weights);
+    precomputeMTMLEmbeddingConv(model);
+    quantizeMTMLModel(model);
+
+    int failures = 0;
+    printf("%-24s %8s %12s\n", "task", "texts", "mismatches");
+    for (const auto &entry : corpus) {
+      const AccuracyCorpus &task = entry.second;
+      std::vector<const char *> texts;
+      for (const std::string &text : task.texts) {
+        texts.push_back(text.c_str());
+      }
+      const int mismatches = task.thresholds.empty()
+      ? -1
+      : countQuantizedMismatches(entry.first, texts, model, task.dense_features.data(), task.thresholds.data(), (int)task.thresholds.size());
+      if (mismatches != 0) {
+        failures++;
+      }
+      printf("%-24s %8zu %12s\n", entry.first.c_str(), texts.size(), mismatches < 0 ? "cannot run" : std::to_string(mismatches).c_str());
+    }
+    return failures > 0 ? 1 : 0;
+  }
+
+  bool parseOptions(int argc, char **argv, Options &options)
+  {
+    for (int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      const size_t equals = arg.find('=');
+      const std::string key = arg.substr(0, equals);
+      const std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+      if (key == "--filter") {
+        options.filter = value;
+      } else if (key == "--min_time") {
+        options.min_time = atof(value.c_str());
+      } else if (key == "--repetitions") {
+        options.repetitions = std::max(1, atoi(value.c_str()));
+      } else if (key == "--baseline") {
+        options.baseline = value;
+      } else if (key == "--save_baseline") {
+        options.save_baseline = value;
+      } else if (key == "--threshold") {
+        options.threshold = atof(value.c_str());
+      } else if (key == "--accuracy_weights") {
+        options.accuracy_weights = value;
+      } else if (key == "--accuracy_corpus") {
+        options.accuracy_corpus = value;
+      } else {
+        fprintf(stderr,
+          "usage: %s [--filter=REGEX] [--min_time=SECONDS] [--repetitions=N] [--baseline=FILE] "
+          "[--save_baseline=FILE] [--threshold=FRACTION] [--accuracy_weights=FILE --accuracy_corpus=FILE]\n", argv[0]);
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  if (!options.accuracy_weights.empty() || !options.accuracy_corpus.empty()) {
+    return checkQuantizedAccuracy(options);
+  }
+
+  const std::unordered_map<std::string, MTensor> weights = mtmlWeights();
+  PackedMTMLModel model = packMTMLWeights(weights);
+  precomputeMTMLEmbeddingConv(model);
+
+  std::vector<Benchmark> benchmarks = kernelBenchmarks();
+  for (const Benchmark &benchmark : opBenchmarks(model)) {
+    benchmarks.push_back(benchmark);
+  }
+  for (const Benchmark &benchmark : predictionBenchmarks(weights, model)) {
+    benchmarks.push_back(benchmark);
+  }
+
+  std::string baseline_backend;
+  double baseline_threshold = kDefaultThreshold;
+  const std::map<std::string, Result> baseline = options.baseline.empty()
+  ? std::map<std::string, Result>()
+  : readBaseline(options.baseline, baseline_backend, baseline_threshold);
+  if (!options.baseline.empty() && baseline_backend != kernels::backendName()) {
+    fprintf(stderr, "warning: baseline was recorded with the %s backend\n", baseline_backend.c_str());
+  }
+  const double threshold = options.threshold >= 0 ? options.threshold : baseline_threshold;
+
+  printf("backend %s\n", kernels::backendName());
+  printf("%-56s %12s %10s %12s %8s %10s\n", "benchmark", "ns/op", "allocs/op", "bytes/op", "GB/s", "baseline");
+  const std::regex filter(options.filter);
+  std::vector<Result> results;
+  int regressions = 0;
+  for (const Benchmark &benchmark : benchmarks) {
+    if (!std::regex_search(benchmark.name, filter)) {
+      continue;
+    }
+    const Result result = measure(benchmark, options);
+    results.push_back(result);
+    std::string comparison;
+    const auto entry = baseline.find(result.name);
+    if (entry != baseline.end()) {
+      const double change = result.ns / entry->second.ns - 1;
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "%+.1f%%", 100 * change);
+      comparison = buffer;
+      // allocations are deterministic, any increase is a regression
+      if (change > threshold || result.allocations > entry->second.allocations + 0.005) {
+        comparison += " REGRESSION";
+        regressions++;
+      }
+    }
+    printf("%-56s %12.1f %10.2f %12.0f %8.2f %10s\n", result.name.c_str(), result.ns, result.allocations, result.bytes,
+      result.bytes / result.ns, comparison.c_str());
+    fflush(stdout);
+  }
+
+  if (!options.save_baseline.empty()) {
+    writeBaseline(options.save_baseline, results, threshold);
+  }
+  if (regressions > 0) {
+    printf("%d regression(s) against %s\n", regressions, options.baseline.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+#!/bin/sh
+# Copyright (c) Meta Platforms, Inc. and affiliates.
+# All rights reserved.
+#
+# This source code is licensed under the license found in the
+# LICENSE file in the root directory of this source tree.
+
+# Builds FBSDKModelBenchmarks.cpp with the portable kernel backend and runs it against the baseline of
+# that backend. Linux only, allocations are counted by wrapping the libc allocators at link time.
+#
+# usage: run_model_benchmarks.sh [--simd=sse2|avx2|none] [--save] [benchmark options]
+#   --simd  vector extension of the portable backend, sse2 by default
+#   --save  also record the results as the baseline of the backend, keeping the baseline's threshold
+# Benchmark options are passed on: --filter=REGEX --min_time=SECONDS --repetitions=N --threshold=FRACTION
+# A regression, i.e. a slowdown over the threshold or more allocations than the baseline, exits with 1.
+#
+# --accuracy_weights=FILE --accuracy_corpus=FILE runs no benchmark: it compares the classes picked by int8
+# and fp32 inference for every text of the corpus with the model of the weights container, and exits with
+# 1 on any difference. Only build with FBSDK_ML_QUANTIZED_INFERENCE for a model that passes this check.
+# The corpus format is described at readAccuracyCorpus in FBSDKModelBenchmarks.cpp.
+#
+# The sse2 baseline is checked in, so every run compares against it. Its "# threshold" line sets the
+# slowdown tolerated by default. It is wide, because the baseline was timed on another machine.
+# Allocation counts do not depend on the machine and must match exactly. To check a change closely,
+# record a local baseline with --save on the base revision, run again with the change and --threshold=0.1,
+# and restore the checked-in file before committing. Update the checked-in baseline with --save on a
+# change that moves the timings on purpose.
+
+set -eu
+
+dir=$(cd "$(dirname "$0")" && pwd)
+simd=sse2
+save=0
+accuracy=0
+for arg in "$@"; do
+  case "$arg" in
+    --simd=*) simd=${arg#--simd=} ;;
+    --save) save=1 ;;
+    --accuracy_*) accuracy=1 ;;
+  esac
+done
+
+case "$simd" in
+  sse2) simd_flags="" ;;
+  avx2) simd_flags="-mavx2 -mfma -mf16c" ;;
+  none) simd_flags="-DFBSDK_ML_DISABLE_SIMD" ;;
+  *)
+    echo "unknown --simd=$simd" >&2
+    exit 2
+    ;;
+esac
+
+build_dir=${TMPDIR:-/tmp}/fbsdk_model_benchmarks
+mkdir -p "$build_dir"
+binary="$build_dir/FBSDKModelBenchmarks-$simd"
+baseline="$dir/FBSDKModelBenchmarks-$simd.baseline"
+
+# shellcheck disable=SC2086
+${CXX:-c++} -std=c++11 -O2 -DNDEBUG -DFBSDK_ML_USE_ACCELERATE=0 $simd_flags \
+  -I"$dir/../FBSDKCoreKit/AppEvents/Internal/ML" \
+  "$dir/FBSDKModelBenchmarks.cpp" \
+  -Wl,--wrap=malloc,--wrap=posix_memalign \
+  -o "$binary"
+
+# drop the options of this script
+for arg in "$@"; do
+  shift
+  case "$arg" in
+    --simd=* | --save) ;;
+    *) set -- "$@" "$arg" ;;
+  esac
+done
+
+if [ "$accuracy" = 1 ]; then
+  exec "$binary" "$@"
+elif [ "$save" = 1 ] && [ -f "$baseline" ]; then
+  exec "$binary" --baseline="$baseline" --save_baseline="$baseline" "$@"
+elif [ "$save" = 1 ]; then
+  exec "$binary" --save_baseline="$baseline" "$@"
+elif [ -f "$baseline" ]; then
+  exec "$binary" --baseline="$baseline" "$@"
+else
+  echo "no baseline for $simd yet, record one with --save" >&2
+  exec "$binary" "$@"
+fi
@@ -8,6 +8,7 @@
 
 #import <FBSDKCoreKit/FBSDKCoreKit.h>
 
+#import "FBSDKBatchIntegrityProcessing.h"
 #import "FBSDKIntegrityManager.h"
 
 NS_ASSUME_NONNULL_BEGIN
@@ -6,6 +6,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#import "FBSDKBatchEventProcessing.h"
 #import "FBSDKModelManager.h"
 
 @protocol FBSDKFeatureChecking;
@@ -14,7 +15,7 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
-@interface FBSDKModelManager (Testing)
+@interface FBSDKModelManager (Testing) <FBSDKBatchEventProcessing>
 
 @property (nullable, nonatomic) id<FBSDKFeatureChecking> featureChecker;
 @property (nullable, nonatomic) id<FBSDKGraphRequestFactory> graphRequestFactory;
@@ -31,6 +32,7 @@ NS_ASSUME_NONNULL_BEGIN
 + (NSArray<NSString *> *)getIntegrityMapping;
 + (NSArray<NSString *> *)getSuggestedEventsMapping;
 + (void)reset;
+- (BOOL)publishMTMLWeights:(nullable NSData *)data;
 
 @end
 
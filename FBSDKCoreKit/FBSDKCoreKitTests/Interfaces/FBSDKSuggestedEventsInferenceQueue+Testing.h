@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#import "FBSDKSuggestedEventsInferenceQueue.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface FBSDKSuggestedEventsInferenceQueue (Testing)
+
+- (BOOL)submitEventForText:(NSString *)text
+                screenName:(NSString *)screenName
+                  viewTree:(NSDictionary<NSString *, id> *)viewTree
+                completion:(FBSDKSuggestedEventsPredictionHandler)completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
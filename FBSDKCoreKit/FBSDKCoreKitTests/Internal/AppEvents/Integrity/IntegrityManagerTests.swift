@@ -126,4 +126,48 @@ final class IntegrityManagerTests: XCTestCase {
     XCTAssertNotNil(processed[.init("_session_id")])
     XCTAssertNil(processed[.init("_onDeviceParams")])
   }
+
+  func testProcessingParametersWithBatchProcessor() throws {
+    let batchProcessor = TestBatchIntegrityProcessor()
+    let batchManager = IntegrityManager(
+      gateKeeperManager: TestGateKeeperManager.self,
+      integrityProcessor: batchProcessor
+    )
+    batchManager.enable()
+
+    let parameters: [AppEvents.ParameterName: String] = [
+      .init("address"): "2301 N Highland Ave, Los Angeles, CA 90068",
+      .init("_session_id"): "12345",
+      .init("note"): "period_starts",
+    ]
+    batchProcessor.stubbedParameters = [
+      "address": true,
+      "period_starts": true,
+    ]
+
+    let processed = try XCTUnwrap(
+      batchManager.processParameters(parameters, eventName: .init(name)) as? [AppEvents.ParameterName: String],
+      "Processed parameters should be in the expected format"
+    )
+
+    XCTAssertEqual(
+      batchProcessor.capturedBatches.count,
+      1,
+      "Should process all keys and values in a single batch"
+    )
+    XCTAssertEqual(
+      batchProcessor.capturedBatches.first?.count,
+      parameters.count * 2,
+      "Should pass every key and every value to the batch"
+    )
+    XCTAssertEqual(
+      batchProcessor.singleParameterCallCount,
+      0,
+      "Should not fall back to processing parameters one at a time"
+    )
+    XCTAssertNil(processed[.init("address")])
+    XCTAssertNil(processed[.init("note")])
+    XCTAssertEqual(processed[.init("_session_id")], "12345")
+    XCTAssertNotNil(processed[.init("_onDeviceParams")])
+  }
 }
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#import <XCTest/XCTest.h>
+
+#include <vector>
+
+#include "FBSDKInferenceQueue.hpp"
+
+typedef fbsdk::MInferenceQueue<int> FBSDKTestInferenceQueue;
+
+@interface FBSDKInferenceQueueTests : XCTestCase
+
+@end
+
+@implementation FBSDKInferenceQueueTests
+
+- (void)testCoalescesDuplicatesWithinWindow
+{
+  FBSDKTestInferenceQueue queue(4, 100);
+  XCTAssertEqual(queue.Submit("add to cart", 1, 0), FBSDKTestInferenceQueue::kQueued);
+  XCTAssertEqual(queue.Submit("add to cart", 2, 50), FBSDKTestInferenceQueue::kCoalesced);
+  XCTAssertEqual(queue.Submit("add to cart", 3, 150), FBSDKTestInferenceQueue::kQueued, "Should not coalesce after the window");
+  XCTAssertEqual(queue.Submit("checkout", 4, 160), FBSDKTestInferenceQueue::kQueued);
+  XCTAssertEqual(queue.size(), 3);
+
+  const std::vector<FBSDKTestInferenceQueue::Request> &batch = queue.TakeBatch(8);
+  XCTAssertEqual(batch.size(), 3);
+  XCTAssertEqual(batch[0].value, 1);
+  XCTAssertEqual(batch[2].value, 4);
+  XCTAssertEqual(queue.size(), 0);
+  XCTAssertEqual(queue.stats().coalesced, 1);
+}
+
+- (void)testDropsOldestWhenFull
+{
+  FBSDKTestInferenceQueue queue(2, 100);
+  queue.Submit("a", 1, 0);
+  queue.Submit("b", 2, 10);
+  XCTAssertEqual(queue.Submit("c", 3, 20), FBSDKTestInferenceQueue::kQueuedDroppingOldest);
+
+  const std::vector<FBSDKTestInferenceQueue::Request> &batch = queue.TakeBatch(1);
+  XCTAssertEqual(batch.size(), 1);
+  XCTAssertEqual(batch[0].value, 2, "Should drop the most stale request");
+  XCTAssertEqual(queue.size(), 1);
+  XCTAssertEqual(queue.stats().dropped, 1);
+}
+
+- (void)testReportsLatency
+{
+  FBSDKTestInferenceQueue queue(4, 100);
+  queue.Submit("a", 1, 1000);
+  queue.Submit("b", 2, 1200);
+  const std::vector<FBSDKTestInferenceQueue::Request> &batch = queue.TakeBatch(2);
+  XCTAssertEqual(queue.Complete(batch[0], 1500), 500);
+  XCTAssertEqual(queue.Complete(batch[1], 1500), 300);
+
+  const fbsdk::MInferenceQueueStats stats = queue.stats();
+  XCTAssertEqual(stats.submitted, 2);
+  XCTAssertEqual(stats.completed, 2);
+  XCTAssertEqual(stats.total_latency_ns, 800);
+  XCTAssertEqual(stats.max_latency_ns, 500);
+}
+
+@end
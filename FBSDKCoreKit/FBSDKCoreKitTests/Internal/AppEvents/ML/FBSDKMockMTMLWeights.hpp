@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef FBSDKMockMTMLWeights_hpp
+#define FBSDKMockMTMLWeights_hpp
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "FBSDKTensor.hpp"
+
+// Weights of the shipped MTML shapes, filled with deterministic pseudo-random values in [-0.2, 0.2)
+static inline std::unordered_map<std::string, fbsdk::MTensor> FBSDKMockMTMLWeights()
+{
+  const std::unordered_map<std::string, std::vector<int>> shapes = {
+    {"embed.weight", {256, 32}},
+    {"convs.0.weight", {32, 32, 3}},
+    {"convs.0.bias", {32}},
+    {"convs.1.weight", {64, 32, 3}},
+    {"convs.1.bias", {64}},
+    {"convs.2.weight", {64, 64, 3}},
+    {"convs.2.bias", {64}},
+    {"fc1.weight", {128, 190}},
+    {"fc1.bias", {128}},
+    {"fc2.weight", {64, 128}},
+    {"fc2.bias", {64}},
+    {"integrity_detect.weight", {3, 64}},
+    {"integrity_detect.bias", {3}},
+    {"app_event_pred.weight", {5, 64}},
+    {"app_event_pred.bias", {5}},
+  };
+  std::unordered_map<std::string, fbsdk::MTensor> weights;
+  unsigned int seed = 0;
+  for (const auto &entry : shapes) {
+    fbsdk::MTensor tensor(entry.second);
+    float *data = tensor.mutable_data();
+    for (int i = 0; i < tensor.count(); i++) {
+      seed = seed * 1103515245u + 12345u;
+      data[i] = (float)((int)((seed >> 16) % 2000) - 1000) / 5000;
+    }
+    weights[entry.first] = tensor;
+  }
+  return weights;
+}
+
+#endif /* FBSDKMockMTMLWeights_hpp */
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#import <XCTest/XCTest.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+#include "FBSDKMockMTMLWeights.hpp"
+#include "FBSDKModelGraph.hpp"
+#include "FBSDKModelWeights.hpp"
+
+@interface FBSDKModelGraphTests : XCTestCase
+
+@end
+
+@implementation FBSDKModelGraphTests
+
+- (void)testRunOpGraphMatchesPredictOnMTML
+{
+  const std::unordered_map<std::string, fbsdk::MTensor> weights = FBSDKMockMTMLWeights();
+  const fbsdk::MOpGraphPlan plan = fbsdk::planOpGraph(fbsdk::MTMLOpGraph(), weights);
+  XCTAssertFalse(plan.empty());
+  XCTAssertLessThan(plan.steps.size(), fbsdk::MTMLOpGraph().ops.size(), "Should fuse the activations into their producers");
+
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart"};
+  fbsdk::MTensorArena arena;
+  std::unordered_map<std::string, fbsdk::MTensor> outputs = fbsdk::runOpGraph(plan, texts, nullptr, &arena);
+  XCTAssertEqual(outputs.size(), 2);
+  XCTAssertEqual(arena.capacity(), fbsdk::opGraphWorkspaceBytes(plan, 2));
+
+  const fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(weights);
+  fbsdk::MTMLInferenceOptions options;
+  options.length_buckets = false;
+  options.fuse_embedding = false;
+  for (const char *task : {"integrity_detect", "app_event_pred"}) {
+    const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch(task, texts, model, nullptr, options);
+    const fbsdk::MTensor &output = outputs[task];
+    XCTAssertEqual(expected.sizes(), output.sizes());
+    XCTAssertEqual(memcmp(expected.data(), output.data(), expected.count() * sizeof(float)), 0);
+  }
+}
+
+- (void)testRunOpGraphRunsOnlyTheRequestedOutput
+{
+  const fbsdk::MOpGraphPlan plan = fbsdk::planOpGraph(fbsdk::MTMLOpGraph(), FBSDKMockMTMLWeights());
+  const std::vector<bool> &steps = plan.output_steps.at("app_event_pred");
+  XCTAssertLessThan(std::count(steps.begin(), steps.end(), true), plan.steps.size(), "Should leave out the steps of other heads");
+
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart"};
+  std::unordered_map<std::string, fbsdk::MTensor> all = fbsdk::runOpGraph(plan, texts, nullptr);
+  std::unordered_map<std::string, fbsdk::MTensor> outputs = fbsdk::runOpGraph(plan, texts, nullptr, nullptr, nullptr, "app_event_pred");
+  XCTAssertEqual(outputs.size(), 1);
+  const fbsdk::MTensor &expected = all["app_event_pred"];
+  const fbsdk::MTensor &output = outputs["app_event_pred"];
+  XCTAssertEqual(expected.sizes(), output.sizes());
+  XCTAssertEqual(memcmp(expected.data(), output.data(), expected.count() * sizeof(float)), 0);
+  XCTAssertTrue(fbsdk::runOpGraph(plan, texts, nullptr, nullptr, nullptr, "unknown").empty());
+}
+
+- (void)testIsMTMLOpGraph
+{
+  XCTAssertTrue(fbsdk::isMTMLOpGraph(fbsdk::MTMLOpGraph()));
+  XCTAssertTrue(fbsdk::isMTMLOpGraph(fbsdk::MTMLOpGraph({"app_event_pred"})));
+
+  fbsdk::MOpGraph graph = fbsdk::MTMLOpGraph();
+  graph.seq_length = 64;
+  XCTAssertFalse(fbsdk::isMTMLOpGraph(graph), "Should not run other sequence lengths on the fixed model");
+  graph = fbsdk::MTMLOpGraph();
+  graph.ops[6].attr = 3;
+  XCTAssertFalse(fbsdk::isMTMLOpGraph(graph), "Should not run other pool sizes on the fixed model");
+}
+
+- (void)testOpGraphRoundTripsThroughTheWeightsContainer
+{
+  const std::unordered_map<std::string, fbsdk::MTensor> weights = FBSDKMockMTMLWeights();
+  const fbsdk::MOpGraph graph = fbsdk::MTMLOpGraph();
+  const std::vector<char> data = fbsdk::MSerializeWeights(weights, 0, {{fbsdk::kOpGraphSection, fbsdk::MSerializeOpGraph(graph)}});
+
+  std::shared_ptr<void> owner;
+  std::unordered_map<std::string, fbsdk::MTensor> parsed;
+  XCTAssertTrue(fbsdk::MParseWeights(data.data(), data.size(), owner, parsed));
+  XCTAssertEqual(parsed.size(), weights.size(), "Should not expose the graph section as a tensor");
+
+  std::vector<char> section;
+  XCTAssertTrue(fbsdk::MFindWeightsSection(data.data(), data.size(), fbsdk::kOpGraphSection, section));
+  fbsdk::MOpGraph parsedGraph;
+  XCTAssertTrue(fbsdk::MParseOpGraph(section, parsedGraph));
+  XCTAssertEqual(parsedGraph.ops.size(), graph.ops.size());
+  XCTAssertEqual(parsedGraph.dense_length, graph.dense_length);
+
+  section.pop_back();
+  XCTAssertFalse(fbsdk::MParseOpGraph(section, parsedGraph));
+}
+
+- (void)testPlanOpGraphRejectsInvalidGraphs
+{
+  const std::unordered_map<std::string, fbsdk::MTensor> weights = FBSDKMockMTMLWeights();
+  fbsdk::MOpGraph graph = fbsdk::MTMLOpGraph();
+  graph.ops[3].inputs[0] = 40;
+  XCTAssertTrue(fbsdk::planOpGraph(graph, weights).empty(), "Should reject inputs that are not produced yet");
+
+  graph = fbsdk::MTMLOpGraph();
+  strcpy(graph.ops[1].weight, "missing");
+  XCTAssertTrue(fbsdk::planOpGraph(graph, weights).empty(), "Should reject missing weights");
+
+  graph = fbsdk::MTMLOpGraph();
+  graph.seq_length = 4;
+  XCTAssertTrue(fbsdk::planOpGraph(graph, weights).empty(), "Should reject sequences shorter than the convolutions");
+
+  graph = fbsdk::MTMLOpGraph();
+  graph.ops[2].type = 99;
+  XCTAssertTrue(fbsdk::planOpGraph(graph, weights).empty(), "Should reject unknown ops");
+
+  XCTAssertTrue(fbsdk::planOpGraph(fbsdk::MTMLOpGraph({"integrity_detect"}), weights).empty(), "Should reject weights the graph never reads");
+}
+
+@end
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#import <XCTest/XCTest.h>
+
+#include <vector>
+
+#include "FBSDKModelKernels.hpp"
+
+@interface FBSDKModelKernelsTests : XCTestCase
+
+@end
+
+@implementation FBSDKModelKernelsTests
+
+// Lengths that are not a multiple of any vector width exercise the scalar tails
+static const int kLength = 19;
+
+- (void)testReLU
+{
+  std::vector<float> x = [self sequence:kLength];
+  fbsdk::kernels::relu(x.data(), kLength);
+  for (int i = 0; i < kLength; i++) {
+    XCTAssertEqual(x[i], fmaxf((float)(i - 9), 0));
+  }
+}
+
+- (void)testReductions
+{
+  std::vector<float> x = [self sequence:kLength];
+  std::vector<float> y(kLength, 2);
+  XCTAssertEqual(fbsdk::kernels::max(x.data(), kLength), 9);
+  XCTAssertEqual(fbsdk::kernels::max(x.data(), 3), -7);
+  XCTAssertEqual(fbsdk::kernels::sum(x.data(), kLength), 0);
+  XCTAssertEqual(fbsdk::kernels::dot(x.data(), y.data(), kLength), 0);
+  XCTAssertEqual(fbsdk::kernels::dot(x.data(), x.data(), kLength), 570);
+}
+
+- (void)testScalarOps
+{
+  std::vector<float> x = [self sequence:kLength];
+  fbsdk::kernels::add_scalar(x.data(), 9, x.data(), kLength);
+  fbsdk::kernels::div_scalar(x.data(), 2, x.data(), kLength);
+  for (int i = 0; i < kLength; i++) {
+    XCTAssertEqualWithAccuracy(x[i], i / 2.0, 0.0001);
+  }
+  fbsdk::kernels::mul_scalar(x.data(), 4, x.data(), kLength);
+  for (int i = 0; i < kLength; i++) {
+    XCTAssertEqual(x[i], i * 2);
+  }
+  fbsdk::kernels::div_scalar(x.data(), 4, x.data(), kLength);
+  fbsdk::kernels::exp(x.data(), x.data(), 2);
+  XCTAssertEqualWithAccuracy(x[0], 1, 0.0001);
+  XCTAssertEqualWithAccuracy(x[1], expf(0.5), 0.0001);
+}
+
+- (void)testExp
+{
+  std::vector<float> x(kLength);
+  for (int i = 0; i < kLength; i++) {
+    x[i] = (float)(i - 9) * 9.5f;
+  }
+  std::vector<float> y(kLength);
+  fbsdk::kernels::exp(x.data(), y.data(), kLength);
+  for (int i = 0; i < kLength; i++) {
+    XCTAssertEqualWithAccuracy(y[i], expf(x[i]), 4e-7 * expf(x[i]));
+  }
+}
+
+- (void)testSoftmax
+{
+  // every length up to three registers of any backend, so rows shorter than a register too
+  for (int n = 1; n <= 3 * 8 + 1; n++) {
+    std::vector<float> x(n);
+    for (int i = 0; i < n; i++) {
+      x[i] = (float)((i * 37) % 11) * 0.7f - 3;
+    }
+    std::vector<double> expected(n);
+    double m = x[0];
+    for (int i = 1; i < n; i++) {
+      m = fmax(m, x[i]);
+    }
+    double s = 0;
+    for (int i = 0; i < n; i++) {
+      expected[i] = ::exp(x[i] - m);
+      s += expected[i];
+    }
+    fbsdk::kernels::softmax(x.data(), n);
+    for (int i = 0; i < n; i++) {
+      XCTAssertEqualWithAccuracy(x[i], expected[i] / s, 1e-6);
+    }
+  }
+}
+
+- (void)testAddBias
+{
+  std::vector<float> y(2 * kLength, 1);
+  std::vector<float> b = [self sequence:kLength];
+  fbsdk::kernels::add_bias(y.data(), b.data(), 2, kLength);
+  for (int i = 0; i < 2 * kLength; i++) {
+    XCTAssertEqual(y[i], b[i % kLength] + 1);
+  }
+}
+
+- (void)testMaxPoolRows
+{
+  // rows of kLength channels whose values go up and down along the positions
+  const int len = 6;
+  std::vector<float> x(len * kLength);
+  for (int r = 0; r < len; r++) {
+    for (int c = 0; c < kLength; c++) {
+      x[r * kLength + c] = (float)(((r + c) % 4) * (c % 3 == 0 ? -1 : 1));
+    }
+  }
+  for (int pool_size = 1; pool_size <= 4; pool_size++) {
+    const int out_len = len - pool_size + 1;
+    std::vector<float> y(out_len * kLength);
+    fbsdk::kernels::max_pool_rows(x.data(), y.data(), len, kLength, pool_size);
+    for (int t = 0; t < out_len; t++) {
+      for (int c = 0; c < kLength; c++) {
+        float expected = x[t * kLength + c];
+        for (int q = 1; q < pool_size; q++) {
+          expected = fmaxf(expected, x[(t + q) * kLength + c]);
+        }
+        XCTAssertEqual(y[t * kLength + c], expected);
+      }
+    }
+  }
+}
+
+- (void)testMaxRows
+{
+  // wider than four registers of any backend, plus a tail
+  const int n = 4 * 8 + kLength;
+  const int len = 5;
+  std::vector<float> x(len * n);
+  for (int i = 0; i < len * n; i++) {
+    x[i] = (float)((i * 7) % 23) - 11;
+  }
+  std::vector<float> y(n);
+  fbsdk::kernels::max_rows(x.data(), y.data(), len, n);
+  for (int c = 0; c < n; c++) {
+    float expected = x[c];
+    for (int r = 1; r < len; r++) {
+      expected = fmaxf(expected, x[r * n + c]);
+    }
+    XCTAssertEqual(y[c], expected);
+  }
+}
+
+- (void)testGemm
+{
+  const int m = 3;
+  const int n = kLength;
+  const int k = 5;
+  std::vector<float> a = [self sequence:m * k];
+  std::vector<float> b = [self sequence:k * n];
+  std::vector<float> c(m * n, -1);
+  fbsdk::kernels::gemm(a.data(), b.data(), c.data(), m, n, k);
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < n; j++) {
+      float expected = 0;
+      for (int p = 0; p < k; p++) {
+        expected += a[i * k + p] * b[p * n + j];
+      }
+      XCTAssertEqualWithAccuracy(c[i * n + j], expected, 0.0001);
+    }
+  }
+}
+
+- (void)testGemmWithOverlappingRows
+{
+  // rows of a start input_size apart but span kernel_size * input_size values, as in conv1D
+  const int input_size = 3;
+  const int kernel_size = 2;
+  const int m = 6;
+  const int n = kLength;
+  const int k = kernel_size * input_size;
+  std::vector<float> a = [self sequence:(m + kernel_size - 1) * input_size];
+  std::vector<float> b = [self sequence:k * n];
+  std::vector<float> c(m * n, -1);
+  fbsdk::kernels::gemm(a.data(), input_size, b.data(), c.data(), m, n, k);
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < n; j++) {
+      float expected = 0;
+      for (int p = 0; p < k; p++) {
+        expected += a[i * input_size + p] * b[p * n + j];
+      }
+      XCTAssertEqualWithAccuracy(c[i * n + j], expected, 0.0001);
+    }
+  }
+}
+
+- (void)testConvGemmMatchesScalarReference
+{
+  // the conv0 shape of the MTML model: BLAS rejects its row stride input_size < k, so this covers the
+  // sliced Accelerate path, with every epilogue and with half precision weights
+  const int input_size = 32;
+  const int kernel_size = 3;
+  const int m = 10;
+  const int n = kLength;
+  const int k = kernel_size * input_size;
+  std::vector<float> a((m + kernel_size - 1) * input_size);
+  for (size_t i = 0; i < a.size(); i++) {
+    a[i] = (float)((int)(i % 9) - 4) / 4;
+  }
+  std::vector<uint16_t> b_half(k * n);
+  std::vector<float> b(k * n);
+  for (int i = 0; i < k * n; i++) {
+    b_half[i] = fbsdk::kernels::fp32_to_fp16((float)((i * 7) % 13 - 6) / 8);
+  }
+  fbsdk::kernels::widen<fbsdk::kernels::WeightsF16>(b_half.data(), b.data(), k * n);
+  std::vector<float> bias = [self sequence:n];
+  std::vector<float> reference(m * n);
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < n; j++) {
+      float acc = bias[j];
+      for (int p = 0; p < k; p++) {
+        acc += a[i * input_size + p] * b[p * n + j];
+      }
+      reference[i * n + j] = fmaxf(acc, 0);
+    }
+  }
+  for (int pool_size = 1; pool_size <= 2; pool_size++) {
+    const fbsdk::kernels::GemmEpilogue epilogue = {bias.data(), true, pool_size};
+    const int out_len = m - pool_size + 1;
+    std::vector<float> c(out_len * n, -1);
+    std::vector<float> c_half(out_len * n, -1);
+    fbsdk::kernels::gemm(a.data(), input_size, b.data(), c.data(), m, n, k, epilogue);
+    fbsdk::kernels::gemm_widening<fbsdk::kernels::WeightsF16>(a.data(), input_size, b_half.data(), c_half.data(), m, n, k, epilogue);
+    for (int t = 0; t < out_len; t++) {
+      for (int j = 0; j < n; j++) {
+        float expected = reference[t * n + j];
+        for (int q = 1; q < pool_size; q++) {
+          expected = fmaxf(expected, reference[(t + q) * n + j]);
+        }
+        XCTAssertEqualWithAccuracy(c[t * n + j], expected, 1e-4);
+        XCTAssertEqualWithAccuracy(c_half[t * n + j], expected, 1e-4);
+      }
+    }
+  }
+}
+
+- (void)testGemmBlockSparse
+{
+  // every other block of each row of b is stored, and a has a zero that is skipped
+  const int m = 3;
+  const int n = 24;
+  const int k = 5;
+  std::vector<float> a = [self sequence:m * k];
+  for (int block : {4, 8}) {
+    std::vector<float> b(k * n, 0);
+    std::vector<int> row_offsets;
+    std::vector<int> block_cols;
+    std::vector<float> values;
+    for (int p = 0; p < k; p++) {
+      row_offsets.push_back((int)block_cols.size());
+      for (int col = (p % 2) * block; col < n; col += 2 * block) {
+        block_cols.push_back(col);
+        for (int j = 0; j < block; j++) {
+          b[p * n + col + j] = (float)((p + j) % 5) - 2;
+          values.push_back(b[p * n + col + j]);
+        }
+      }
+    }
+    row_offsets.push_back((int)block_cols.size());
+    std::vector<float> bias = [self sequence:n];
+    std::vector<float> c(m * n, -1);
+    if (block == 4) {
+      fbsdk::kernels::gemm_block_sparse<4>(a.data(), k, row_offsets.data(), block_cols.data(), values.data(), bias.data(), c.data(), m, n, k);
+    } else {
+      fbsdk::kernels::gemm_block_sparse<8>(a.data(), k, row_offsets.data(), block_cols.data(), values.data(), bias.data(), c.data(), m, n, k);
+    }
+    for (int i = 0; i < m; i++) {
+      for (int j = 0; j < n; j++) {
+        float expected = bias[j];
+        for (int p = 0; p < k; p++) {
+          expected += a[i * k + p] * b[p * n + j];
+        }
+        XCTAssertEqualWithAccuracy(c[i * n + j], expected, 0.0001);
+      }
+    }
+  }
+}
+
+- (void)testFixedShapeKernelsMatchTheGenericOnes
+{
+  // fc2 over 1 and 6 examples, i.e. only remaining rows and a 4 row tile followed by them
+  std::vector<float> w = [self sequence:128 * 64];
+  std::vector<float> b = [self sequence:64];
+  const fbsdk::kernels::GemmEpilogue bias = {b.data(), false, 1};
+  fbsdk::kernels::DenseKernel dense = fbsdk::kernels::dense_for_shape(128, 64);
+  XCTAssertTrue(dense != (fbsdk::kernels::DenseKernel)fbsdk::kernels::dense);
+  for (int m : {1, 6}) {
+    std::vector<float> x = [self sequence:m * 128];
+    std::vector<float> expected(m * 64);
+    std::vector<float> actual(m * 64);
+    fbsdk::kernels::dense(x.data(), w.data(), expected.data(), m, 128, 64, bias);
+    dense(x.data(), w.data(), actual.data(), m, 128, 64, bias);
+    XCTAssertEqual(memcmp(actual.data(), expected.data(), expected.size() * sizeof(float)), 0);
+  }
+
+  XCTAssertTrue(fbsdk::kernels::dense_for_shape(190, 64) == (fbsdk::kernels::DenseKernel)fbsdk::kernels::dense);
+}
+
+- (void)testGemmS8
+{
+  // odd k exercises the zero padded last k pair, m = 6 both the 4 row blocks and the remaining rows
+  const int m = 6;
+  const int n = kLength;
+  const int k = 5;
+  std::vector<float> a = [self sequence:m * k];
+  std::vector<float> b = [self sequence:k * n];
+  std::vector<int8_t> a_q(m * k);
+  std::vector<int8_t> b_q(fbsdk::kernels::packed_s8_size(k, n));
+  std::vector<float> b_scales(n);
+  float a_scale = fbsdk::kernels::quantize_s8(a.data(), m * k, a_q.data());
+  fbsdk::kernels::quantize_columns_s8(b.data(), k, n, b_q.data(), b_scales.data());
+  std::vector<float> c(m * n, -1);
+  fbsdk::kernels::gemm_s8(a_q.data(), k, &a_scale, 0, b_q.data(), b_scales.data(), c.data(), m, n, k, fbsdk::kernels::kNoEpilogue);
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < n; j++) {
+      float expected = 0;
+      for (int p = 0; p < k; p++) {
+        expected += a[i * k + p] * b[p * n + j];
+      }
+      XCTAssertEqualWithAccuracy(c[i * n + j], expected, 0.02 * fabsf(expected) + 1);
+    }
+  }
+}
+
+- (void)testGemmS8BlocksAndPerRowScales
+{
+  // more than one block of columns and of k pairs, and 3 rows left over after a block of 4
+  const int m = 7;
+  const int n = 150;
+  const int k = 601;
+  std::vector<float> a = [self sequence:m * k];
+  std::vector<float> b = [self sequence:k * n];
+  std::vector<int8_t> a_q(m * k);
+  std::vector<int8_t> b_q(fbsdk::kernels::packed_s8_size(k, n));
+  std::vector<float> a_scales(m);
+  std::vector<float> b_scales(n);
+  for (int i = 0; i < m; i++) {
+    a_scales[i] = fbsdk::kernels::quantize_s8(a.data() + i * k, k, a_q.data() + i * k);
+  }
+  fbsdk::kernels::quantize_columns_s8(b.data(), k, n, b_q.data(), b_scales.data());
+  std::vector<float> bias = [self sequence:n];
+  const fbsdk::kernels::GemmEpilogue epilogue = {bias.data(), true, 1};
+  std::vector<float> c(m * n, -1);
+  fbsdk::kernels::gemm_s8(a_q.data(), k, a_scales.data(), 1, b_q.data(), b_scales.data(), c.data(), m, n, k, epilogue);
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < n; j++) {
+      int32_t dot = 0;
+      for (int p = 0; p < k; p++) {
+        dot += a_q[i * k + p] * b_q[(p / 2) * 2 * n + 2 * j + p % 2];
+      }
+      const float expected = fmaxf((float)dot * (a_scales[i] * b_scales[j]) + bias[j], 0);
+      XCTAssertEqualWithAccuracy(c[i * n + j], expected, 1e-5 * fabsf(expected));
+    }
+  }
+}
+
+- (void)testQuantizeS8
+{
+  std::vector<float> x = [self sequence:kLength];
+  std::vector<int8_t> q(kLength);
+  float scale = fbsdk::kernels::quantize_s8(x.data(), kLength, q.data());
+  XCTAssertEqualWithAccuracy(scale, 9 / 127.0, 0.0001);
+  XCTAssertEqual(q[0], -127);
+  XCTAssertEqual(q[9], 0);
+  XCTAssertEqual(q[kLength - 1], 127);
+
+  std::vector<float> zeros(kLength, 0);
+  XCTAssertEqual(fbsdk::kernels::quantize_s8(zeros.data(), kLength, q.data()), 0);
+}
+
+- (void)testHalfPrecisionConversions
+{
+  XCTAssertEqual(fbsdk::kernels::fp32_to_fp16(1), 0x3c00);
+  XCTAssertEqual(fbsdk::kernels::fp32_to_fp16(-2.5), 0xc100);
+  XCTAssertEqual(fbsdk::kernels::fp32_to_fp16(65520), 0x7c00, "Should round to infinity");
+  XCTAssertEqual(fbsdk::kernels::fp32_to_fp16(1 + 1 / 2048.0), 0x3c00, "Should round ties to even");
+  XCTAssertEqual(fbsdk::kernels::fp16_to_fp32(0x0001), 5.9604644775390625e-08f, "Should widen subnormals");
+  XCTAssertEqual(fbsdk::kernels::fp32_to_bf16(1.00390625f), 0x3f80, "Should round ties to even");
+  XCTAssertEqual(fbsdk::kernels::bf16_to_fp32(0xc020), -2.5);
+  for (int h = 0; h < 0x7c00; h++) {
+    XCTAssertEqual(fbsdk::kernels::fp32_to_fp16(fbsdk::kernels::fp16_to_fp32((uint16_t)h)), h);
+  }
+}
+
+- (void)testGemmWideningIsBitExact
+{
+  const int m = 6;
+  const int n = kLength;
+  const int k = 5;
+  std::vector<float> a = [self sequence:m * k];
+  std::vector<uint16_t> b_half(k * n);
+  std::vector<float> b(k * n);
+  for (int i = 0; i < k * n; i++) {
+    b_half[i] = fbsdk::kernels::fp32_to_fp16((i % 11 - 5) / 3.0f);
+  }
+  fbsdk::kernels::widen<fbsdk::kernels::WeightsF16>(b_half.data(), b.data(), k * n);
+  std::vector<float> expected(m * n);
+  std::vector<float> c(m * n);
+  fbsdk::kernels::gemm(a.data(), k, b.data(), expected.data(), m, n, k, fbsdk::kernels::kNoEpilogue);
+  fbsdk::kernels::gemm_widening<fbsdk::kernels::WeightsF16>(a.data(), k, b_half.data(), c.data(), m, n, k, fbsdk::kernels::kNoEpilogue);
+  XCTAssertEqual(memcmp(c.data(), expected.data(), c.size() * sizeof(float)), 0);
+}
+
+- (void)testGemmWideningOverSeveralPanels
+{
+  // b does not fit one stack panel, so its columns are widened in several
+  const int m = 7;
+  const int n = 40;
+  const int k = 190;
+  std::vector<float> a(m * k);
+  std::vector<float> bias(n);
+  std::vector<uint16_t> b_half(k * n);
+  std::vector<float> b(k * n);
+  for (int i = 0; i < m * k; i++) {
+    a[i] = (i % 7 - 3) / 4.0f;
+  }
+  for (int j = 0; j < n; j++) {
+    bias[j] = (j % 5 - 2) / 8.0f;
+  }
+  for (int i = 0; i < k * n; i++) {
+    b_half[i] = fbsdk::kernels::fp32_to_fp16((i % 13 - 6) / 16.0f);
+  }
+  fbsdk::kernels::widen<fbsdk::kernels::WeightsF16>(b_half.data(), b.data(), k * n);
+  const fbsdk::kernels::GemmEpilogue epilogue = {bias.data(), true, 2};
+  std::vector<float> expected((m - 1) * n);
+  std::vector<float> c((m - 1) * n);
+  fbsdk::kernels::gemm(a.data(), k, b.data(), expected.data(), m, n, k, epilogue);
+  fbsdk::kernels::gemm_widening<fbsdk::kernels::WeightsF16>(a.data(), k, b_half.data(), c.data(), m, n, k, epilogue);
+  for (size_t i = 0; i < c.size(); i++) {
+    XCTAssertEqualWithAccuracy(c[i], expected[i], 1e-4);
+  }
+}
+
+- (std::vector<float>)sequence:(int)length
+{
+  std::vector<float> x(length);
+  for (int i = 0; i < length; i++) {
+    x[i] = (float)(i - length / 2);
+  }
+  return x;
+}
+
+@end
@@ -9,6 +9,7 @@
 #import <XCTest/XCTest.h>
 
 #import "FBSDKModelParser.h"
+#import "FBSDKModelWeights.hpp"
 using fbsdk::MTensor;
 using std::string;
 using std::unordered_map;
@@ -69,6 +70,104 @@ using std::vector;
   XCTAssertFalse(validatedRes);
 }
 
+- (void)testParseWeightsDataWithoutCopying
+{
+  // a 20 byte header keeps the floats aligned
+  NSData *data = [self _weightsDataWithHeader:@"{\"a\":[2], \"b\":[1]  }"];
+  unordered_map<string, MTensor> weights = [FBSDKModelParser parseWeightsData:data];
+
+  XCTAssertEqual((int)weights.size(), 2);
+  const float *bytes = (const float *)((const char *)data.bytes + 4 + 20);
+  XCTAssertEqual(weights["a"].data(), bytes, "Should point into the weights data");
+  XCTAssertEqual(weights["b"].data(), bytes + 2);
+  XCTAssertEqual(weights["a"].data()[1], 2);
+  XCTAssertEqual(weights["b"].data()[0], 3);
+}
+
+- (void)testParseWeightsDataWithUnalignedFloats
+{
+  NSData *data = [self _weightsDataWithHeader:@"{\"a\":[2],\"b\":[1]}"];
+  unordered_map<string, MTensor> weights = [FBSDKModelParser parseWeightsData:data];
+
+  XCTAssertEqual((int)weights.size(), 2);
+  XCTAssertEqual((uintptr_t)weights["a"].data() % 64, 0, "Should copy into an aligned buffer");
+  XCTAssertEqual(weights["a"].data()[0], 1);
+  XCTAssertEqual(weights["a"].data()[1], 2);
+  XCTAssertEqual(weights["b"].data()[0], 3);
+}
+
+- (void)testParseConvertedWeightsData
+{
+  NSData *legacy = [self _weightsDataWithHeader:@"{\"a\":[2],\"b\":[1]}"];
+  NSData *container = [FBSDKModelParser convertLegacyWeightsData:legacy];
+  XCTAssertTrue([FBSDKModelParser isWeightsContainer:container]);
+  XCTAssertFalse([FBSDKModelParser isWeightsContainer:legacy]);
+  XCTAssertNil([FBSDKModelParser convertLegacyWeightsData:container], "Should not convert a container again");
+
+  unordered_map<string, MTensor> weights = [FBSDKModelParser parseWeightsData:container];
+  XCTAssertEqual((int)weights.size(), 2);
+  XCTAssertTrue(weights["a"].sizes() == fbsdk::MShape({2}));
+  XCTAssertEqual(weights["a"].data()[1], 2);
+  XCTAssertEqual(weights["b"].data()[0], 3);
+  XCTAssertEqual(((const char *)weights["b"].data() - (const char *)container.bytes) % 64, 0, "Should align every tensor");
+}
+
+- (void)testParseHalfPrecisionWeightsData
+{
+  unordered_map<string, MTensor> weights;
+  weights["a"] = MTensor({3});
+  weights["a"].mutable_data()[0] = 1;
+  weights["a"].mutable_data()[1] = -0.5;
+  weights["a"].mutable_data()[2] = 1.0001;
+  const vector<char> &blob = fbsdk::MSerializeWeights(weights, fbsdk::kWeightsFlagFloat16Storage);
+  NSData *container = [NSData dataWithBytes:blob.data() length:blob.size()];
+  XCTAssertEqual([FBSDKModelParser weightsFlags:container], fbsdk::kWeightsFlagFloat16Storage);
+
+  unordered_map<string, MTensor> parsed = [FBSDKModelParser parseWeightsData:container];
+  XCTAssertTrue(parsed["a"].sizes() == fbsdk::MShape({3}));
+  XCTAssertEqual(parsed["a"].data()[0], 1);
+  XCTAssertEqual(parsed["a"].data()[1], -0.5);
+  XCTAssertEqual(parsed["a"].data()[2], 1, "Should round to half precision");
+}
+
+- (void)testParseCorruptedWeightsData
+{
+  NSData *legacy = [self _weightsDataWithHeader:@"{\"a\":[2],\"b\":[1]}"];
+  NSMutableData *container = [[FBSDKModelParser convertLegacyWeightsData:legacy] mutableCopy];
+  ((char *)container.mutableBytes)[container.length - 1] ^= 1;
+
+  XCTAssertTrue([FBSDKModelParser parseWeightsData:container].empty(), "Should fail the checksum");
+}
+
+- (void)testParseWeightsDataOverlappingTheDirectory
+{
+  unordered_map<string, MTensor> weights;
+  weights["a"] = MTensor({2});
+  vector<char> blob = fbsdk::MSerializeWeights(weights);
+  fbsdk::MWeightsEntry entry;
+  memcpy(&entry, blob.data() + sizeof(fbsdk::MWeightsHeader), sizeof(entry));
+  entry.offset = 0;
+  memcpy(blob.data() + sizeof(fbsdk::MWeightsHeader), &entry, sizeof(entry));
+  fbsdk::MWeightsHeader header;
+  memcpy(&header, blob.data(), sizeof(header));
+  header.crc32 = fbsdk::MCrc32(blob.data() + sizeof(header), blob.size() - sizeof(header));
+  memcpy(blob.data(), &header, sizeof(header));
+  NSData *container = [NSData dataWithBytes:blob.data() length:blob.size()];
+
+  XCTAssertTrue([FBSDKModelParser parseWeightsData:container].empty(), "Should reject a tensor in the header");
+}
+
+- (NSData *)_weightsDataWithHeader:(NSString *)header
+{
+  NSData *json = [header dataUsingEncoding:NSUTF8StringEncoding];
+  int length = (int)json.length;
+  const float floats[] = {1, 2, 3};
+  NSMutableData *data = [NSMutableData dataWithBytes:&length length:4];
+  [data appendData:json];
+  [data appendBytes:floats length:sizeof(floats)];
+  return data;
+}
+
 - (unordered_map<string, MTensor>)_mockWeightsWithRefDict:(NSDictionary<NSString *, NSArray<NSNumber *> *> *)dict
 {
   unordered_map<string, MTensor> weights;
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#import <XCTest/XCTest.h>
+
+#include <string.h>
+
+// the hooks are only built with the flag, the runtime is header-only so this test builds its own copy
+#define FBSDK_ML_PROFILING 1
+
+#include "FBSDKMockMTMLWeights.hpp"
+#include "FBSDKModelGraph.hpp"
+#include "FBSDKModelRuntime.hpp"
+
+@interface FBSDKModelProfilerTests : XCTestCase
+
+@end
+
+@implementation FBSDKModelProfilerTests
+
+- (void)testProfilesEveryStageOfAPrediction
+{
+  const fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart", ""};
+  fbsdk::MModelProfiler profiler;
+  fbsdk::MTMLInferenceOptions options;
+  options.fuse_conv_layers = false;
+  const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr, options);
+  options.profiler = &profiler;
+  const fbsdk::MTensor &actual = fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr, options);
+  XCTAssertEqual(memcmp(expected.data(), actual.data(), expected.count() * sizeof(float)), 0);
+
+  for (const char *stage : {"embedding", "conv0", "conv1", "conv2", "concat", "fc1", "fc2", "head", "prediction"}) {
+    XCTAssertEqual(profiler.Stage(stage).ns.count(), 1, "%s", stage);
+  }
+  XCTAssertEqual(profiler.Stage("global_max_pool").ns.count(), 3);
+  XCTAssertEqual(profiler.Stage("quantize").ns.count(), 0);
+  const fbsdk::MStageProfile &prediction = profiler.Stage("prediction");
+  XCTAssertGreaterThanOrEqual(prediction.ns.sum(), profiler.Stage("conv1").ns.sum());
+  XCTAssertGreaterThan(prediction.allocations.max(), 0, "Should count the allocations without an arena");
+  XCTAssertGreaterThan(prediction.bytes.max(), expected.count() * sizeof(float));
+
+  const fbsdk::MHistogram &lengths = profiler.InputLengths();
+  XCTAssertEqual(lengths.count(), 3);
+  XCTAssertEqual(lengths.min(), 0);
+  XCTAssertEqual(lengths.max(), strlen("fb_content_id"));
+}
+
+- (void)testCountsNoAllocationsWithAWarmArena
+{
+  const fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart"};
+  fbsdk::MModelProfiler profiler;
+  fbsdk::MTensorArena arena;
+  fbsdk::MTMLInferenceOptions options;
+  options.arena = &arena;
+  options.profiler = &profiler;
+  fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr, options);
+  profiler.Reset();
+  fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr, options);
+
+  for (const fbsdk::MStageProfile &stage : profiler.Stages()) {
+    if (stage.name != "prediction") {
+      XCTAssertEqual(stage.allocations.max(), 0, "%s", stage.name.c_str());
+    }
+  }
+}
+
+- (void)testExportsChromeTrace
+{
+  const std::unordered_map<std::string, fbsdk::MTensor> weights = FBSDKMockMTMLWeights();
+  const fbsdk::MOpGraphPlan plan = fbsdk::planOpGraph(fbsdk::MTMLOpGraph(), weights);
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart"};
+  fbsdk::MModelProfiler profiler;
+  fbsdk::runOpGraph(plan, texts, nullptr, nullptr, &profiler);
+  XCTAssertEqual(profiler.Stage("conv").ns.count(), 3);
+  XCTAssertEqual(profiler.Stage("dense").ns.count(), 4);
+
+  fbsdk::MTMLInferenceOptions options;
+  options.profiler = &profiler;
+  fbsdk::predictOnMTMLBatch("integrity_detect", texts, fbsdk::packMTMLWeights(weights), nullptr, options);
+  const std::string &json = profiler.ChromeTraceJSON();
+  XCTAssertEqual(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0);
+  XCTAssertNotEqual(json.find("{\"name\":\"conv\",\"cat\":\"mtml\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"), std::string::npos);
+  XCTAssertNotEqual(json.find("\"texts\":2,\"max_length\":13}"), std::string::npos);
+  XCTAssertEqual(profiler.dropped_trace_events(), 0);
+
+  fbsdk::MModelProfiler bounded(2);
+  options.profiler = &bounded;
+  fbsdk::predictOnMTMLBatch("integrity_detect", texts, fbsdk::packMTMLWeights(weights), nullptr, options);
+  XCTAssertGreaterThan(bounded.dropped_trace_events(), 0);
+  XCTAssertEqual(bounded.Stage("prediction").ns.count(), 1, "Should aggregate the dropped events");
+}
+
+- (void)testHistogramPercentiles
+{
+  fbsdk::MHistogram histogram;
+  for (uint64_t value : {0, 1, 2, 3, 4, 100, 1000}) {
+    histogram.Add(value);
+  }
+  XCTAssertEqual(histogram.count(), 7);
+  XCTAssertEqual(histogram.sum(), 1110);
+  XCTAssertEqual(histogram.min(), 0);
+  XCTAssertEqual(histogram.max(), 1000);
+  XCTAssertEqual(histogram.bucket(fbsdk::MHistogram::BucketOf(3)), 2);
+  XCTAssertEqual(histogram.Percentile(0), 0);
+  XCTAssertEqual(histogram.Percentile(0.5), 3);
+  XCTAssertEqual(histogram.Percentile(0.9), 1000);
+  XCTAssertEqual(fbsdk::MHistogram().Percentile(0.5), 0);
+}
+
+@end
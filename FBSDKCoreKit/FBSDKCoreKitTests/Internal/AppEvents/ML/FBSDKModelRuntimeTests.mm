@@ -8,6 +8,7 @@
 
 #import <XCTest/XCTest.h>
 
+#include "FBSDKMockMTMLWeights.hpp"
 #include "FBSDKModelRuntime.hpp"
 
 @interface FBSDKModelRuntimeTests : XCTestCase
@@ -56,6 +57,26 @@
   memcpy(expected.mutable_data(), *expected_data, expected.count() * sizeof(float));
   fbsdk::flatten(input, 1);
   [self AssertEqual:expected input:input];
+  XCTAssertTrue(input.strides() == expected.strides(), "Should recompute the strides");
+}
+
+- (void)testSlice
+{
+  fbsdk::MTensor input({2, 3, 4});
+  for (int i = 0; i < input.count(); i++) {
+    input.mutable_data()[i] = i;
+  }
+  XCTAssertTrue(input.strides() == fbsdk::MShape({12, 4, 1}));
+
+  const fbsdk::MTensorView &example = input.Slice(1);
+  XCTAssertTrue(example.sizes() == fbsdk::MShape({3, 4}));
+  XCTAssertTrue(example.strides() == fbsdk::MShape({4, 1}));
+  XCTAssertEqual(example.count(), 12);
+  XCTAssertEqual(example.data()[0], 12);
+
+  const fbsdk::MTensorView &row = example.Slice(2);
+  XCTAssertEqual(row.size(0), 4);
+  XCTAssertEqual(row.data()[3], 23);
 }
 
 - (void)testConcatenate
@@ -282,20 +303,105 @@
   [self AssertEqual:expected input:fbsdk::conv1D(input, conv)];
 }
 
-- (void)testTextVectorizationLessThanMaxLen
+- (void)testConv1DMatchesDirectConvolution
 {
-  char strs[] = {"0123456"};
-  const std::vector<int> expected{48, 49, 50, 51, 52, 53, 54, 0, 0, 0};
-  const std::vector<int> &res = fbsdk::vectorize(strs, 10);
-  XCTAssertEqual(expected, res);
+  const int n_examples = 2, seq_len = 10, input_size = 8, kernel_size = 3, output_size = 20;
+  const int output_len = seq_len - kernel_size + 1;
+  fbsdk::MTensor input({n_examples, seq_len, input_size});
+  fbsdk::MTensor conv({kernel_size, input_size, output_size});
+  for (int i = 0; i < input.count(); i++) {
+    input.mutable_data()[i] = (float)(i % 7) - 3;
+  }
+  for (int i = 0; i < conv.count(); i++) {
+    conv.mutable_data()[i] = (float)(i % 5) - 2;
+  }
+  fbsdk::MTensor expected({n_examples, output_len, output_size});
+  for (int n = 0; n < n_examples; n++) {
+    for (int i = 0; i < output_len; i++) {
+      for (int o = 0; o < output_size; o++) {
+        float sum = 0;
+        for (int m = 0; m < kernel_size; m++) {
+          for (int k = 0; k < input_size; k++) {
+            sum += input.data()[(n * seq_len + i + m) * input_size + k] * conv.data()[(m * input_size + k) * output_size + o];
+          }
+        }
+        expected.mutable_data()[(n * output_len + i) * output_size + o] = sum;
+      }
+    }
+  }
+  [self AssertEqual:expected input:fbsdk::conv1D(input, conv)];
 }
 
-- (void)testTextVectorizationLargerThanMaxLen
+- (void)testConv1DBiasReLUMaxPool1DMatchesUnfusedOps
 {
-  char strs[] = {"0123456"};
-  const std::vector<int> expected{48, 49, 50};
-  const std::vector<int> &res = fbsdk::vectorize(strs, 3);
-  XCTAssertEqual(expected, res);
+  fbsdk::MTensor input({2, 9, 5});
+  fbsdk::MTensor conv({3, 5, 20});
+  fbsdk::MTensor bias({20});
+  for (int i = 0; i < input.count(); i++) {
+    input.mutable_data()[i] = (float)(i % 11) - 5;
+  }
+  for (int i = 0; i < conv.count(); i++) {
+    conv.mutable_data()[i] = (float)(i % 7) - 3;
+  }
+  for (int i = 0; i < bias.count(); i++) {
+    bias.mutable_data()[i] = (float)(i % 3) - 1;
+  }
+  fbsdk::MTensor expected = fbsdk::conv1D(input, conv);
+  fbsdk::addmv(expected, bias);
+  fbsdk::relu(expected);
+  [self AssertEqual:expected input:fbsdk::conv1DBiasReLU(input, conv, bias)];
+  [self AssertEqual:fbsdk::maxPool1D(expected, 2) input:fbsdk::conv1DBiasReLUMaxPool1D(input, conv, bias, 2)];
+}
+
+- (void)testConvsOfABatchMatchTheConvsOfEachExample
+{
+  const int n_examples = 3, input_size = 8, output_size = 16;
+  fbsdk::MTensor conv({3, input_size, output_size});
+  fbsdk::MTensor bias({output_size});
+  for (int i = 0; i < conv.count(); i++) {
+    conv.mutable_data()[i] = (float)(i % 7) - 3;
+  }
+  for (int i = 0; i < bias.count(); i++) {
+    bias.mutable_data()[i] = (float)(i % 3) - 1;
+  }
+  const fbsdk::MQuantizedTensor &quantized = fbsdk::quantizePerChannel(conv);
+  // conv lengths with every number of rows left over by the register tile, stacked or not
+  for (int seq_len = 8; seq_len < 12; seq_len++) {
+    fbsdk::MTensor input({n_examples, seq_len, input_size});
+    for (int i = 0; i < input.count(); i++) {
+      input.mutable_data()[i] = (float)(i % 11) - 5;
+    }
+    for (int pool_size = 1; pool_size < 3; pool_size++) {
+      const fbsdk::MTensor &batch = fbsdk::conv1DBiasReLUMaxPool1D(input, conv, bias, pool_size);
+      const fbsdk::MTensor &quantized_batch = fbsdk::conv1DBiasReLUMaxPool1D(input, quantized, bias, pool_size);
+      XCTAssertEqual(batch.size(0), n_examples);
+      XCTAssertTrue(batch.sizes() == quantized_batch.sizes());
+      const int example_count = batch.count() / n_examples;
+      for (int n = 0; n < n_examples; n++) {
+        fbsdk::MTensor example({1, seq_len, input_size});
+        memcpy(example.mutable_data(), input.data() + n * example.count(), example.count() * sizeof(float));
+        const fbsdk::MTensor &single = fbsdk::conv1DBiasReLUMaxPool1D(example, conv, bias, pool_size);
+        const fbsdk::MTensor &quantized_single = fbsdk::conv1DBiasReLUMaxPool1D(example, quantized, bias, pool_size);
+        XCTAssertEqual(single.count(), example_count);
+        XCTAssertEqual(memcmp(single.data(), batch.data() + n * example_count, example_count * sizeof(float)), 0);
+        XCTAssertEqual(memcmp(quantized_single.data(), quantized_batch.data() + n * example_count, example_count * sizeof(float)), 0);
+      }
+    }
+  }
+}
+
+- (void)testEmbeddingLessThanMaxLen
+{
+  const std::vector<float> expected{48, 49, 50, 51, 52, 53, 54, 0, 0, 0};
+  const fbsdk::MTensor &res = fbsdk::embedding(std::vector<const char *>{"0123456"}, 10, [self tokenEmbeddings]);
+  XCTAssertEqual(expected, std::vector<float>(res.data(), res.data() + res.count()));
+}
+
+- (void)testEmbeddingLargerThanMaxLen
+{
+  const std::vector<float> expected{48, 49, 50};
+  const fbsdk::MTensor &res = fbsdk::embedding(std::vector<const char *>{"0123456"}, 3, [self tokenEmbeddings]);
+  XCTAssertEqual(expected, std::vector<float>(res.data(), res.data() + res.count()));
 }
 
 - (void)testTranspose3D
@@ -475,11 +581,416 @@
   [self AssertEqual:expected input:fbsdk::maxPool1D(input, 3)];
 }
 
+- (void)testPackMTMLWeights
+{
+  std::unordered_map<std::string, fbsdk::MTensor> weights = FBSDKMockMTMLWeights();
+  const fbsdk::PackedMTMLModel &model = fbsdk::packMTMLWeights(weights);
+  XCTAssertFalse(model.empty());
+  XCTAssertEqual(model.heads.size(), 2);
+  [self AssertEqual:fbsdk::transpose3D(weights["convs.0.weight"]) input:model.convs_0_weight];
+  [self AssertEqual:fbsdk::transpose2D(weights["fc1.weight"]) input:model.fc1_weight];
+  [self AssertEqual:fbsdk::transpose2D(weights["app_event_pred.weight"]) input:model.heads.at("app_event_pred").weight];
+}
+
+- (void)testPackMTMLWeightsPicksKernelsForItsShapes
+{
+  const fbsdk::PackedMTMLModel &model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  XCTAssertTrue(model.fc_kernels[0] == fbsdk::kernels::dense_for_shape(190, 128));
+  XCTAssertTrue(model.fc_kernels[1] == fbsdk::kernels::dense_for_shape(128, 64));
+
+  fbsdk::PackedMTMLModel generic = model;
+  for (fbsdk::kernels::DenseKernel &kernel : generic.fc_kernels) {
+    kernel = fbsdk::kernels::dense;
+  }
+  fbsdk::MTMLInferenceOptions options;
+  options.fuse_embedding = false;
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart", ""};
+  const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch("app_event_pred", texts, generic, nullptr, options);
+  const fbsdk::MTensor &actual = fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr, options);
+  XCTAssertEqual(memcmp(expected.data(), actual.data(), (size_t)expected.count() * sizeof(float)), 0);
+}
+
+- (void)testPackMTMLWeightsWithMissingWeights
+{
+  std::unordered_map<std::string, fbsdk::MTensor> weights = FBSDKMockMTMLWeights();
+  weights.erase("fc2.bias");
+  XCTAssertTrue(fbsdk::packMTMLWeights(weights).empty());
+}
+
+- (void)testPredictOnMTMLWithPackedModel
+{
+  std::unordered_map<std::string, fbsdk::MTensor> weights = FBSDKMockMTMLWeights();
+  const fbsdk::PackedMTMLModel &model = fbsdk::packMTMLWeights(weights);
+  float dense[DENSE_FEATURE_LEN] = {0};
+  for (const char *text : {"fb_content_id", "add to cart"}) {
+    [self AssertEqual:fbsdk::predictOnMTML("integrity_detect", text, weights, nullptr)
+                input:fbsdk::predictOnMTML("integrity_detect", text, model, nullptr)];
+    [self AssertEqual:fbsdk::predictOnMTML("app_event_pred", text, weights, dense)
+                input:fbsdk::predictOnMTML("app_event_pred", text, model, dense)];
+  }
+  XCTAssertEqual(fbsdk::predictOnMTML("unknown_task", "text", model, nullptr).count(), 0);
+}
+
+- (void)testPredictOnMTMLBatch
+{
+  const fbsdk::PackedMTMLModel &model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "email", "add to cart"};
+  float dense[3 * DENSE_FEATURE_LEN];
+  for (int i = 0; i < 3 * DENSE_FEATURE_LEN; i++) {
+    dense[i] = (float)(i % 5);
+  }
+  const fbsdk::MTensor &batch = fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, dense);
+  XCTAssertEqual(batch.size(0), 3);
+  XCTAssertEqual(batch.size(1), 5);
+  for (int n = 0; n < texts.size(); n++) {
+    const fbsdk::MTensor &single = fbsdk::predictOnMTML("app_event_pred", texts[n], model, dense + n * DENSE_FEATURE_LEN);
+    for (int i = 0; i < 5; i++) {
+      XCTAssertEqualWithAccuracy(single.data()[i], batch.data()[n * 5 + i], 0.0001);
+    }
+  }
+  XCTAssertEqual(fbsdk::predictOnMTMLBatch("app_event_pred", {}, model, nullptr).count(), 0);
+}
+
+- (void)testPredictOnMTMLWithUnfusedConvLayers
+{
+  const fbsdk::PackedMTMLModel &model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart"};
+  fbsdk::MTMLInferenceOptions unfused;
+  unfused.fuse_conv_layers = false;
+  [self AssertEqual:fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr, unfused)
+              input:fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr)];
+}
+
+- (void)testPredictOnMTMLWithArena
+{
+  const fbsdk::PackedMTMLModel &model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart"};
+  fbsdk::MTensorArena arena;
+  fbsdk::MTMLInferenceOptions options;
+  options.arena = &arena;
+  const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr);
+  [self AssertEqual:expected input:fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr, options)];
+  XCTAssertEqual(arena.capacity(), fbsdk::mtmlWorkspaceBytes(model, 2));
+  XCTAssertLessThanOrEqual(arena.used(), arena.capacity());
+
+  [self AssertEqual:expected input:fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr, options)];
+  XCTAssertEqual(arena.capacity(), fbsdk::mtmlWorkspaceBytes(model, 2), "Should reuse the workspace");
+}
+
+- (void)testQuantizedConv1DBiasReLUMaxPool1D
+{
+  fbsdk::MTensor input({2, 9, 4});
+  fbsdk::MTensor conv({3, 4, 5});
+  fbsdk::MTensor bias({5});
+  for (int i = 0; i < input.count(); i++) {
+    input.mutable_data()[i] = (float)(i % 7) - 3;
+  }
+  for (int i = 0; i < conv.count(); i++) {
+    conv.mutable_data()[i] = (float)(i % 5) - 2;
+  }
+  for (int i = 0; i < bias.count(); i++) {
+    bias.mutable_data()[i] = (float)i - 2;
+  }
+  const fbsdk::MTensor &expected = fbsdk::conv1DBiasReLUMaxPool1D(input, conv, bias, 2);
+  const fbsdk::MTensor &quantized = fbsdk::conv1DBiasReLUMaxPool1D(input, fbsdk::quantizePerChannel(conv), bias, 2);
+  XCTAssertTrue(expected.sizes() == quantized.sizes());
+  for (int i = 0; i < expected.count(); i++) {
+    XCTAssertEqualWithAccuracy(expected.data()[i], quantized.data()[i], 0.05);
+  }
+}
+
+- (void)testQuantizedPredictionsPickTheSameClasses
+{
+  fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart", "sign up", "1 hacker way", "password"};
+  const float thresholds[] = {0.6, 0.6, 0.2};
+  XCTAssertEqual(fbsdk::countQuantizedMismatches("integrity_detect", texts, model, nullptr, thresholds, 3), -1, "Should require a quantized model");
+
+  fbsdk::quantizeMTMLModel(model);
+  XCTAssertTrue(model.quantized());
+  XCTAssertEqual(fbsdk::countQuantizedMismatches("integrity_detect", texts, model, nullptr, thresholds, 3), 0);
+
+  fbsdk::MTMLInferenceOptions quantized;
+  quantized.quantized = true;
+  [self AssertEqual:fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr)
+              input:fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr, quantized)];
+}
+
+- (void)testHalfPrecisionPredictionsMatchTheWidenedModel
+{
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart", "sign up"};
+  for (fbsdk::MHalfType type : {fbsdk::kHalfFloat16, fbsdk::kHalfBFloat16}) {
+    fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+    fbsdk::storeMTMLModelInHalfPrecision(model, type);
+    XCTAssertTrue(model.half_precision());
+    XCTAssertEqual(model.fc1_weight.count(), 0);
+
+    const fbsdk::PackedMTMLModel &widened = fbsdk::widenMTMLModel(model);
+    const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch("integrity_detect", texts, widened, nullptr);
+    const fbsdk::MTensor &actual = fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr);
+    XCTAssertTrue(expected.sizes() == actual.sizes());
+    XCTAssertEqual(memcmp(expected.data(), actual.data(), (size_t)expected.count() * sizeof(float)), 0);
+  }
+}
+
+- (void)testBlockSparseDense
+{
+  // every third block of 4 columns is nonzero
+  fbsdk::MTensor w({6, 12});
+  float *w_data = w.mutable_data();
+  for (int i = 0; i < w.count(); i++) {
+    w_data[i] = (i / 4) % 3 == 0 ? (float)(i % 7) - 3 : 0;
+  }
+  const fbsdk::MBlockSparseTensor &sparse = fbsdk::toBlockSparse(w, 4);
+  XCTAssertEqual(sparse.n_blocks(), 6);
+  XCTAssertEqualWithAccuracy(fbsdk::blockDensity(w, 4), 1 / 3.0, 0.0001);
+  XCTAssertTrue(fbsdk::toBlockSparse(w, 5).empty());
+
+  fbsdk::MTensor x({2, 6});
+  fbsdk::MTensor b({12});
+  for (int i = 0; i < x.count(); i++) {
+    x.mutable_data()[i] = i % 3 == 0 ? 0 : (float)i;
+  }
+  for (int i = 0; i < b.count(); i++) {
+    b.mutable_data()[i] = (float)i;
+  }
+  [self AssertEqual:fbsdk::dense(x, w, b) input:fbsdk::dense(x, sparse, b)];
+
+  for (fbsdk::MHalfType type : {fbsdk::kHalfFloat16, fbsdk::kHalfBFloat16}) {
+    const fbsdk::MBlockSparseTensor &half = fbsdk::toHalfPrecision(sparse, type);
+    XCTAssertTrue(half.half_precision());
+    XCTAssertEqual(half.block_cols(), sparse.block_cols(), "Should share the block indices");
+    [self AssertEqual:fbsdk::dense(x, w, b) input:fbsdk::dense(x, half, b)];
+  }
+}
+
+- (void)testPackMTMLWeightsRunsPrunedFcLayersSparse
+{
+  std::unordered_map<std::string, fbsdk::MTensor> weights = FBSDKMockMTMLWeights();
+  XCTAssertTrue(fbsdk::packMTMLWeights(weights).fc1_sweight.empty());
+
+  // prune 3 of every 4 blocks of 8 outputs of fc1 and fc2, per input
+  for (const char *key : {"fc1.weight", "fc2.weight"}) {
+    fbsdk::MTensor &w = weights[key];
+    const int in_size = w.size(1);
+    for (int o = 0; o < w.size(0); o++) {
+      for (int i = 0; i < in_size; i++) {
+        if ((o / 8 + i) % 4 != 0) {
+          w.mutable_data()[o * in_size + i] = 0;
+        }
+      }
+    }
+  }
+  fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(weights);
+  XCTAssertEqual(model.fc1_sweight.block_size(), 8);
+  XCTAssertEqual(model.fc2_sweight.block_size(), 8);
+  XCTAssertEqual(model.fc1_weight.count(), 0, "Should release the dense weights");
+  XCTAssertEqual(model.fc2_weight.count(), 0, "Should release the dense weights");
+
+  fbsdk::PackedMTMLModel dense_model = model;
+  dense_model.fc1_weight = fbsdk::transpose2D(weights["fc1.weight"]);
+  dense_model.fc2_weight = fbsdk::transpose2D(weights["fc2.weight"]);
+  dense_model.fc1_sweight = fbsdk::MBlockSparseTensor();
+  dense_model.fc2_sweight = fbsdk::MBlockSparseTensor();
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart", ""};
+  const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch("app_event_pred", texts, dense_model, nullptr);
+  [self AssertEqual:expected input:fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr)];
+
+  fbsdk::storeMTMLModelInHalfPrecision(model, fbsdk::kHalfBFloat16);
+  XCTAssertTrue(model.fc1_sweight.half_precision());
+  XCTAssertEqual(model.fc1_hweight.count(), 0, "Should not keep a dense half precision copy");
+  XCTAssertEqual(model.fc2_hweight.count(), 0, "Should not keep a dense half precision copy");
+  [self AssertEqual:expected input:fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr)];
+
+  fbsdk::quantizeMTMLModel(model);
+  XCTAssertEqual(model.fc1_qweight.sizes(), dense_model.fc1_weight.sizes());
+}
+
+- (void)testPredictOnMTMLWithEmbeddingConvTable
+{
+  fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart", ""};
+  const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr);
+
+  fbsdk::precomputeMTMLEmbeddingConv(model);
+  XCTAssertTrue(model.embed_conv0_table.sizes() == fbsdk::MShape({3, 256, 32}));
+  [self AssertEqual:fbsdk::conv1DBiasReLU(fbsdk::embedding(texts, SEQ_LEN, model.embed_weight), model.convs_0_weight, model.convs_0_bias)
+              input:fbsdk::embeddingConv1DBiasReLU(texts, SEQ_LEN, model.embed_conv0_table, model.convs_0_bias)];
+  [self AssertEqual:expected input:fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr)];
+}
+
+- (void)testLengthBucketsMatchTheFullPass
+{
+  fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  XCTAssertEqual(model.receptive_field, 8);
+  const std::vector<const char *> texts = {"email", "fb_content_id", "add to cart | checkout | buy now"};
+  XCTAssertEqual(fbsdk::mtmlBucketLength({"email", "fb_content_id"}, model), 32);
+  XCTAssertEqual(fbsdk::mtmlBucketLength(texts, model), 64);
+  XCTAssertEqual(fbsdk::mtmlBucketLength({"0123456789abcdefghijklmno"}, model), 32);
+  XCTAssertEqual(fbsdk::mtmlBucketLength({"0123456789abcdefghijklmno"}, model, 1), 64);
+
+  fbsdk::quantizeMTMLModel(model);
+  fbsdk::MTMLInferenceOptions full;
+  full.length_buckets = false;
+  fbsdk::MTMLInferenceOptions buckets;
+  for (bool quantized : {false, true}) {
+    full.quantized = quantized;
+    buckets.quantized = quantized;
+    for (const std::vector<const char *> &batch : {texts, std::vector<const char *> {"email"}}) {
+      const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch("app_event_pred", batch, model, nullptr, full);
+      const fbsdk::MTensor &actual = fbsdk::predictOnMTMLBatch("app_event_pred", batch, model, nullptr, buckets);
+      XCTAssertTrue(expected.sizes() == actual.sizes());
+      XCTAssertEqual(memcmp(expected.data(), actual.data(), (size_t)expected.count() * sizeof(float)), 0);
+    }
+  }
+}
+
+- (void)testArenaAllocate
+{
+  fbsdk::MTensorArena arena;
+  arena.Reserve(256);
+  const fbsdk::MTensor &x = arena.Allocate({3});
+  const fbsdk::MTensor &y = arena.Allocate({2, 5});
+  XCTAssertEqual((uintptr_t)x.data() % 64, 0);
+  XCTAssertEqual((uintptr_t)y.data() % 64, 0);
+  XCTAssertEqual(y.data() - x.data(), 16);
+  XCTAssertEqual(arena.used(), 128);
+
+  // does not fit, falls back to the heap and grows the buffer on the next round
+  const fbsdk::MTensor &z = arena.Allocate({64});
+  XCTAssertEqual(z.count(), 64);
+  XCTAssertEqual(arena.used(), 128);
+  arena.Reset();
+  XCTAssertEqual(arena.capacity(), 384);
+  XCTAssertEqual(arena.used(), 0);
+}
+
+- (void)testArenaPlaceNext
+{
+  fbsdk::MTensorArena arena;
+  arena.Reserve(256, 128);
+  XCTAssertEqual(arena.used(), 128, "Should set the planned bytes aside");
+  const fbsdk::MTensor &x = arena.Allocate({3});
+  arena.PlaceNext(64);
+  const fbsdk::MTensor &y = arena.Allocate({2, 5});
+  arena.PlaceNext(0);
+  const fbsdk::MTensor &z = arena.Allocate({4});
+  XCTAssertEqual(x.data() - z.data(), 32, "Should bump allocate after the planned bytes");
+  XCTAssertEqual(y.data() - z.data(), 16);
+  XCTAssertEqual(arena.used(), 192);
+}
+
+- (void)testPlanBuffers
+{
+  // a chain of tensors that each live until the next one has been written
+  const std::vector<fbsdk::MBufferLifetime> buffers = {
+    {100, 0, 1},
+    {40, 1, 2},
+    {50, 2, 3},
+    {60, 3, 4},
+  };
+  const fbsdk::MBufferPlan &plan = fbsdk::MPlanBuffers(buffers);
+  XCTAssertEqual(plan.total, 250);
+  XCTAssertEqual(plan.peak, 150);
+  XCTAssertEqual(plan.offsets[0], 0);
+  XCTAssertEqual(plan.offsets[1], 110);
+  XCTAssertEqual(plan.offsets[2], 60);
+  XCTAssertEqual(plan.offsets[3], 0, "Should reuse the memory of the first tensor");
+
+  const fbsdk::MBufferPlan &aligned = fbsdk::MPlanBuffers(buffers, 16);
+  for (size_t offset : aligned.offsets) {
+    XCTAssertEqual(offset % 16, 0);
+  }
+}
+
+- (void)testPredictOnMTMLReusesDeadIntermediates
+{
+  const fbsdk::PackedMTMLModel &model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  for (const fbsdk::MBufferPlan &plan : model.buffer_plans) {
+    XCTAssertLessThan(plan.peak * 3, plan.total * 2, "Should need at most two thirds of the memory");
+  }
+
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart", "checkout"};
+  fbsdk::MTensorArena arena;
+  for (int fuse_conv_layers = 0; fuse_conv_layers < 2; fuse_conv_layers++) {
+    fbsdk::MTMLInferenceOptions options;
+    options.fuse_conv_layers = fuse_conv_layers == 1;
+    const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr, options);
+    options.arena = &arena;
+    const fbsdk::MTensor &actual = fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr, options);
+    XCTAssertEqual(memcmp(expected.data(), actual.data(), (size_t)expected.count() * sizeof(float)), 0);
+  }
+}
+
+- (void)testPredictMTMLHead
+{
+  fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart"};
+  const fbsdk::MTensor &embedding = fbsdk::predictMTMLEmbedding(texts, model, nullptr);
+  XCTAssertEqual(embedding.size(1), 64);
+  [self AssertEqual:fbsdk::predictOnMTMLBatch("integrity_detect", texts, model, nullptr)
+              input:fbsdk::predictMTMLHead("integrity_detect", embedding, model)];
+  [self AssertEqual:fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr)
+              input:fbsdk::predictMTMLHead("app_event_pred", embedding, model)];
+  XCTAssertEqual(fbsdk::predictMTMLHead("unknown", embedding, model).count(), 0);
+}
+
+- (void)testPredictOnMTMLTasks
+{
+  fbsdk::PackedMTMLModel model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart"};
+  fbsdk::MTensorArena arena;
+  fbsdk::MTMLInferenceOptions options;
+  options.arena = &arena;
+  std::unordered_map<std::string, fbsdk::MTensor> probs = fbsdk::predictOnMTMLTasks({"integrity_detect", "app_event_pred", "unknown"}, texts, model, nullptr, options);
+  XCTAssertEqual(probs.size(), 2, "Should leave out tasks without a head");
+  XCTAssertLessThanOrEqual(arena.used(), fbsdk::mtmlWorkspaceBytes(model, 2), "Should fit every head in the workspace");
+
+  const fbsdk::MTensor &embedding = fbsdk::predictMTMLEmbedding(texts, model, nullptr);
+  [self AssertEqual:fbsdk::predictMTMLHead("integrity_detect", embedding, model) input:probs["integrity_detect"]];
+  [self AssertEqual:fbsdk::predictMTMLHead("app_event_pred", embedding, model) input:probs["app_event_pred"]];
+}
+
+- (void)testClassifyOnMTMLBatch
+{
+  const fbsdk::PackedMTMLModel &model = fbsdk::packMTMLWeights(FBSDKMockMTMLWeights());
+  const std::vector<const char *> texts = {"fb_content_id", "add to cart", "checkout", "email"};
+  const fbsdk::MTensor &expected = fbsdk::predictOnMTMLBatch("app_event_pred", texts, model, nullptr);
+  for (float threshold : {0.0f, 0.3f, 1.1f}) {
+    const float thresholds[] = {threshold, threshold, threshold, threshold, threshold};
+    std::vector<int> classes;
+    const fbsdk::MTensor &probs = fbsdk::classifyOnMTMLBatch("app_event_pred", texts, model, nullptr, thresholds, 5, classes);
+    [self AssertEqual:expected input:probs];
+    XCTAssertEqual(classes.size(), texts.size());
+    for (int n = 0; n < (int)texts.size(); n++) {
+      XCTAssertEqual(classes[n], fbsdk::firstClassOverThreshold(expected.Slice(n).data(), thresholds, 5));
+    }
+    if (threshold > 1) {
+      XCTAssertEqual(classes[0], -1, "Should not pick a class no probability reaches");
+    }
+  }
+
+  const float thresholds[] = {0, 0, 0, 0, 0, 0};
+  std::vector<int> classes;
+  XCTAssertEqual(fbsdk::classifyOnMTMLBatch("app_event_pred", texts, model, nullptr, thresholds, 6, classes).count(), 0, "Should need a class per threshold");
+  XCTAssertEqual(fbsdk::classifyOnMTMLBatch("unknown", texts, model, nullptr, thresholds, 5, classes).count(), 0);
+}
+
+// Embeddings of size 1 whose value is the token
+- (fbsdk::MTensor)tokenEmbeddings
+{
+  fbsdk::MTensor embeddings({256, 1});
+  for (int i = 0; i < embeddings.count(); i++) {
+    embeddings.mutable_data()[i] = i;
+  }
+  return embeddings;
+}
+
 - (void)AssertEqual:(const fbsdk::MTensor &)expected
               input:(const fbsdk::MTensor &)input
 {
-  const std::vector<int> &expected_sizes = expected.sizes();
-  const std::vector<int> &input_sizes = input.sizes();
+  const fbsdk::MShape &expected_sizes = expected.sizes();
+  const fbsdk::MShape &input_sizes = input.sizes();
   XCTAssertEqual(expected_sizes, input_sizes);
   const float *expected_data = expected.data();
   const float *input_data = input.data();
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#import <XCTest/XCTest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "FBSDKModelSnapshot.hpp"
+
+@interface FBSDKModelSnapshotTests : XCTestCase
+
+@end
+
+@implementation FBSDKModelSnapshotTests
+
+- (void)testReadersKeepTheirSnapshot
+{
+  fbsdk::MSnapshotHolder<fbsdk::MTMLSnapshot> holder;
+  XCTAssertTrue(holder.Load() == nullptr);
+
+  std::shared_ptr<fbsdk::MTMLSnapshot> first = std::make_shared<fbsdk::MTMLSnapshot>();
+  first->version = 1;
+  holder.Publish(first);
+  std::shared_ptr<const fbsdk::MTMLSnapshot> reader = holder.Load();
+  first.reset();
+
+  std::shared_ptr<fbsdk::MTMLSnapshot> second = std::make_shared<fbsdk::MTMLSnapshot>();
+  second->version = 2;
+  holder.Publish(second);
+  XCTAssertEqual(reader->version, 1, "Should not be affected by a newer snapshot");
+  XCTAssertEqual(holder.Load()->version, 2);
+}
+
+- (void)testReplaceFailsIfAnotherSnapshotWasPublished
+{
+  fbsdk::MSnapshotHolder<fbsdk::MTMLSnapshot> holder;
+  holder.Publish(std::make_shared<fbsdk::MTMLSnapshot>());
+  std::shared_ptr<const fbsdk::MTMLSnapshot> expected = holder.Load();
+
+  std::shared_ptr<fbsdk::MTMLSnapshot> other = std::make_shared<fbsdk::MTMLSnapshot>(*expected);
+  other->quantized_tasks.insert("integrity_detect");
+  holder.Publish(other);
+
+  std::shared_ptr<fbsdk::MTMLSnapshot> updated = std::make_shared<fbsdk::MTMLSnapshot>(*expected);
+  updated->quantized_tasks.insert("app_event_pred");
+  XCTAssertFalse(holder.Replace(expected, updated));
+  XCTAssertTrue(expected == holder.Load(), "Should load the current snapshot");
+
+  updated = std::make_shared<fbsdk::MTMLSnapshot>(*expected);
+  updated->quantized_tasks.insert("app_event_pred");
+  XCTAssertTrue(holder.Replace(expected, updated));
+  XCTAssertEqual(holder.Load()->quantized_tasks.size(), 2);
+}
+
+- (void)testConcurrentReadersAndWriter
+{
+  fbsdk::MSnapshotHolder<fbsdk::MTMLSnapshot> holder;
+  std::atomic<bool> done(false);
+  std::atomic<int> torn(0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&] {
+      while (!done) {
+        std::shared_ptr<const fbsdk::MTMLSnapshot> snapshot = holder.Load();
+        if (snapshot && snapshot->model_id != snapshot->version) {
+          torn++;
+        }
+      }
+    });
+  }
+  for (uint64_t i = 1; i <= 1000; i++) {
+    std::shared_ptr<fbsdk::MTMLSnapshot> snapshot = std::make_shared<fbsdk::MTMLSnapshot>();
+    snapshot->version = i;
+    snapshot->model_id = i;
+    holder.Publish(snapshot);
+  }
+  done = true;
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+  XCTAssertEqual(torn.load(), 0);
+  XCTAssertEqual(holder.Load()->version, 1000);
+}
+
+@end
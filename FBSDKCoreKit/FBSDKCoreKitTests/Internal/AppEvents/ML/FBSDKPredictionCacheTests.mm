@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#import <XCTest/XCTest.h>
+
+#include <vector>
+
+#include "FBSDKPredictionCache.hpp"
+
+@interface FBSDKPredictionCacheTests : XCTestCase
+
+@end
+
+@implementation FBSDKPredictionCacheTests
+
+- (void)testLookupAndInsert
+{
+  fbsdk::MPredictionCache cache(4096);
+  fbsdk::MPredictionKey key = {"integrity_detect", 1, 0, 0, ""};
+  key.SetText("fb_content_id");
+  const float probs[] = {0.7, 0.2, 0.1};
+  std::vector<float> cached;
+  XCTAssertFalse(cache.Lookup(key, cached));
+
+  cache.Insert(key, probs, 3);
+  XCTAssertTrue(cache.Lookup(key, cached));
+  XCTAssertTrue(cached == std::vector<float>(probs, probs + 3));
+  XCTAssertEqual(cache.hits(), 1);
+  XCTAssertEqual(cache.misses(), 1);
+  XCTAssertEqual(cache.size(), 1);
+
+  fbsdk::MPredictionKey newerModel = key;
+  newerModel.model_version = 2;
+  XCTAssertFalse(cache.Lookup(newerModel, cached), "Should not return predictions of another model");
+  fbsdk::MPredictionKey otherTask = key;
+  otherTask.task = "app_event_pred";
+  XCTAssertFalse(cache.Lookup(otherTask, cached));
+  fbsdk::MPredictionKey otherText = key;
+  otherText.SetText("fb_content_ids");
+  XCTAssertFalse(cache.Lookup(otherText, cached));
+
+  cache.Clear();
+  XCTAssertEqual(cache.size(), 0);
+  XCTAssertEqual(cache.bytes(), 0);
+  XCTAssertFalse(cache.Lookup(key, cached));
+}
+
+- (void)testEvictsLeastRecentlyUsed
+{
+  const float probs[] = {1, 0};
+  fbsdk::MPredictionKey a = {"integrity_detect", 1, 0, 0, ""};
+  fbsdk::MPredictionKey b = a;
+  fbsdk::MPredictionKey c = a;
+  a.SetText("a");
+  b.SetText("b");
+  c.SetText("c");
+  fbsdk::MPredictionCache probe(1 << 20);
+  probe.Insert(a, probs, 2);
+  // room for exactly two entries
+  fbsdk::MPredictionCache cache(2 * probe.bytes());
+
+  std::vector<float> cached;
+  cache.Insert(a, probs, 2);
+  cache.Insert(b, probs, 2);
+  XCTAssertTrue(cache.Lookup(a, cached));
+  cache.Insert(c, probs, 2);
+  XCTAssertEqual(cache.size(), 2);
+  XCTAssertLessThanOrEqual(cache.bytes(), 2 * probe.bytes());
+  XCTAssertTrue(cache.Lookup(a, cached));
+  XCTAssertFalse(cache.Lookup(b, cached), "Should evict the least recently used entry");
+  XCTAssertTrue(cache.Lookup(c, cached));
+}
+
+- (void)testCollidingTextHashesDoNotMatch
+{
+  fbsdk::MPredictionCache cache(4096);
+  const float probs[] = {1, 0};
+  fbsdk::MPredictionKey key = {"integrity_detect", 1, 0, 0, ""};
+  key.SetText("fb_content_id");
+  cache.Insert(key, probs, 2);
+  fbsdk::MPredictionKey collision = key;
+  collision.text = "fb_content_ie";
+
+  std::vector<float> cached;
+  XCTAssertFalse(cache.Lookup(collision, cached), "Should compare the texts of keys whose hashes collide");
+  XCTAssertTrue(cache.Lookup(key, cached));
+}
+
+- (void)testCountsTheTextAgainstTheCap
+{
+  const float probs[] = {1, 0};
+  fbsdk::MPredictionKey key = {"integrity_detect", 1, 0, 0, ""};
+  key.SetText("a");
+  fbsdk::MPredictionCache shortText(1 << 20);
+  shortText.Insert(key, probs, 2);
+  key.SetText(std::string(1000, 'a').c_str());
+  fbsdk::MPredictionCache longText(1 << 20);
+  longText.Insert(key, probs, 2);
+  XCTAssertGreaterThanOrEqual(longText.bytes(), shortText.bytes() + 999);
+
+  fbsdk::MPredictionCache tooSmall(longText.bytes() - 1);
+  tooSmall.Insert(key, probs, 2);
+  XCTAssertEqual(tooSmall.size(), 0, "Should not cache an entry whose text exceeds the cap");
+}
+
+- (void)testHashDenseFeatures
+{
+  float df[30] = {0};
+  const uint64_t zeros = fbsdk::MHashDenseFeatures(df, 30);
+  df[29] = 1;
+  XCTAssertNotEqual(fbsdk::MHashDenseFeatures(df, 30), zeros);
+  XCTAssertEqual(fbsdk::MHashDenseFeatures(nullptr, 30), 0);
+}
+
+@end
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#import <XCTest/XCTest.h>
+
+#include <malloc/malloc.h>
+#include <stdlib.h>
+#include <vector>
+
+#import <FBSDKCoreKit/FBSDKCoreKit.h>
+
+#import "FBSDKBatchEventProcessing.h"
+#import "FBSDKMLMacros.h"
+#import "FBSDKModelManager+Testing.h"
+#import "FBSDKSuggestedEventsInferenceQueue+Testing.h"
+
+#include "FBSDKMockMTMLWeights.hpp"
+#include "FBSDKModelRuntime.hpp"
+#include "FBSDKModelWeights.hpp"
+
+// dense features are large enough that the small allocations of the queue cannot reuse them once freed
+static const size_t kTestDenseFeaturesBytes = 1 << 20;
+
+// A view tree {@"dense" : @(v)} has the dense features v, v + 1, ..., other view trees have none
+@interface FBSDKTestDenseFeatureExtractor : NSObject <FBSDKFeatureExtracting>
+@end
+
+@implementation FBSDKTestDenseFeatureExtractor
+
++ (nullable float *)getDenseFeatures:(NSDictionary<NSString *, id> *)viewHierarchy
+{
+  NSNumber *value = viewHierarchy[@"dense"];
+  if (!value) {
+    return nullptr;
+  }
+  float *denseData = (float *)malloc(kTestDenseFeaturesBytes);
+  for (int i = 0; i < DENSE_FEATURE_LEN; i++) {
+    denseData[i] = value.floatValue + i;
+  }
+  return denseData;
+}
+
++ (NSString *)getTextFeature:(NSString *)text withScreenName:(NSString *)screenName
+{
+  return [NSString stringWithFormat:@"%@ | %@", text, screenName];
+}
+
++ (void)loadRulesForKey:(NSString *)useCaseKey {}
+
+@end
+
+// Predicts "event v" for dense features v, v + 1, ... and "other" without dense features
+@interface FBSDKTestEventProcessor : NSObject <FBSDKEventProcessing>
+@property (nonatomic, readonly) NSMutableArray<NSString *> *processedTextFeatures;
+@end
+
+@implementation FBSDKTestEventProcessor
+
+- (instancetype)init
+{
+  if ((self = [super init])) {
+    _processedTextFeatures = [NSMutableArray array];
+  }
+  return self;
+}
+
+- (NSString *)processSuggestedEvents:(NSString *)textFeature denseData:(nullable float *)denseData
+{
+  [self.processedTextFeatures addObject:textFeature];
+  return denseData ? [NSString stringWithFormat:@"event %g", denseData[0]] : SUGGESTED_EVENT_OTHER;
+}
+
+- (void)enable {}
+
+@end
+
+// Batched variant of FBSDKTestEventProcessor, which can leave out the event of the last text
+@interface FBSDKTestBatchEventProcessor : FBSDKTestEventProcessor <FBSDKBatchEventProcessing>
+@property (nonatomic) NSUInteger batchCount;
+@property (nonatomic) BOOL dropsLastEvent;
+@end
+
+@implementation FBSDKTestBatchEventProcessor
+
+- (NSArray<NSString *> *)processSuggestedEventsForTextFeatures:(NSArray<NSString *> *)textFeatures denseData:(nullable float *)denseData
+{
+  self.batchCount++;
+  NSMutableArray<NSString *> *events = [NSMutableArray array];
+  for (NSUInteger i = 0; i < textFeatures.count; i++) {
+    [self.processedTextFeatures addObject:textFeatures[i]];
+    if (!self.dropsLastEvent || i + 1 < textFeatures.count) {
+      [events addObject:denseData ? [NSString stringWithFormat:@"event %g", denseData[i * DENSE_FEATURE_LEN]] : SUGGESTED_EVENT_OTHER];
+    }
+  }
+  return events;
+}
+
+@end
+
+@interface FBSDKSuggestedEventsInferenceQueueTests : XCTestCase
+
+@end
+
+@implementation FBSDKSuggestedEventsInferenceQueueTests
+{
+  NSMutableDictionary<NSString *, NSString *> *_events;
+  std::vector<float *> _denseData;
+}
+
+- (void)setUp
+{
+  [super setUp];
+
+  _events = [NSMutableDictionary dictionary];
+  _denseData.clear();
+}
+
+- (void)tearDown
+{
+  [FBSDKModelManager reset];
+
+  [super tearDown];
+}
+
+- (void)testBatchesOnlyRequestsWithDenseFeatures
+{
+  FBSDKTestBatchEventProcessor *processor = [FBSDKTestBatchEventProcessor new];
+  FBSDKSuggestedEventsInferenceQueue *queue = [[FBSDKSuggestedEventsInferenceQueue alloc] initWithEventProcessor:processor
+                                                                                                featureExtractor:FBSDKTestDenseFeatureExtractor.class];
+  [self submitText:@"sign up" dense:@1 toQueue:queue];
+  [self submitText:@"help" dense:nil toQueue:queue];
+  [self submitText:@"add to cart" dense:@3 toQueue:queue];
+  [self submitText:@"about" dense:nil toQueue:queue];
+  [queue drain];
+
+  XCTAssertEqual(processor.batchCount, 1);
+  XCTAssertEqualObjects(processor.processedTextFeatures, (@[@"sign up | screen", @"add to cart | screen"]));
+  XCTAssertEqualObjects(_events[@"sign up"], @"event 1");
+  XCTAssertEqualObjects(_events[@"help"], SUGGESTED_EVENT_OTHER, "Should not predict a request without dense features");
+  XCTAssertEqualObjects(_events[@"add to cart"], @"event 3", "Should map the batched events back to their requests");
+  XCTAssertEqualObjects(_events[@"about"], SUGGESTED_EVENT_OTHER);
+}
+
+- (void)testMissingBatchedEventIsOther
+{
+  FBSDKTestBatchEventProcessor *processor = [FBSDKTestBatchEventProcessor new];
+  processor.dropsLastEvent = YES;
+  FBSDKSuggestedEventsInferenceQueue *queue = [[FBSDKSuggestedEventsInferenceQueue alloc] initWithEventProcessor:processor
+                                                                                                featureExtractor:FBSDKTestDenseFeatureExtractor.class];
+  [self submitText:@"sign up" dense:@1 toQueue:queue];
+  [self submitText:@"add to cart" dense:@3 toQueue:queue];
+  [queue drain];
+
+  XCTAssertEqualObjects(_events[@"sign up"], @"event 1");
+  XCTAssertEqualObjects(_events[@"add to cart"], SUGGESTED_EVENT_OTHER);
+}
+
+- (void)testFallsBackToSingleRequests
+{
+  FBSDKTestEventProcessor *processor = [FBSDKTestEventProcessor new];
+  FBSDKSuggestedEventsInferenceQueue *queue = [[FBSDKSuggestedEventsInferenceQueue alloc] initWithEventProcessor:processor
+                                                                                                featureExtractor:FBSDKTestDenseFeatureExtractor.class];
+  [self submitText:@"sign up" dense:@1 toQueue:queue];
+  [self submitText:@"help" dense:nil toQueue:queue];
+  [queue drain];
+
+  XCTAssertEqualObjects(processor.processedTextFeatures, (@[@"sign up | screen", @"help | screen"]), "Should process every request on its own");
+  XCTAssertEqualObjects(_events[@"sign up"], @"event 1");
+  XCTAssertEqualObjects(_events[@"help"], SUGGESTED_EVENT_OTHER);
+}
+
+- (void)testFreesDenseDataAfterTheCompletion
+{
+  FBSDKSuggestedEventsInferenceQueue *queue = [[FBSDKSuggestedEventsInferenceQueue alloc] initWithEventProcessor:[FBSDKTestBatchEventProcessor new]
+                                                                                                featureExtractor:FBSDKTestDenseFeatureExtractor.class];
+  [self submitText:@"sign up" dense:@1 toQueue:queue];
+  [self submitText:@"help" dense:nil toQueue:queue];
+  [self submitText:@"add to cart" dense:@3 toQueue:queue];
+  [queue drain];
+
+  XCTAssertEqual(_denseData.size(), 3);
+  XCTAssertTrue(_denseData[1] == nullptr);
+  for (float *denseData : {_denseData[0], _denseData[2]}) {
+    XCTAssertEqual(malloc_size(denseData), 0, "Should free the dense features once the completion returns");
+  }
+}
+
+- (void)testManagerPredictsBatches
+{
+  const std::vector<char> &container = fbsdk::MSerializeWeights(FBSDKMockMTMLWeights());
+  FBSDKModelManager *manager = FBSDKModelManager.shared;
+  XCTAssertTrue([manager conformsToProtocol:@protocol(FBSDKBatchEventProcessing)], "Should let the queue batch its predictions");
+  XCTAssertTrue([manager publishMTMLWeights:[NSData dataWithBytes:container.data() length:container.size()]]);
+  // every prediction clears the threshold of the second class
+  [FBSDKModelManager setModelInfo:@{MTMLTaskAppEventPredKey : @{THRESHOLDS_KEY : @[@1.1, @0, @0, @0, @0]}}];
+  NSString *predicted = [FBSDKModelManager getSuggestedEventsMapping][1];
+
+  std::vector<float> denseData(3 * DENSE_FEATURE_LEN);
+  for (size_t i = 0; i < denseData.size(); i++) {
+    denseData[i] = (float)(i % 7);
+  }
+  NSArray<NSString *> *textFeatures = @[@"sign up", @"", @"add to cart"];
+  NSArray<NSString *> *expected = @[predicted, SUGGESTED_EVENT_OTHER, predicted];
+  XCTAssertEqualObjects([manager processSuggestedEventsForTextFeatures:textFeatures denseData:denseData.data()], expected);
+  XCTAssertEqualObjects([manager processSuggestedEventsForTextFeatures:textFeatures denseData:denseData.data()], expected, "Should predict the same from the cache");
+  XCTAssertEqualObjects([manager processSuggestedEvents:@"add to cart" denseData:denseData.data() + 2 * DENSE_FEATURE_LEN], predicted);
+  XCTAssertEqualObjects(
+    [manager processSuggestedEventsForTextFeatures:textFeatures denseData:nullptr],
+    (@[SUGGESTED_EVENT_OTHER, SUGGESTED_EVENT_OTHER, SUGGESTED_EVENT_OTHER])
+  );
+}
+
+- (void)submitText:(NSString *)text dense:(nullable NSNumber *)dense toQueue:(FBSDKSuggestedEventsInferenceQueue *)queue
+{
+  NSDictionary<NSString *, id> *viewTree = dense ? @{@"dense" : dense} : @{};
+  XCTAssertTrue([queue submitEventForText:text screenName:@"screen" viewTree:viewTree completion:^(NSString *event, float *denseData, NSTimeInterval latency) {
+    self->_events[text] = event;
+    self->_denseData.push_back(denseData);
+    if (dense) {
+      XCTAssertEqual(denseData[DENSE_FEATURE_LEN - 1], dense.floatValue + DENSE_FEATURE_LEN - 1, "Should not free the dense features before the completion");
+    }
+  }]);
+}
+
+@end
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+final class TestBatchIntegrityProcessor: BatchIntegrityProcessing {
+  var stubbedParameters = [String: Bool]()
+  var capturedBatches = [[String]]()
+  var singleParameterCallCount = 0
+
+  func processIntegrity(_ potentialParameter: String?) -> Bool {
+    singleParameterCallCount += 1
+    guard let parameter = potentialParameter else {
+      return false
+    }
+
+    return stubbedParameters[parameter] ?? false
+  }
+
+  func processIntegrity(forParameters parameters: [String]) -> [NSNumber] {
+    capturedBatches.append(parameters)
+    return parameters.map { NSNumber(value: stubbedParameters[$0] ?? false) }
+  }
+}